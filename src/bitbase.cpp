@@ -18,8 +18,8 @@
 
 #include <cassert>
 #include <vector>
-#include <bitset>
 
+#include "bitbase_data.h"
 #include "bitboard.h"
 #include "types.h"
 
@@ -31,7 +31,7 @@ namespace {
   // Positions with the pawn on files E to H will be mirrored before probing.
   constexpr unsigned MAX_INDEX = 2*24*64*64; // stm * psq * wksq * bksq = 196608
 
-  std::bitset<MAX_INDEX> KPKBitbase;
+  static_assert(sizeof(Bitbases::KPKData) * 8 == MAX_INDEX, "KPK data size mismatch");
 
   // A KPK bitbase index is an integer in [0, IndexMax] range
   //
@@ -46,6 +46,11 @@ namespace {
     return int(wksq) | (bksq << 6) | (stm << 12) | (file_of(psq) << 13) | ((RANK_7 - rank_of(psq)) << 15);
   }
 
+#ifndef NDEBUG
+
+  // The retrograde analysis below generated bitbase_data.h. Only debug builds
+  // compile it, to check the embedded data at startup.
+
   enum Result {
     INVALID = 0,
     UNKNOWN = 1,
@@ -66,18 +71,25 @@ namespace {
     Result result;
   };
 
+#endif
+
 } // namespace
 
 bool Bitbases::probe(Square wksq, Square wpsq, Square bksq, Color stm) {
 
   assert(file_of(wpsq) <= FILE_D);
 
-  return KPKBitbase[index(stm, bksq, wksq, wpsq)];
+  unsigned idx = index(stm, bksq, wksq, wpsq);
+  return (KPKData[idx / 64] >> (idx % 64)) & 1;
 }
 
 
+/// Bitbases::init() has nothing to do in release builds, the bitbase is embedded
+/// in bitbase_data.h. Debug builds rerun the analysis and check it bit by bit.
+
 void Bitbases::init() {
 
+#ifndef NDEBUG
   std::vector<KPKPosition> db(MAX_INDEX);
   unsigned idx, repeat = 1;
 
@@ -91,14 +103,16 @@ void Bitbases::init() {
       for (repeat = idx = 0; idx < MAX_INDEX; ++idx)
           repeat |= (db[idx] == UNKNOWN && db[idx].classify(db) != UNKNOWN);
 
-  // Fill the bitbase with the decisive results
+  // The embedded bitbase must hold exactly the decisive results
   for (idx = 0; idx < MAX_INDEX; ++idx)
-      if (db[idx] == WIN)
-          KPKBitbase.set(idx);
+      assert(bool((KPKData[idx / 64] >> (idx % 64)) & 1) == (db[idx] == WIN));
+#endif
 }
 
 namespace {
 
+#ifndef NDEBUG
+
   KPKPosition::KPKPosition(unsigned idx) {
 
     ksq[WHITE] = Square((idx >>  0) & 0x3F);
@@ -167,6 +181,8 @@ namespace {
     return result = r & Good  ? Good  : r & UNKNOWN ? UNKNOWN : Bad;
   }
 
+#endif
+
 } // namespace
 
 } // namespace Stockfish
@@ -0,0 +1,808 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2022 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BITBASE_DATA_H_INCLUDED
+#define BITBASE_DATA_H_INCLUDED
+
+#include <cstdint>
+
+namespace Stockfish {
+
+namespace Bitbases {
+
+// KPK bitbase as computed by the retrograde analysis in bitbase.cpp, packed
+// 64 positions per word: bit (idx % 64) of word (idx / 64) is set when the
+// position with index idx is a win for the side with the pawn. Debug builds
+// recompute the table at startup and assert that it matches this data.
+constexpr uint64_t KPKData[] = {
+  0xFFFEFFFFFFFFFCFCULL, 0xFFFEFFFFFFFFF8F8ULL, 0xFFFEFFFFFFFFF1F1ULL, 0xFFFEFFFFFFFFE3E3ULL,
+  0xFFFEFFFFFFFFC7C7ULL, 0xFFFEFFFFFFFF8F8FULL, 0xFFFEFFFFFFFF1F1FULL, 0xFFFEFFFFFFFF3F3FULL,
+  0xFFFEFFFFFFFCFCFCULL, 0xFFFEFFFFFFF8F8F8ULL, 0xFFFEFFFFFFF1F1F1ULL, 0xFFFEFFFFFFE3E3E3ULL,
+  0xFFFEFFFFFFC7C7C7ULL, 0xFFFEFFFFFF8F8F8FULL, 0xFFFEFFFFFF1F1F1FULL, 0xFFFEFFFFFF3F3F3FULL,
+  0xFFFEFFFFFCFCFCFFULL, 0xFFFEFFFFF8F8F8FFULL, 0xFFFEFFFFF1F1F1FFULL, 0xFFFEFFFFE3E3E3FFULL,
+  0xFFFEFFFFC7C7C7FFULL, 0xFFFEFFFF8F8F8FFFULL, 0xFFFEFFFF1F1F1FFFULL, 0xFFFEFFFF3F3F3FFFULL,
+  0xFFFEFFFCFCFCFFFFULL, 0xFFFEFFF8F8F8FFFFULL, 0xFFFEFFF1F1F1FFFFULL, 0xFFFEFFE3E3E3FFFFULL,
+  0xFFFEFFC7C7C7FFFFULL, 0xFFFEFF8F8F8FFFFFULL, 0xFFFEFF1F1F1FFFFFULL, 0xFFFEFF3F3F3FFFFFULL,
+  0xFFFEFCFCFCFFFFFFULL, 0xFFFEF8F8F8FFFFFFULL, 0xFFFEF1F1F1FFFFFFULL, 0xFFFEE3E3E3FFFFFFULL,
+  0xFFFEC7C7C7FFFFFFULL, 0xFFFE8F8F8FFFFFFFULL, 0xFFFE1F1F1FFFFFFFULL, 0xFFFE3F3F3FFFFFFFULL,
+  0xFFFCFCFCFFFFFFFFULL, 0xFFF8F8F8FFFFFFFFULL, 0xFFF0F1F1FFFFFFFFULL, 0xFFE2E3E3FFFFFFFFULL,
+  0xFFC6C7C7FFFFFFFFULL, 0xFF8E8F8FFFFFFFFFULL, 0xFF1E1F1FFFFFFFFFULL, 0xFF3E3F3FFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0xF0F0F1FFFFFFFFFFULL, 0xE3E2E3FFFFFFFFFFULL,
+  0xC7C6C7FFFFFFFFFFULL, 0x8F8E8FFFFFFFFFFFULL, 0x1F1E1FFFFFFFFFFFULL, 0x3F3E3FFFFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0xF0F0FFFFFFFFFFFFULL, 0xE3E2FFFFFFFFFFFFULL,
+  0xC7C6FFFFFFFFFFFFULL, 0x8F8EFFFFFFFFFFFFULL, 0x1F1EFFFFFFFFFFFFULL, 0x3F3EFFFFFFFFFFFFULL,
+  0xFFFEFFFFFFFFFCFCULL, 0xFFFEFFFFFFFFF8F8ULL, 0xFFFEFFFFFFFFF1F1ULL, 0xFFFEFFFFFFFFE3E3ULL,
+  0xFFFEFFFFFFFFC7C7ULL, 0xFFFEFFFFFFFF8F8FULL, 0xFFFEFFFFFFFF1F1FULL, 0xFFFEFFFFFFFF3F3FULL,
+  0xFFFEFFFFFFFCFCFCULL, 0xFFFEFFFFFFF8F8F8ULL, 0xFFFEFFFFFFF1F1F1ULL, 0xFFFEFFFFFFE3E3E3ULL,
+  0xFFFEFFFFFFC7C7C7ULL, 0xFFFEFFFFFF8F8F8FULL, 0xFFFEFFFFFF1F1F1FULL, 0xFFFEFFFFFF3F3F3FULL,
+  0xFFFEFFFFFCFCFCFFULL, 0xFFFEFFFFF8F8F8FFULL, 0xFFFEFFFFF1F1F1FFULL, 0xFFFEFFFFE3E3E3FFULL,
+  0xFFFEFFFFC7C7C7FFULL, 0xFFFEFFFF8F8F8FFFULL, 0xFFFEFFFF1F1F1FFFULL, 0xFFFEFFFF3F3F3FFFULL,
+  0xFFFEFFFCFCFCFFFFULL, 0xFFFEFFF8F8F8FFFFULL, 0xFFFEFFF1F1F1FFFFULL, 0xFFFEFFE3E3E3FFFFULL,
+  0xFFFEFFC7C7C7FFFFULL, 0xFFFEFF8F8F8FFFFFULL, 0xFFFEFF1F1F1FFFFFULL, 0xFFFEFF3F3F3FFFFFULL,
+  0xFFFEFCFCFCFFFFFFULL, 0xFFFEF8F8F8FFFFFFULL, 0xFFFEF1F1F1FFFFFFULL, 0xFFFEE3E3E3FFFFFFULL,
+  0xFFFEC7C7C7FFFFFFULL, 0xFFFE8F8F8FFFFFFFULL, 0xFFFE1F1F1FFFFFFFULL, 0xFFFE3F3F3FFFFFFFULL,
+  0x0300000000000000ULL, 0x0200000000000000ULL, 0x0600010000000000ULL, 0xFEE2E3E3FFFFFFFFULL,
+  0xFFC6C7C7FFFFFFFFULL, 0xFF8E8F8FFFFFFFFFULL, 0xFF1E1F1FFFFFFFFFULL, 0xFF3E3F3FFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000010000000000ULL, 0xE2E2E3FFFFFFFFFFULL,
+  0xC7C6C7FFFFFFFFFFULL, 0x8F8E8FFFFFFFFFFFULL, 0x1F1E1FFFFFFFFFFFULL, 0x3F3E3FFFFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000070000000000ULL, 0xE2E2FFFFFFFFFFFFULL,
+  0xC7C6FFFFFFFFFFFFULL, 0x8F8EFFFFFFFFFFFFULL, 0x1F1EFFFFFFFFFFFFULL, 0x3F3EFFFFFFFFFFFFULL,
+  0xFFFDFFFFFFFFFCFCULL, 0xFFFDFFFFFFFFF8F8ULL, 0xFFFDFFFFFFFFF1F1ULL, 0xFFFDFFFFFFFFE3E3ULL,
+  0xFFFDFFFFFFFFC7C7ULL, 0xFFFDFFFFFFFF8F8FULL, 0xFFFDFFFFFFFF1F1FULL, 0xFFFDFFFFFFFF3F3FULL,
+  0xFFFDFFFFFFFCFCFCULL, 0xFFFDFFFFFFF8F8F8ULL, 0xFFFDFFFFFFF1F1F1ULL, 0xFFFDFFFFFFE3E3E3ULL,
+  0xFFFDFFFFFFC7C7C7ULL, 0xFFFDFFFFFF8F8F8FULL, 0xFFFDFFFFFF1F1F1FULL, 0xFFFDFFFFFF3F3F3FULL,
+  0xFFFDFFFFFCFCFCFFULL, 0xFFFDFFFFF8F8F8FFULL, 0xFFFDFFFFF1F1F1FFULL, 0xFFFDFFFFE3E3E3FFULL,
+  0xFFFDFFFFC7C7C7FFULL, 0xFFFDFFFF8F8F8FFFULL, 0xFFFDFFFF1F1F1FFFULL, 0xFFFDFFFF3F3F3FFFULL,
+  0xFFFDFFFCFCFCFFFFULL, 0xFFFDFFF8F8F8FFFFULL, 0xFFFDFFF1F1F1FFFFULL, 0xFFFDFFE3E3E3FFFFULL,
+  0xFFFDFFC7C7C7FFFFULL, 0xFFFDFF8F8F8FFFFFULL, 0xFFFDFF1F1F1FFFFFULL, 0xFFFDFF3F3F3FFFFFULL,
+  0xFFFDFCFCFCFFFFFFULL, 0xFFFDF8F8F8FFFFFFULL, 0xFFFDF1F1F1FFFFFFULL, 0xFFFDE3E3E3FFFFFFULL,
+  0xFFFDC7C7C7FFFFFFULL, 0xFFFD8F8F8FFFFFFFULL, 0xFFFD1F1F1FFFFFFFULL, 0xFFFD3F3F3FFFFFFFULL,
+  0xFFFCFCFCFFFFFFFFULL, 0xFFF8F8F8FFFFFFFFULL, 0xFFF1F1F1FFFFFFFFULL, 0xFFE1E3E3FFFFFFFFULL,
+  0xFFC5C7C7FFFFFFFFULL, 0xFF8D8F8FFFFFFFFFULL, 0xFF1D1F1FFFFFFFFFULL, 0xFF3D3F3FFFFFFFFFULL,
+  0x0C0C0C0000000000ULL, 0x0000000000000000ULL, 0x0101010000000000ULL, 0xE3E1E3FFFFFFFFFFULL,
+  0xC7C5C7FFFFFFFFFFULL, 0x8F8D8FFFFFFFFFFFULL, 0x1F1D1FFFFFFFFFFFULL, 0x3F3D3FFFFFFFFFFFULL,
+  0x0000000000000000ULL, 0x00080A0F00000000ULL, 0x0000000000000000ULL, 0xE3E1FFFFFFFFFFFFULL,
+  0xC7C5FFFFFFFFFFFFULL, 0x8F8DFFFFFFFFFFFFULL, 0x1F1DFFFFFFFFFFFFULL, 0x3F3DFFFFFFFFFFFFULL,
+  0xFFFDFFFFFFFFFCFCULL, 0xFFFDFFFFFFFFF8F8ULL, 0xFFFDFFFFFFFFF1F1ULL, 0xFFFDFFFFFFFFE3E3ULL,
+  0xFFFDFFFFFFFFC7C7ULL, 0xFFFDFFFFFFFF8F8FULL, 0xFFFDFFFFFFFF1F1FULL, 0xFFFDFFFFFFFF3F3FULL,
+  0xFFFDFFFFFFFCFCFCULL, 0xFFFDFFFFFFF8F8F8ULL, 0xFFFDFFFFFFF1F1F1ULL, 0xFFFDFFFFFFE3E3E3ULL,
+  0xFFFDFFFFFFC7C7C7ULL, 0xFFFDFFFFFF8F8F8FULL, 0xFFFDFFFFFF1F1F1FULL, 0xFFFDFFFFFF3F3F3FULL,
+  0xFFFDFFFFFCFCFCFFULL, 0xFFFDFFFFF8F8F8FFULL, 0xFFFDFFFFF1F1F1FFULL, 0xFFFDFFFFE3E3E3FFULL,
+  0xFFFDFFFFC7C7C7FFULL, 0xFFFDFFFF8F8F8FFFULL, 0xFFFDFFFF1F1F1FFFULL, 0xFFFDFFFF3F3F3FFFULL,
+  0xFFFDFFFCFCFCFFFFULL, 0xFFFDFFF8F8F8FFFFULL, 0xFFFDFFF1F1F1FFFFULL, 0xFFFDFFE3E3E3FFFFULL,
+  0xFFFDFFC7C7C7FFFFULL, 0xFFFDFF8F8F8FFFFFULL, 0xFFFDFF1F1F1FFFFFULL, 0xFFFDFF3F3F3FFFFFULL,
+  0xFFFDFCFCFCFFFFFFULL, 0xFFFDF8F8F8FFFFFFULL, 0xFFFDF1F1F1FFFFFFULL, 0xFFFDE3E3E3FFFFFFULL,
+  0xFFFDC7C7C7FFFFFFULL, 0xFFFD8F8F8FFFFFFFULL, 0xFFFD1F1F1FFFFFFFULL, 0xFFFD3F3F3FFFFFFFULL,
+  0x0704040000000000ULL, 0x0700000000000000ULL, 0x0701010000000000ULL, 0x0F01030000000000ULL,
+  0xFFC5C7C7FFFFFFFFULL, 0xFF8D8F8FFFFFFFFFULL, 0xFF1D1F1FFFFFFFFFULL, 0xFF3D3F3FFFFFFFFFULL,
+  0x0404000000000000ULL, 0x0000000000000000ULL, 0x0101000000000000ULL, 0x0301030000000000ULL,
+  0xC7C5C7FFFFFFFFFFULL, 0x8F8D8FFFFFFFFFFFULL, 0x1F1D1FFFFFFFFFFFULL, 0x3F3D3FFFFFFFFFFFULL,
+  0x0404020000000000ULL, 0x0000050000000000ULL, 0x0101020000000000ULL, 0x03010F0000000000ULL,
+  0xC7C5FFFFFFFFFFFFULL, 0x8F8DFFFFFFFFFFFFULL, 0x1F1DFFFFFFFFFFFFULL, 0x3F3DFFFFFFFFFFFFULL,
+  0xFFFBFFFFFFFFFCFCULL, 0xFFFBFFFFFFFFF8F8ULL, 0xFFFBFFFFFFFFF1F1ULL, 0xFFFBFFFFFFFFE3E3ULL,
+  0xFFFBFFFFFFFFC7C7ULL, 0xFFFBFFFFFFFF8F8FULL, 0xFFFBFFFFFFFF1F1FULL, 0xFFFBFFFFFFFF3F3FULL,
+  0xFFFBFFFFFFFCFCFCULL, 0xFFFBFFFFFFF8F8F8ULL, 0xFFFBFFFFFFF1F1F1ULL, 0xFFFBFFFFFFE3E3E3ULL,
+  0xFFFBFFFFFFC7C7C7ULL, 0xFFFBFFFFFF8F8F8FULL, 0xFFFBFFFFFF1F1F1FULL, 0xFFFBFFFFFF3F3F3FULL,
+  0xFFFBFFFFFCFCFCFFULL, 0xFFFBFFFFF8F8F8FFULL, 0xFFFBFFFFF1F1F1FFULL, 0xFFFBFFFFE3E3E3FFULL,
+  0xFFFBFFFFC7C7C7FFULL, 0xFFFBFFFF8F8F8FFFULL, 0xFFFBFFFF1F1F1FFFULL, 0xFFFBFFFF3F3F3FFFULL,
+  0xFFFBFFFCFCFCFFFFULL, 0xFFFBFFF8F8F8FFFFULL, 0xFFFBFFF1F1F1FFFFULL, 0xFFFBFFE3E3E3FFFFULL,
+  0xFFFBFFC7C7C7FFFFULL, 0xFFFBFF8F8F8FFFFFULL, 0xFFFBFF1F1F1FFFFFULL, 0xFFFBFF3F3F3FFFFFULL,
+  0xFFFBFCFCFCFFFFFFULL, 0xFFFBF8F8F8FFFFFFULL, 0xFFFBF1F1F1FFFFFFULL, 0xFFFBE3E3E3FFFFFFULL,
+  0xFFFBC7C7C7FFFFFFULL, 0xFFFB8F8F8FFFFFFFULL, 0xFFFB1F1F1FFFFFFFULL, 0xFFFB3F3F3FFFFFFFULL,
+  0xFFF8FCFCFFFFFFFFULL, 0xFFF8F8F8FFFFFFFFULL, 0xFFF1F1F1FFFFFFFFULL, 0xFFE3E3E3FFFFFFFFULL,
+  0xFFC3C7C7FFFFFFFFULL, 0xFF8B8F8FFFFFFFFFULL, 0xFF1B1F1FFFFFFFFFULL, 0xFF3B3F3FFFFFFFFFULL,
+  0xFCF8FCFFFFFFFFFFULL, 0x1818180000000000ULL, 0x0000000000000000ULL, 0x0303030000000000ULL,
+  0xC7C3C7FFFFFFFFFFULL, 0x8F8B8FFFFFFFFFFFULL, 0x1F1B1FFFFFFFFFFFULL, 0x3F3B3FFFFFFFFFFFULL,
+  0xFCF8FFFFFFFFFFFFULL, 0x0000000000000000ULL, 0x0011151F00000000ULL, 0x0000000000000000ULL,
+  0xC7C3FFFFFFFFFFFFULL, 0x8F8BFFFFFFFFFFFFULL, 0x1F1BFFFFFFFFFFFFULL, 0x3F3BFFFFFFFFFFFFULL,
+  0xFFFBFFFFFFFFFCFCULL, 0xFFFBFFFFFFFFF8F8ULL, 0xFFFBFFFFFFFFF1F1ULL, 0xFFFBFFFFFFFFE3E3ULL,
+  0xFFFBFFFFFFFFC7C7ULL, 0xFFFBFFFFFFFF8F8FULL, 0xFFFBFFFFFFFF1F1FULL, 0xFFFBFFFFFFFF3F3FULL,
+  0xFFFBFFFFFFFCFCFCULL, 0xFFFBFFFFFFF8F8F8ULL, 0xFFFBFFFFFFF1F1F1ULL, 0xFFFBFFFFFFE3E3E3ULL,
+  0xFFFBFFFFFFC7C7C7ULL, 0xFFFBFFFFFF8F8F8FULL, 0xFFFBFFFFFF1F1F1FULL, 0xFFFBFFFFFF3F3F3FULL,
+  0xFFFBFFFFFCFCFCFFULL, 0xFFFBFFFFF8F8F8FFULL, 0xFFFBFFFFF1F1F1FFULL, 0xFFFBFFFFE3E3E3FFULL,
+  0xFFFBFFFFC7C7C7FFULL, 0xFFFBFFFF8F8F8FFFULL, 0xFFFBFFFF1F1F1FFFULL, 0xFFFBFFFF3F3F3FFFULL,
+  0xFFFBFFFCFCFCFFFFULL, 0xFFFBFFF8F8F8FFFFULL, 0xFFFBFFF1F1F1FFFFULL, 0xFFFBFFE3E3E3FFFFULL,
+  0xFFFBFFC7C7C7FFFFULL, 0xFFFBFF8F8F8FFFFFULL, 0xFFFBFF1F1F1FFFFFULL, 0xFFFBFF3F3F3FFFFFULL,
+  0xFFFBFCFCFCFFFFFFULL, 0xFFFBF8F8F8FFFFFFULL, 0xFFFBF1F1F1FFFFFFULL, 0xFFFBE3E3E3FFFFFFULL,
+  0xFFFBC7C7C7FFFFFFULL, 0xFFFB8F8F8FFFFFFFULL, 0xFFFB1F1F1FFFFFFFULL, 0xFFFB3F3F3FFFFFFFULL,
+  0x1F181C0000000000ULL, 0x0E08080000000000ULL, 0x0E00000000000000ULL, 0x0E02020000000000ULL,
+  0x1F03070000000000ULL, 0xFF8B8F8FFFFFFFFFULL, 0xFF1B1F1FFFFFFFFFULL, 0xFF3B3F3FFFFFFFFFULL,
+  0x1C181C0000000000ULL, 0x0808000000000000ULL, 0x0000000000000000ULL, 0x0202000000000000ULL,
+  0x0703070000000000ULL, 0x8F8B8FFFFFFFFFFFULL, 0x1F1B1FFFFFFFFFFFULL, 0x3F3B3FFFFFFFFFFFULL,
+  0x1C181C0000000000ULL, 0x0808040000000000ULL, 0x00000A0000000000ULL, 0x0202040000000000ULL,
+  0x07031F0000000000ULL, 0x8F8BFFFFFFFFFFFFULL, 0x1F1BFFFFFFFFFFFFULL, 0x3F3BFFFFFFFFFFFFULL,
+  0xFFF7FFFFFFFFFCFCULL, 0xFFF7FFFFFFFFF8F8ULL, 0xFFF7FFFFFFFFF1F1ULL, 0xFFF7FFFFFFFFE3E3ULL,
+  0xFFF7FFFFFFFFC7C7ULL, 0xFFF7FFFFFFFF8F8FULL, 0xFFF7FFFFFFFF1F1FULL, 0xFFF7FFFFFFFF3F3FULL,
+  0xFFF7FFFFFFFCFCFCULL, 0xFFF7FFFFFFF8F8F8ULL, 0xFFF7FFFFFFF1F1F1ULL, 0xFFF7FFFFFFE3E3E3ULL,
+  0xFFF7FFFFFFC7C7C7ULL, 0xFFF7FFFFFF8F8F8FULL, 0xFFF7FFFFFF1F1F1FULL, 0xFFF7FFFFFF3F3F3FULL,
+  0xFFF7FFFFFCFCFCFFULL, 0xFFF7FFFFF8F8F8FFULL, 0xFFF7FFFFF1F1F1FFULL, 0xFFF7FFFFE3E3E3FFULL,
+  0xFFF7FFFFC7C7C7FFULL, 0xFFF7FFFF8F8F8FFFULL, 0xFFF7FFFF1F1F1FFFULL, 0xFFF7FFFF3F3F3FFFULL,
+  0xFFF7FFFCFCFCFFFFULL, 0xFFF7FFF8F8F8FFFFULL, 0xFFF7FFF1F1F1FFFFULL, 0xFFF7FFE3E3E3FFFFULL,
+  0xFFF7FFC7C7C7FFFFULL, 0xFFF7FF8F8F8FFFFFULL, 0xFFF7FF1F1F1FFFFFULL, 0xFFF7FF3F3F3FFFFFULL,
+  0xFFF7FCFCFCFFFFFFULL, 0xFFF7F8F8F8FFFFFFULL, 0xFFF7F1F1F1FFFFFFULL, 0xFFF7E3E3E3FFFFFFULL,
+  0xFFF7C7C7C7FFFFFFULL, 0xFFF78F8F8FFFFFFFULL, 0xFFF71F1F1FFFFFFFULL, 0xFFF73F3F3FFFFFFFULL,
+  0xFFF4FCFCFFFFFFFFULL, 0xFFF0F8F8FFFFFFFFULL, 0xFFF1F1F1FFFFFFFFULL, 0xFFE3E3E3FFFFFFFFULL,
+  0xFFC7C7C7FFFFFFFFULL, 0xFF878F8FFFFFFFFFULL, 0xFF171F1FFFFFFFFFULL, 0xFF373F3FFFFFFFFFULL,
+  0xFCF4FCFFFFFFFFFFULL, 0xF8F0F8FFFFFFFFFFULL, 0x3030300000000000ULL, 0x0000000000000000ULL,
+  0x0606060000000000ULL, 0x8F878FFFFFFFFFFFULL, 0x1F171FFFFFFFFFFFULL, 0x3F373FFFFFFFFFFFULL,
+  0xFCF4FFFFFFFFFFFFULL, 0xF8F0FFFFFFFFFFFFULL, 0x0000000000000000ULL, 0x00222A3E00000000ULL,
+  0x0000000000000000ULL, 0x8F87FFFFFFFFFFFFULL, 0x1F17FFFFFFFFFFFFULL, 0x3F37FFFFFFFFFFFFULL,
+  0xFFF7FFFFFFFFFCFCULL, 0xFFF7FFFFFFFFF8F8ULL, 0xFFF7FFFFFFFFF1F1ULL, 0xFFF7FFFFFFFFE3E3ULL,
+  0xFFF7FFFFFFFFC7C7ULL, 0xFFF7FFFFFFFF8F8FULL, 0xFFF7FFFFFFFF1F1FULL, 0xFFF7FFFFFFFF3F3FULL,
+  0xFFF7FFFFFFFCFCFCULL, 0xFFF7FFFFFFF8F8F8ULL, 0xFFF7FFFFFFF1F1F1ULL, 0xFFF7FFFFFFE3E3E3ULL,
+  0xFFF7FFFFFFC7C7C7ULL, 0xFFF7FFFFFF8F8F8FULL, 0xFFF7FFFFFF1F1F1FULL, 0xFFF7FFFFFF3F3F3FULL,
+  0xFFF7FFFFFCFCFCFFULL, 0xFFF7FFFFF8F8F8FFULL, 0xFFF7FFFFF1F1F1FFULL, 0xFFF7FFFFE3E3E3FFULL,
+  0xFFF7FFFFC7C7C7FFULL, 0xFFF7FFFF8F8F8FFFULL, 0xFFF7FFFF1F1F1FFFULL, 0xFFF7FFFF3F3F3FFFULL,
+  0xFFF7FFFCFCFCFFFFULL, 0xFFF7FFF8F8F8FFFFULL, 0xFFF7FFF1F1F1FFFFULL, 0xFFF7FFE3E3E3FFFFULL,
+  0xFFF7FFC7C7C7FFFFULL, 0xFFF7FF8F8F8FFFFFULL, 0xFFF7FF1F1F1FFFFFULL, 0xFFF7FF3F3F3FFFFFULL,
+  0xFFF7FCFCFCFFFFFFULL, 0xFFF7F8F8F8FFFFFFULL, 0xFFF7F1F1F1FFFFFFULL, 0xFFF7E3E3E3FFFFFFULL,
+  0xFFF7C7C7C7FFFFFFULL, 0xFFF78F8F8FFFFFFFULL, 0xFFF71F1F1FFFFFFFULL, 0xFFF73F3F3FFFFFFFULL,
+  0xFFF4FCFCFFFFFFFFULL, 0x3E30380000000000ULL, 0x1C10100000000000ULL, 0x1C00000000000000ULL,
+  0x1C04040000000000ULL, 0x3E060E0000000000ULL, 0xFF171F1FFFFFFFFFULL, 0xFF373F3FFFFFFFFFULL,
+  0xFCF4FCFFFFFFFFFFULL, 0x3830380000000000ULL, 0x1010000000000000ULL, 0x0000000000000000ULL,
+  0x0404000000000000ULL, 0x0E060E0000000000ULL, 0x1F171FFFFFFFFFFFULL, 0x3F373FFFFFFFFFFFULL,
+  0xFCF4FFFFFFFFFFFFULL, 0x38303E0000000000ULL, 0x1010080000000000ULL, 0x0000140000000000ULL,
+  0x0404080000000000ULL, 0x0E063E0000000000ULL, 0x1F17FFFFFFFFFFFFULL, 0x3F37FFFFFFFFFFFFULL,
+  0xFFFFFEFFFFFFFCFCULL, 0xFFFFFEFFFFFFF8F8ULL, 0xFFFFFEFFFFFFF1F1ULL, 0xFFFFFEFFFFFFE3E3ULL,
+  0xFFFFFEFFFFFFC7C7ULL, 0xFFFFFEFFFFFF8F8FULL, 0xFFFFFEFFFFFF1F1FULL, 0xFFFFFEFFFFFF3F3FULL,
+  0xFFFFFEFFFFFCFCFCULL, 0xFFFFFEFFFFF8F8F8ULL, 0xFFFFFEFFFFF1F1F1ULL, 0xFFFFFEFFFFE3E3E3ULL,
+  0xFFFFFEFFFFC7C7C7ULL, 0xFFFFFEFFFF8F8F8FULL, 0xFFFFFEFFFF1F1F1FULL, 0xFFFFFEFFFF3F3F3FULL,
+  0xFFFFFEFFFCFCFCFFULL, 0xFFFFFEFFF8F8F8FFULL, 0xFFFFFEFFF1F1F1FFULL, 0xFFFFFEFFE3E3E3FFULL,
+  0xFFFFFEFFC7C7C7FFULL, 0xFFFFFEFF8F8F8FFFULL, 0xFFFFFEFF1F1F1FFFULL, 0xFFFFFEFF3F3F3FFFULL,
+  0xFFFFFEFCFCFCFFFFULL, 0xFFFFFEF8F8F8FFFFULL, 0xFFFFFEF1F1F1FFFFULL, 0xFFFFFEE3E3E3FFFFULL,
+  0xFFFFFEC7C7C7FFFFULL, 0xFFFFFE8F8F8FFFFFULL, 0xFFFFFE1F1F1FFFFFULL, 0xFFFFFE3F3F3FFFFFULL,
+  0xFFFFFCFCFCFFFFFFULL, 0xFFFFF8F8F8FFFFFFULL, 0xFFFFF0F1F1FFFFFFULL, 0xFFFFE2E3E3FFFFFFULL,
+  0xFFFFC6C7C7FFFFFFULL, 0xFFFF8E8F8FFFFFFFULL, 0xFFFF1E1F1FFFFFFFULL, 0xFFFF3E3F3FFFFFFFULL,
+  0x0000000000000000ULL, 0x0200000000000000ULL, 0x0701000000000000ULL, 0xFFE3E2E3FFFFFFFFULL,
+  0xFFC7C6C7FFFFFFFFULL, 0xFF8F8E8FFFFFFFFFULL, 0xFF1F1E1FFFFFFFFFULL, 0xFF3F3E3FFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0xE3E3E2FFFFFFFFFFULL,
+  0xC7C7C6FFFFFFFFFFULL, 0x8F8F8EFFFFFFFFFFULL, 0x1F1F1EFFFFFFFFFFULL, 0x3F3F3EFFFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000060000000000ULL, 0xE3E3FEFFFFFFFFFFULL,
+  0xC7C7FEFFFFFFFFFFULL, 0x8F8FFEFFFFFFFFFFULL, 0x1F1FFEFFFFFFFFFFULL, 0x3F3FFEFFFFFFFFFFULL,
+  0xFFFFFEFFFFFFFCFCULL, 0xFFFFFEFFFFFFF8F8ULL, 0xFFFFFEFFFFFFF1F1ULL, 0xFFFFFEFFFFFFE3E3ULL,
+  0xFFFFFEFFFFFFC7C7ULL, 0xFFFFFEFFFFFF8F8FULL, 0xFFFFFEFFFFFF1F1FULL, 0xFFFFFEFFFFFF3F3FULL,
+  0xFFFFFEFFFFFCFCFCULL, 0xFFFFFEFFFFF8F8F8ULL, 0xFFFFFEFFFFF1F1F1ULL, 0xFFFFFEFFFFE3E3E3ULL,
+  0xFFFFFEFFFFC7C7C7ULL, 0xFFFFFEFFFF8F8F8FULL, 0xFFFFFEFFFF1F1F1FULL, 0xFFFFFEFFFF3F3F3FULL,
+  0xFFFFFEFFFCFCFCFFULL, 0xFFFFFEFFF8F8F8FFULL, 0xFFFFFEFFF1F1F1FFULL, 0xFFFFFEFFE3E3E3FFULL,
+  0xFFFFFEFFC7C7C7FFULL, 0xFFFFFEFF8F8F8FFFULL, 0xFFFFFEFF1F1F1FFFULL, 0xFFFFFEFF3F3F3FFFULL,
+  0xFFFFFEFCFCFCFFFFULL, 0xFFFFFEF8F8F8FFFFULL, 0xFFFFFEF1F1F1FFFFULL, 0xFFFFFEE3E3E3FFFFULL,
+  0xFFFFFEC7C7C7FFFFULL, 0xFFFFFE8F8F8FFFFFULL, 0xFFFFFE1F1F1FFFFFULL, 0xFFFFFE3F3F3FFFFFULL,
+  0x0003000000000000ULL, 0x0003000000000000ULL, 0x0207000000000000ULL, 0x070F020200000000ULL,
+  0xFFFFC6C7C7FFFFFFULL, 0xFFFF8E8F8FFFFFFFULL, 0xFFFF1E1F1FFFFFFFULL, 0xFFFF3E3F3FFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0200000000000000ULL, 0x0602020000000000ULL,
+  0xFFC7C6C7FFFFFFFFULL, 0xFF8F8E8FFFFFFFFFULL, 0xFF1F1E1FFFFFFFFFULL, 0xFF3F3E3FFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0202020000000000ULL,
+  0xC7C7C6FFFFFFFFFFULL, 0x8F8F8EFFFFFFFFFFULL, 0x1F1F1EFFFFFFFFFFULL, 0x3F3F3EFFFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0202060000000000ULL,
+  0xC7C7FEFFFFFFFFFFULL, 0x8F8FFEFFFFFFFFFFULL, 0x1F1FFEFFFFFFFFFFULL, 0x3F3FFEFFFFFFFFFFULL,
+  0xFFFFFDFFFFFFFCFCULL, 0xFFFFFDFFFFFFF8F8ULL, 0xFFFFFDFFFFFFF1F1ULL, 0xFFFFFDFFFFFFE3E3ULL,
+  0xFFFFFDFFFFFFC7C7ULL, 0xFFFFFDFFFFFF8F8FULL, 0xFFFFFDFFFFFF1F1FULL, 0xFFFFFDFFFFFF3F3FULL,
+  0xFFFFFDFFFFFCFCFCULL, 0xFFFFFDFFFFF8F8F8ULL, 0xFFFFFDFFFFF1F1F1ULL, 0xFFFFFDFFFFE3E3E3ULL,
+  0xFFFFFDFFFFC7C7C7ULL, 0xFFFFFDFFFF8F8F8FULL, 0xFFFFFDFFFF1F1F1FULL, 0xFFFFFDFFFF3F3F3FULL,
+  0xFFFFFDFFFCFCFCFFULL, 0xFFFFFDFFF8F8F8FFULL, 0xFFFFFDFFF1F1F1FFULL, 0xFFFFFDFFE3E3E3FFULL,
+  0xFFFFFDFFC7C7C7FFULL, 0xFFFFFDFF8F8F8FFFULL, 0xFFFFFDFF1F1F1FFFULL, 0xFFFFFDFF3F3F3FFFULL,
+  0xFFFFFDFCFCFCFFFFULL, 0xFFFFFDF8F8F8FFFFULL, 0xFFFFFDF1F1F1FFFFULL, 0xFFFFFDE3E3E3FFFFULL,
+  0xFFFFFDC7C7C7FFFFULL, 0xFFFFFD8F8F8FFFFFULL, 0xFFFFFD1F1F1FFFFFULL, 0xFFFFFD3F3F3FFFFFULL,
+  0xFFFFFCFCFCFFFFFFULL, 0xFFFFF8F8F8FFFFFFULL, 0xFFFFF1F1F1FFFFFFULL, 0xFFFFE1E3E3FFFFFFULL,
+  0xFFFFC5C7C7FFFFFFULL, 0xFFFF8D8F8FFFFFFFULL, 0xFFFF1D1F1FFFFFFFULL, 0xFFFF3D3F3FFFFFFFULL,
+  0x0F0C0C0C00000000ULL, 0x0000000000000000ULL, 0x0701010100000000ULL, 0x0F03010307000000ULL,
+  0xFFC7C5C7FFFFFFFFULL, 0xFF8F8D8FFFFFFFFFULL, 0xFF1F1D1FFFFFFFFFULL, 0xFF3F3D3FFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0303011F1F000000ULL,
+  0xC7C7C5FFFFFFFFFFULL, 0x8F8F8DFFFFFFFFFFULL, 0x1F1F1DFFFFFFFFFFULL, 0x3F3F3DFFFFFFFFFFULL,
+  0x040C080F00000000ULL, 0x0000050000000000ULL, 0x0101090F00000000ULL, 0x03031D1F1F000000ULL,
+  0xC7C7FDFFFFFFFFFFULL, 0x8F8FFDFFFFFFFFFFULL, 0x1F1FFDFFFFFFFFFFULL, 0x3F3FFDFFFFFFFFFFULL,
+  0xFFFFFDFFFFFFFCFCULL, 0xFFFFFDFFFFFFF8F8ULL, 0xFFFFFDFFFFFFF1F1ULL, 0xFFFFFDFFFFFFE3E3ULL,
+  0xFFFFFDFFFFFFC7C7ULL, 0xFFFFFDFFFFFF8F8FULL, 0xFFFFFDFFFFFF1F1FULL, 0xFFFFFDFFFFFF3F3FULL,
+  0xFFFFFDFFFFFCFCFCULL, 0xFFFFFDFFFFF8F8F8ULL, 0xFFFFFDFFFFF1F1F1ULL, 0xFFFFFDFFFFE3E3E3ULL,
+  0xFFFFFDFFFFC7C7C7ULL, 0xFFFFFDFFFF8F8F8FULL, 0xFFFFFDFFFF1F1F1FULL, 0xFFFFFDFFFF3F3F3FULL,
+  0xFFFFFDFFFCFCFCFFULL, 0xFFFFFDFFF8F8F8FFULL, 0xFFFFFDFFF1F1F1FFULL, 0xFFFFFDFFE3E3E3FFULL,
+  0xFFFFFDFFC7C7C7FFULL, 0xFFFFFDFF8F8F8FFFULL, 0xFFFFFDFF1F1F1FFFULL, 0xFFFFFDFF3F3F3FFFULL,
+  0xFFFFFDFCFCFCFFFFULL, 0xFFFFFDF8F8F8FFFFULL, 0xFFFFFDF1F1F1FFFFULL, 0xFFFFFDE3E3E3FFFFULL,
+  0xFFFFFDC7C7C7FFFFULL, 0xFFFFFD8F8F8FFFFFULL, 0xFFFFFD1F1F1FFFFFULL, 0xFFFFFD3F3F3FFFFFULL,
+  0x0007040400000000ULL, 0x0007000000000000ULL, 0x0007010100000000ULL, 0x070F010300000000ULL,
+  0x0F1F050707000000ULL, 0xFFFF8D8F8FFFFFFFULL, 0xFFFF1D1F1FFFFFFFULL, 0xFFFF3D3F3FFFFFFFULL,
+  0x0004040000000000ULL, 0x0000000000000000ULL, 0x0001010000000000ULL, 0x0703010300000000ULL,
+  0x0F07050707000000ULL, 0xFF8F8D8FFFFFFFFFULL, 0xFF1F1D1FFFFFFFFFULL, 0xFF3F3D3FFFFFFFFFULL,
+  0x0004000000000000ULL, 0x0000000000000000ULL, 0x0001010000000000ULL, 0x0303010F00000000ULL,
+  0x0707051F07000000ULL, 0x8F8F8DFFFFFFFFFFULL, 0x1F1F1DFFFFFFFFFFULL, 0x3F3F3DFFFFFFFFFFULL,
+  0x0000050000000000ULL, 0x0000000000000000ULL, 0x0101050000000000ULL, 0x0303090F00000000ULL,
+  0x07071D1F1F000000ULL, 0x8F8FFDFFFFFFFFFFULL, 0x1F1FFDFFFFFFFFFFULL, 0x3F3FFDFFFFFFFFFFULL,
+  0xFFFFFBFFFFFFFCFCULL, 0xFFFFFBFFFFFFF8F8ULL, 0xFFFFFBFFFFFFF1F1ULL, 0xFFFFFBFFFFFFE3E3ULL,
+  0xFFFFFBFFFFFFC7C7ULL, 0xFFFFFBFFFFFF8F8FULL, 0xFFFFFBFFFFFF1F1FULL, 0xFFFFFBFFFFFF3F3FULL,
+  0xFFFFFBFFFFFCFCFCULL, 0xFFFFFBFFFFF8F8F8ULL, 0xFFFFFBFFFFF1F1F1ULL, 0xFFFFFBFFFFE3E3E3ULL,
+  0xFFFFFBFFFFC7C7C7ULL, 0xFFFFFBFFFF8F8F8FULL, 0xFFFFFBFFFF1F1F1FULL, 0xFFFFFBFFFF3F3F3FULL,
+  0xFFFFFBFFFCFCFCFFULL, 0xFFFFFBFFF8F8F8FFULL, 0xFFFFFBFFF1F1F1FFULL, 0xFFFFFBFFE3E3E3FFULL,
+  0xFFFFFBFFC7C7C7FFULL, 0xFFFFFBFF8F8F8FFFULL, 0xFFFFFBFF1F1F1FFFULL, 0xFFFFFBFF3F3F3FFFULL,
+  0xFFFFFBFCFCFCFFFFULL, 0xFFFFFBF8F8F8FFFFULL, 0xFFFFFBF1F1F1FFFFULL, 0xFFFFFBE3E3E3FFFFULL,
+  0xFFFFFBC7C7C7FFFFULL, 0xFFFFFB8F8F8FFFFFULL, 0xFFFFFB1F1F1FFFFFULL, 0xFFFFFB3F3F3FFFFFULL,
+  0xFFFFF8FCFCFFFFFFULL, 0xFFFFF8F8F8FFFFFFULL, 0xFFFFF1F1F1FFFFFFULL, 0xFFFFE3E3E3FFFFFFULL,
+  0xFFFFC3C7C7FFFFFFULL, 0xFFFF8B8F8FFFFFFFULL, 0xFFFF1B1F1FFFFFFFULL, 0xFFFF3B3F3FFFFFFFULL,
+  0x3F3C383C3E000000ULL, 0x1E18181800000000ULL, 0x0000000000000000ULL, 0x0F03030300000000ULL,
+  0x1F0703070F000000ULL, 0xFF8F8B8FFFFFFFFFULL, 0xFF1F1B1FFFFFFFFFULL, 0xFF3F3B3FFFFFFFFFULL,
+  0x3C3C383F3F000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+  0x0707033F3F000000ULL, 0x8F8F8BFFFFFFFFFFULL, 0x1F1F1BFFFFFFFFFFULL, 0x3F3F3BFFFFFFFFFFULL,
+  0x3C3C3B3F3F000000ULL, 0x1818191F00000000ULL, 0x00000A0000000000ULL, 0x0303131F00000000ULL,
+  0x07073B3F3F000000ULL, 0x8F8FFBFFFFFFFFFFULL, 0x1F1FFBFFFFFFFFFFULL, 0x3F3FFBFFFFFFFFFFULL,
+  0xFFFFFBFFFFFFFCFCULL, 0xFFFFFBFFFFFFF8F8ULL, 0xFFFFFBFFFFFFF1F1ULL, 0xFFFFFBFFFFFFE3E3ULL,
+  0xFFFFFBFFFFFFC7C7ULL, 0xFFFFFBFFFFFF8F8FULL, 0xFFFFFBFFFFFF1F1FULL, 0xFFFFFBFFFFFF3F3FULL,
+  0xFFFFFBFFFFFCFCFCULL, 0xFFFFFBFFFFF8F8F8ULL, 0xFFFFFBFFFFF1F1F1ULL, 0xFFFFFBFFFFE3E3E3ULL,
+  0xFFFFFBFFFFC7C7C7ULL, 0xFFFFFBFFFF8F8F8FULL, 0xFFFFFBFFFF1F1F1FULL, 0xFFFFFBFFFF3F3F3FULL,
+  0xFFFFFBFFFCFCFCFFULL, 0xFFFFFBFFF8F8F8FFULL, 0xFFFFFBFFF1F1F1FFULL, 0xFFFFFBFFE3E3E3FFULL,
+  0xFFFFFBFFC7C7C7FFULL, 0xFFFFFBFF8F8F8FFFULL, 0xFFFFFBFF1F1F1FFFULL, 0xFFFFFBFF3F3F3FFFULL,
+  0xFFFFFBFCFCFCFFFFULL, 0xFFFFFBF8F8F8FFFFULL, 0xFFFFFBF1F1F1FFFFULL, 0xFFFFFBE3E3E3FFFFULL,
+  0xFFFFFBC7C7C7FFFFULL, 0xFFFFFB8F8F8FFFFFULL, 0xFFFFFB1F1F1FFFFFULL, 0xFFFFFB3F3F3FFFFFULL,
+  0x1E1F181C00000000ULL, 0x000E080800000000ULL, 0x000E000000000000ULL, 0x000E020200000000ULL,
+  0x0F1F030700000000ULL, 0x1F3F0B0F0F000000ULL, 0xFFFF1B1F1FFFFFFFULL, 0xFFFF3B3F3FFFFFFFULL,
+  0x1E1C181C00000000ULL, 0x0008080000000000ULL, 0x0000000000000000ULL, 0x0002020000000000ULL,
+  0x0F07030700000000ULL, 0x1F0F0B0F0F000000ULL, 0xFF1F1B1FFFFFFFFFULL, 0xFF3F3B3FFFFFFFFFULL,
+  0x1C1C181F00000000ULL, 0x0008080000000000ULL, 0x0000000000000000ULL, 0x0002020000000000ULL,
+  0x0707031F00000000ULL, 0x0F0F0B3F0F000000ULL, 0x1F1F1BFFFFFFFFFFULL, 0x3F3F3BFFFFFFFFFFULL,
+  0x1C1C191F00000000ULL, 0x08080A0000000000ULL, 0x0000000000000000ULL, 0x02020A0000000000ULL,
+  0x0707131F00000000ULL, 0x0F0F3B3F3F000000ULL, 0x1F1FFBFFFFFFFFFFULL, 0x3F3FFBFFFFFFFFFFULL,
+  0xFFFFF7FFFFFFFCFCULL, 0xFFFFF7FFFFFFF8F8ULL, 0xFFFFF7FFFFFFF1F1ULL, 0xFFFFF7FFFFFFE3E3ULL,
+  0xFFFFF7FFFFFFC7C7ULL, 0xFFFFF7FFFFFF8F8FULL, 0xFFFFF7FFFFFF1F1FULL, 0xFFFFF7FFFFFF3F3FULL,
+  0xFFFFF7FFFFFCFCFCULL, 0xFFFFF7FFFFF8F8F8ULL, 0xFFFFF7FFFFF1F1F1ULL, 0xFFFFF7FFFFE3E3E3ULL,
+  0xFFFFF7FFFFC7C7C7ULL, 0xFFFFF7FFFF8F8F8FULL, 0xFFFFF7FFFF1F1F1FULL, 0xFFFFF7FFFF3F3F3FULL,
+  0xFFFFF7FFFCFCFCFFULL, 0xFFFFF7FFF8F8F8FFULL, 0xFFFFF7FFF1F1F1FFULL, 0xFFFFF7FFE3E3E3FFULL,
+  0xFFFFF7FFC7C7C7FFULL, 0xFFFFF7FF8F8F8FFFULL, 0xFFFFF7FF1F1F1FFFULL, 0xFFFFF7FF3F3F3FFFULL,
+  0xFFFFF7FCFCFCFFFFULL, 0xFFFFF7F8F8F8FFFFULL, 0xFFFFF7F1F1F1FFFFULL, 0xFFFFF7E3E3E3FFFFULL,
+  0xFFFFF7C7C7C7FFFFULL, 0xFFFFF78F8F8FFFFFULL, 0xFFFFF71F1F1FFFFFULL, 0xFFFFF73F3F3FFFFFULL,
+  0xFFFFF4FCFCFFFFFFULL, 0xFFFFF0F8F8FFFFFFULL, 0xFFFFF1F1F1FFFFFFULL, 0xFFFFE3E3E3FFFFFFULL,
+  0xFFFFC7C7C7FFFFFFULL, 0xFFFF878F8FFFFFFFULL, 0xFFFF171F1FFFFFFFULL, 0xFFFF373F3FFFFFFFULL,
+  0xFFFCF4FCFFFFFFFFULL, 0x7E7870787C000000ULL, 0x3C30303000000000ULL, 0x0000000000000000ULL,
+  0x1E06060600000000ULL, 0x3F0F070F1F000000ULL, 0xFF1F171FFFFFFFFFULL, 0xFF3F373FFFFFFFFFULL,
+  0xFCFCF4FFFFFFFFFFULL, 0x7878707F7F000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+  0x0000000000000000ULL, 0x0F0F077F7F000000ULL, 0x1F1F17FFFFFFFFFFULL, 0x3F3F37FFFFFFFFFFULL,
+  0xFCFCF7FFFFFFFFFFULL, 0x7878777F7F000000ULL, 0x3030323E00000000ULL, 0x0000140000000000ULL,
+  0x0606263E00000000ULL, 0x0F0F777F7F000000ULL, 0x1F1FF7FFFFFFFFFFULL, 0x3F3FF7FFFFFFFFFFULL,
+  0xFFFFF7FFFFFFFCFCULL, 0xFFFFF7FFFFFFF8F8ULL, 0xFFFFF7FFFFFFF1F1ULL, 0xFFFFF7FFFFFFE3E3ULL,
+  0xFFFFF7FFFFFFC7C7ULL, 0xFFFFF7FFFFFF8F8FULL, 0xFFFFF7FFFFFF1F1FULL, 0xFFFFF7FFFFFF3F3FULL,
+  0xFFFFF7FFFFFCFCFCULL, 0xFFFFF7FFFFF8F8F8ULL, 0xFFFFF7FFFFF1F1F1ULL, 0xFFFFF7FFFFE3E3E3ULL,
+  0xFFFFF7FFFFC7C7C7ULL, 0xFFFFF7FFFF8F8F8FULL, 0xFFFFF7FFFF1F1F1FULL, 0xFFFFF7FFFF3F3F3FULL,
+  0xFFFFF7FFFCFCFCFFULL, 0xFFFFF7FFF8F8F8FFULL, 0xFFFFF7FFF1F1F1FFULL, 0xFFFFF7FFE3E3E3FFULL,
+  0xFFFFF7FFC7C7C7FFULL, 0xFFFFF7FF8F8F8FFFULL, 0xFFFFF7FF1F1F1FFFULL, 0xFFFFF7FF3F3F3FFFULL,
+  0xFFFFF7FCFCFCFFFFULL, 0xFFFFF7F8F8F8FFFFULL, 0xFFFFF7F1F1F1FFFFULL, 0xFFFFF7E3E3E3FFFFULL,
+  0xFFFFF7C7C7C7FFFFULL, 0xFFFFF78F8F8FFFFFULL, 0xFFFFF71F1F1FFFFFULL, 0xFFFFF73F3F3FFFFFULL,
+  0x7E7F747C7C000000ULL, 0x3C3E303800000000ULL, 0x001C101000000000ULL, 0x001C000000000000ULL,
+  0x001C040400000000ULL, 0x1E3E060E00000000ULL, 0x3F7F171F1F000000ULL, 0xFFFF373F3FFFFFFFULL,
+  0x7E7C747C7C000000ULL, 0x3C38303800000000ULL, 0x0010100000000000ULL, 0x0000000000000000ULL,
+  0x0004040000000000ULL, 0x1E0E060E00000000ULL, 0x3F1F171F1F000000ULL, 0xFF3F373FFFFFFFFFULL,
+  0x7C7C747F7C000000ULL, 0x3838303E00000000ULL, 0x0010100000000000ULL, 0x0000000000000000ULL,
+  0x0004040000000000ULL, 0x0E0E063E00000000ULL, 0x1F1F177F1F000000ULL, 0x3F3F37FFFFFFFFFFULL,
+  0x7C7C777F7F000000ULL, 0x3838323E00000000ULL, 0x1010140000000000ULL, 0x0000000000000000ULL,
+  0x0404140000000000ULL, 0x0E0E263E00000000ULL, 0x1F1F777F7F000000ULL, 0x3F3FF7FFFFFFFFFFULL,
+  0xFFFFFFFEFFFFFCFCULL, 0xFFFFFFFEFFFFF8F8ULL, 0xFFFFFFFEFFFFF1F1ULL, 0xFFFFFFFEFFFFE3E3ULL,
+  0xFFFFFFFEFFFFC7C7ULL, 0xFFFFFFFEFFFF8F8FULL, 0xFFFFFFFEFFFF1F1FULL, 0xFFFFFFFEFFFF3F3FULL,
+  0xFFFFFFFEFFFCFCFCULL, 0xFFFFFFFEFFF8F8F8ULL, 0xFFFFFFFEFFF1F1F1ULL, 0xFFFFFFFEFFE3E3E3ULL,
+  0xFFFFFFFEFFC7C7C7ULL, 0xFFFFFFFEFF8F8F8FULL, 0xFFFFFFFEFF1F1F1FULL, 0xFFFFFFFEFF3F3F3FULL,
+  0xFFFFFFFEFCFCFCFFULL, 0xFFFFFFFEF8F8F8FFULL, 0xFFFFFFFEF1F1F1FFULL, 0xFFFFFFFEE3E3E3FFULL,
+  0xFFFFFFFEC7C7C7FFULL, 0xFFFFFFFE8F8F8FFFULL, 0xFFFFFFFE1F1F1FFFULL, 0xFFFFFFFE3F3F3FFFULL,
+  0xFFFFFFFCFCFCFFFFULL, 0xFFFFFFF8F8F8FFFFULL, 0xFFFFFFF0F1F1FFFFULL, 0xFFFFFFE2E3E3FFFFULL,
+  0xFFFFFFC6C7C7FFFFULL, 0xFFFFFF8E8F8FFFFFULL, 0xFFFFFF1E1F1FFFFFULL, 0xFFFFFF3E3F3FFFFFULL,
+  0x0000000000000000ULL, 0x0003000000000000ULL, 0x0707010000000000ULL, 0x0F0F030203000000ULL,
+  0xFFFFC7C6C7FFFFFFULL, 0xFFFF8F8E8FFFFFFFULL, 0xFFFF1F1E1FFFFFFFULL, 0xFFFF3F3E3FFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0200000000000000ULL, 0x0703030200000000ULL,
+  0xFFC7C7C6FFFFFFFFULL, 0xFF8F8F8EFFFFFFFFULL, 0xFF1F1F1EFFFFFFFFULL, 0xFF3F3F3EFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0303030000000000ULL,
+  0xC7C7C7FEFFFFFFFFULL, 0x8F8F8FFEFFFFFFFFULL, 0x1F1F1FFEFFFFFFFFULL, 0x3F3F3FFEFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0303070000000000ULL,
+  0xC7C7FFFEFFFFFFFFULL, 0x8F8FFFFEFFFFFFFFULL, 0x1F1FFFFEFFFFFFFFULL, 0x3F3FFFFEFFFFFFFFULL,
+  0xFFFFFFFEFFFFFCFCULL, 0xFFFFFFFEFFFFF8F8ULL, 0xFFFFFFFEFFFFF1F1ULL, 0xFFFFFFFEFFFFE3E3ULL,
+  0xFFFFFFFEFFFFC7C7ULL, 0xFFFFFFFEFFFF8F8FULL, 0xFFFFFFFEFFFF1F1FULL, 0xFFFFFFFEFFFF3F3FULL,
+  0xFFFFFFFEFFFCFCFCULL, 0xFFFFFFFEFFF8F8F8ULL, 0xFFFFFFFEFFF1F1F1ULL, 0xFFFFFFFEFFE3E3E3ULL,
+  0xFFFFFFFEFFC7C7C7ULL, 0xFFFFFFFEFF8F8F8FULL, 0xFFFFFFFEFF1F1F1FULL, 0xFFFFFFFEFF3F3F3FULL,
+  0xFFFFFFFEFCFCFCFFULL, 0xFFFFFFFEF8F8F8FFULL, 0xFFFFFFFEF1F1F1FFULL, 0xFFFFFFFEE3E3E3FFULL,
+  0xFFFFFFFEC7C7C7FFULL, 0xFFFFFFFE8F8F8FFFULL, 0xFFFFFFFE1F1F1FFFULL, 0xFFFFFFFE3F3F3FFFULL,
+  0x0000030000000000ULL, 0x0000030000000000ULL, 0x0003070000000000ULL, 0x07070F0202000000ULL,
+  0x0F0F1F0607000000ULL, 0xFFFFFF8E8F8FFFFFULL, 0xFFFFFF1E1F1FFFFFULL, 0xFFFFFF3E3F3FFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0002000000000000ULL, 0x0206020200000000ULL,
+  0x070F070600000000ULL, 0xFFFF8F8E8FFFFFFFULL, 0xFFFF1F1E1FFFFFFFULL, 0xFFFF3F3E3FFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0202020000000000ULL,
+  0x0707070000000000ULL, 0xFF8F8F8EFFFFFFFFULL, 0xFF1F1F1EFFFFFFFFULL, 0xFF3F3F3EFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0202000000000000ULL,
+  0x0707070000000000ULL, 0x8F8F8FFEFFFFFFFFULL, 0x1F1F1FFEFFFFFFFFULL, 0x3F3F3FFEFFFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0202000000000000ULL,
+  0x0707070000000000ULL, 0x8F8FFFFEFFFFFFFFULL, 0x1F1FFFFEFFFFFFFFULL, 0x3F3FFFFEFFFFFFFFULL,
+  0xFFFFFFFDFFFFFCFCULL, 0xFFFFFFFDFFFFF8F8ULL, 0xFFFFFFFDFFFFF1F1ULL, 0xFFFFFFFDFFFFE3E3ULL,
+  0xFFFFFFFDFFFFC7C7ULL, 0xFFFFFFFDFFFF8F8FULL, 0xFFFFFFFDFFFF1F1FULL, 0xFFFFFFFDFFFF3F3FULL,
+  0xFFFFFFFDFFFCFCFCULL, 0xFFFFFFFDFFF8F8F8ULL, 0xFFFFFFFDFFF1F1F1ULL, 0xFFFFFFFDFFE3E3E3ULL,
+  0xFFFFFFFDFFC7C7C7ULL, 0xFFFFFFFDFF8F8F8FULL, 0xFFFFFFFDFF1F1F1FULL, 0xFFFFFFFDFF3F3F3FULL,
+  0xFFFFFFFDFCFCFCFFULL, 0xFFFFFFFDF8F8F8FFULL, 0xFFFFFFFDF1F1F1FFULL, 0xFFFFFFFDE3E3E3FFULL,
+  0xFFFFFFFDC7C7C7FFULL, 0xFFFFFFFD8F8F8FFFULL, 0xFFFFFFFD1F1F1FFFULL, 0xFFFFFFFD3F3F3FFFULL,
+  0xFFFFFFFCFCFCFFFFULL, 0xFFFFFFF8F8F8FFFFULL, 0xFFFFFFF1F1F1FFFFULL, 0xFFFFFFE1E3E3FFFFULL,
+  0xFFFFFFC5C7C7FFFFULL, 0xFFFFFF8D8F8FFFFFULL, 0xFFFFFF1D1F1FFFFFULL, 0xFFFFFF3D3F3FFFFFULL,
+  0x000F0C0C0C000000ULL, 0x0000000000000000ULL, 0x0007010101000000ULL, 0x0F0F030103070000ULL,
+  0x1F1F070507070000ULL, 0xFFFF8F8D8FFFFFFFULL, 0xFFFF1F1D1FFFFFFFULL, 0xFFFF3F3D3FFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0703030103000000ULL,
+  0x0F0707050F070000ULL, 0xFF8F8F8DFFFFFFFFULL, 0xFF1F1F1DFFFFFFFFULL, 0xFF3F3F3DFFFFFFFFULL,
+  0x0C0C0C0C00000000ULL, 0x0000000000000000ULL, 0x0101010100000000ULL, 0x0303030D03000000ULL,
+  0x0707071D1F070000ULL, 0x8F8F8FFDFFFFFFFFULL, 0x1F1F1FFDFFFFFFFFULL, 0x3F3F3FFDFFFFFFFFULL,
+  0x0C0C0F0D00000000ULL, 0x00080F0D00000000ULL, 0x01010F0D00000000ULL, 0x03031F1D03000000ULL,
+  0x07073F3D1F070000ULL, 0x8F8FFFFDFFFFFFFFULL, 0x1F1FFFFDFFFFFFFFULL, 0x3F3FFFFDFFFFFFFFULL,
+  0xFFFFFFFDFFFFFCFCULL, 0xFFFFFFFDFFFFF8F8ULL, 0xFFFFFFFDFFFFF1F1ULL, 0xFFFFFFFDFFFFE3E3ULL,
+  0xFFFFFFFDFFFFC7C7ULL, 0xFFFFFFFDFFFF8F8FULL, 0xFFFFFFFDFFFF1F1FULL, 0xFFFFFFFDFFFF3F3FULL,
+  0xFFFFFFFDFFFCFCFCULL, 0xFFFFFFFDFFF8F8F8ULL, 0xFFFFFFFDFFF1F1F1ULL, 0xFFFFFFFDFFE3E3E3ULL,
+  0xFFFFFFFDFFC7C7C7ULL, 0xFFFFFFFDFF8F8F8FULL, 0xFFFFFFFDFF1F1F1FULL, 0xFFFFFFFDFF3F3F3FULL,
+  0xFFFFFFFDFCFCFCFFULL, 0xFFFFFFFDF8F8F8FFULL, 0xFFFFFFFDF1F1F1FFULL, 0xFFFFFFFDE3E3E3FFULL,
+  0xFFFFFFFDC7C7C7FFULL, 0xFFFFFFFD8F8F8FFFULL, 0xFFFFFFFD1F1F1FFFULL, 0xFFFFFFFD3F3F3FFFULL,
+  0x0000070404000000ULL, 0x0000070000000000ULL, 0x0000070101000000ULL, 0x00070F0103000000ULL,
+  0x0F0F1F0507070000ULL, 0x1F1F3F0D0F070000ULL, 0xFFFFFF1D1F1FFFFFULL, 0xFFFFFF3D3F3FFFFFULL,
+  0x0000040400000000ULL, 0x0000000000000000ULL, 0x0000010100000000ULL, 0x0007030103000000ULL,
+  0x070F070503000000ULL, 0x0F1F0F0D0F070000ULL, 0xFFFF1F1D1FFFFFFFULL, 0xFFFF3F3D3FFFFFFFULL,
+  0x0000040000000000ULL, 0x0000000000000000ULL, 0x0000010000000000ULL, 0x0003030100000000ULL,
+  0x0707070503000000ULL, 0x0F0F0F0D0F070000ULL, 0xFF1F1F1DFFFFFFFFULL, 0xFF3F3F3DFFFFFFFFULL,
+  0x0004040000000000ULL, 0x0000000000000000ULL, 0x0001010000000000ULL, 0x0303030100000000ULL,
+  0x0707070D03000000ULL, 0x0F0F0F1D0F070000ULL, 0x1F1F1FFDFFFFFFFFULL, 0x3F3F3FFDFFFFFFFFULL,
+  0x0404070000000000ULL, 0x0000070000000000ULL, 0x0101070000000000ULL, 0x03030F0100000000ULL,
+  0x07071F0D03000000ULL, 0x0F0F3F1D1F070000ULL, 0x1F1FFFFDFFFFFFFFULL, 0x3F3FFFFDFFFFFFFFULL,
+  0xFFFFFFFBFFFFFCFCULL, 0xFFFFFFFBFFFFF8F8ULL, 0xFFFFFFFBFFFFF1F1ULL, 0xFFFFFFFBFFFFE3E3ULL,
+  0xFFFFFFFBFFFFC7C7ULL, 0xFFFFFFFBFFFF8F8FULL, 0xFFFFFFFBFFFF1F1FULL, 0xFFFFFFFBFFFF3F3FULL,
+  0xFFFFFFFBFFFCFCFCULL, 0xFFFFFFFBFFF8F8F8ULL, 0xFFFFFFFBFFF1F1F1ULL, 0xFFFFFFFBFFE3E3E3ULL,
+  0xFFFFFFFBFFC7C7C7ULL, 0xFFFFFFFBFF8F8F8FULL, 0xFFFFFFFBFF1F1F1FULL, 0xFFFFFFFBFF3F3F3FULL,
+  0xFFFFFFFBFCFCFCFFULL, 0xFFFFFFFBF8F8F8FFULL, 0xFFFFFFFBF1F1F1FFULL, 0xFFFFFFFBE3E3E3FFULL,
+  0xFFFFFFFBC7C7C7FFULL, 0xFFFFFFFB8F8F8FFFULL, 0xFFFFFFFB1F1F1FFFULL, 0xFFFFFFFB3F3F3FFFULL,
+  0xFFFFFFF8FCFCFFFFULL, 0xFFFFFFF8F8F8FFFFULL, 0xFFFFFFF1F1F1FFFFULL, 0xFFFFFFE3E3E3FFFFULL,
+  0xFFFFFFC3C7C7FFFFULL, 0xFFFFFF8B8F8FFFFFULL, 0xFFFFFF1B1F1FFFFFULL, 0xFFFFFF3B3F3FFFFFULL,
+  0x3F3F3C383C3E0000ULL, 0x001E181818000000ULL, 0x0000000000000000ULL, 0x000F030303000000ULL,
+  0x1F1F0703070F0000ULL, 0x3F3F0F0B0F0F0000ULL, 0xFFFF1F1B1FFFFFFFULL, 0xFFFF3F3B3FFFFFFFULL,
+  0x3E3C3C383C000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+  0x0F07070307000000ULL, 0x1F0F0F0B1F0F0000ULL, 0xFF1F1F1BFFFFFFFFULL, 0xFF3F3F3BFFFFFFFFULL,
+  0x3C3C3C3B3C000000ULL, 0x1818181800000000ULL, 0x0000000000000000ULL, 0x0303030300000000ULL,
+  0x0707071B07000000ULL, 0x0F0F0F3B3F0F0000ULL, 0x1F1F1FFBFFFFFFFFULL, 0x3F3F3FFBFFFFFFFFULL,
+  0x3C3C3F3B3C000000ULL, 0x18181F1B00000000ULL, 0x00111F1B00000000ULL, 0x03031F1B00000000ULL,
+  0x07073F3B07000000ULL, 0x0F0F7F7B3F0F0000ULL, 0x1F1FFFFBFFFFFFFFULL, 0x3F3FFFFBFFFFFFFFULL,
+  0xFFFFFFFBFFFFFCFCULL, 0xFFFFFFFBFFFFF8F8ULL, 0xFFFFFFFBFFFFF1F1ULL, 0xFFFFFFFBFFFFE3E3ULL,
+  0xFFFFFFFBFFFFC7C7ULL, 0xFFFFFFFBFFFF8F8FULL, 0xFFFFFFFBFFFF1F1FULL, 0xFFFFFFFBFFFF3F3FULL,
+  0xFFFFFFFBFFFCFCFCULL, 0xFFFFFFFBFFF8F8F8ULL, 0xFFFFFFFBFFF1F1F1ULL, 0xFFFFFFFBFFE3E3E3ULL,
+  0xFFFFFFFBFFC7C7C7ULL, 0xFFFFFFFBFF8F8F8FULL, 0xFFFFFFFBFF1F1F1FULL, 0xFFFFFFFBFF3F3F3FULL,
+  0xFFFFFFFBFCFCFCFFULL, 0xFFFFFFFBF8F8F8FFULL, 0xFFFFFFFBF1F1F1FFULL, 0xFFFFFFFBE3E3E3FFULL,
+  0xFFFFFFFBC7C7C7FFULL, 0xFFFFFFFB8F8F8FFFULL, 0xFFFFFFFB1F1F1FFFULL, 0xFFFFFFFB3F3F3FFFULL,
+  0x001E1F181C000000ULL, 0x00000E0808000000ULL, 0x00000E0000000000ULL, 0x00000E0202000000ULL,
+  0x000F1F0307000000ULL, 0x1F1F3F0B0F0F0000ULL, 0x3F3F7F1B1F0F0000ULL, 0xFFFFFF3B3F3FFFFFULL,
+  0x001E1C181C000000ULL, 0x0000080800000000ULL, 0x0000000000000000ULL, 0x0000020200000000ULL,
+  0x000F070307000000ULL, 0x0F1F0F0B07000000ULL, 0x1F3F1F1B1F0F0000ULL, 0xFFFF3F3B3FFFFFFFULL,
+  0x001C1C1800000000ULL, 0x0000080000000000ULL, 0x0000000000000000ULL, 0x0000020000000000ULL,
+  0x0007070300000000ULL, 0x0F0F0F0B07000000ULL, 0x1F1F1F1B1F0F0000ULL, 0xFF3F3F3BFFFFFFFFULL,
+  0x1C1C1C1800000000ULL, 0x0008080000000000ULL, 0x0000000000000000ULL, 0x0002020000000000ULL,
+  0x0707070300000000ULL, 0x0F0F0F1B07000000ULL, 0x1F1F1F3B1F0F0000ULL, 0x3F3F3FFBFFFFFFFFULL,
+  0x1C1C1F1800000000ULL, 0x08080E0000000000ULL, 0x00000E0000000000ULL, 0x02020E0000000000ULL,
+  0x07071F0300000000ULL, 0x0F0F3F1B07000000ULL, 0x1F1F7F3B3F0F0000ULL, 0x3F3FFFFBFFFFFFFFULL,
+  0xFFFFFFF7FFFFFCFCULL, 0xFFFFFFF7FFFFF8F8ULL, 0xFFFFFFF7FFFFF1F1ULL, 0xFFFFFFF7FFFFE3E3ULL,
+  0xFFFFFFF7FFFFC7C7ULL, 0xFFFFFFF7FFFF8F8FULL, 0xFFFFFFF7FFFF1F1FULL, 0xFFFFFFF7FFFF3F3FULL,
+  0xFFFFFFF7FFFCFCFCULL, 0xFFFFFFF7FFF8F8F8ULL, 0xFFFFFFF7FFF1F1F1ULL, 0xFFFFFFF7FFE3E3E3ULL,
+  0xFFFFFFF7FFC7C7C7ULL, 0xFFFFFFF7FF8F8F8FULL, 0xFFFFFFF7FF1F1F1FULL, 0xFFFFFFF7FF3F3F3FULL,
+  0xFFFFFFF7FCFCFCFFULL, 0xFFFFFFF7F8F8F8FFULL, 0xFFFFFFF7F1F1F1FFULL, 0xFFFFFFF7E3E3E3FFULL,
+  0xFFFFFFF7C7C7C7FFULL, 0xFFFFFFF78F8F8FFFULL, 0xFFFFFFF71F1F1FFFULL, 0xFFFFFFF73F3F3FFFULL,
+  0xFFFFFFF4FCFCFFFFULL, 0xFFFFFFF0F8F8FFFFULL, 0xFFFFFFF1F1F1FFFFULL, 0xFFFFFFE3E3E3FFFFULL,
+  0xFFFFFFC7C7C7FFFFULL, 0xFFFFFF878F8FFFFFULL, 0xFFFFFF171F1FFFFFULL, 0xFFFFFF373F3FFFFFULL,
+  0xFFFFFCF4FCFC0000ULL, 0x7E7E7870787C0000ULL, 0x003C303030000000ULL, 0x0000000000000000ULL,
+  0x001E060606000000ULL, 0x3F3F0F070F1F0000ULL, 0x7F7F1F171F1F0000ULL, 0xFFFF3F373FFFFFFFULL,
+  0xFEFCFCF4FEFC0000ULL, 0x7C78787078000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+  0x0000000000000000ULL, 0x1F0F0F070F000000ULL, 0x3F1F1F173F1F0000ULL, 0xFF3F3F37FFFFFFFFULL,
+  0xFCFCFCF7FFFC0000ULL, 0x7878787678000000ULL, 0x3030303000000000ULL, 0x0000000000000000ULL,
+  0x0606060600000000ULL, 0x0F0F0F370F000000ULL, 0x1F1F1F777F1F0000ULL, 0x3F3F3FF7FFFFFFFFULL,
+  0xFCFCFFF7FFFC0000ULL, 0x78787F7778000000ULL, 0x30303E3600000000ULL, 0x00223E3600000000ULL,
+  0x06063E3600000000ULL, 0x0F0F7F770F000000ULL, 0x1F1FFFF77F1F0000ULL, 0x3F3FFFF7FFFFFFFFULL,
+  0xFFFFFFF7FFFFFCFCULL, 0xFFFFFFF7FFFFF8F8ULL, 0xFFFFFFF7FFFFF1F1ULL, 0xFFFFFFF7FFFFE3E3ULL,
+  0xFFFFFFF7FFFFC7C7ULL, 0xFFFFFFF7FFFF8F8FULL, 0xFFFFFFF7FFFF1F1FULL, 0xFFFFFFF7FFFF3F3FULL,
+  0xFFFFFFF7FFFCFCFCULL, 0xFFFFFFF7FFF8F8F8ULL, 0xFFFFFFF7FFF1F1F1ULL, 0xFFFFFFF7FFE3E3E3ULL,
+  0xFFFFFFF7FFC7C7C7ULL, 0xFFFFFFF7FF8F8F8FULL, 0xFFFFFFF7FF1F1F1FULL, 0xFFFFFFF7FF3F3F3FULL,
+  0xFFFFFFF7FCFCFCFFULL, 0xFFFFFFF7F8F8F8FFULL, 0xFFFFFFF7F1F1F1FFULL, 0xFFFFFFF7E3E3E3FFULL,
+  0xFFFFFFF7C7C7C7FFULL, 0xFFFFFFF78F8F8FFFULL, 0xFFFFFFF71F1F1FFFULL, 0xFFFFFFF73F3F3FFFULL,
+  0x7E7E7F747C7C0000ULL, 0x003C3E3038000000ULL, 0x00001C1010000000ULL, 0x00001C0000000000ULL,
+  0x00001C0404000000ULL, 0x001E3E060E000000ULL, 0x3F3F7F171F1F0000ULL, 0x7F7FFF373F1F0000ULL,
+  0x7C7E7C7478000000ULL, 0x003C383038000000ULL, 0x0000101000000000ULL, 0x0000000000000000ULL,
+  0x0000040400000000ULL, 0x001E0E060E000000ULL, 0x1F3F1F170F000000ULL, 0x3F7F3F373F1F0000ULL,
+  0x7C7C7C7478000000ULL, 0x0038383000000000ULL, 0x0000100000000000ULL, 0x0000000000000000ULL,
+  0x0000040000000000ULL, 0x000E0E0600000000ULL, 0x1F1F1F170F000000ULL, 0x3F3F3F373F1F0000ULL,
+  0x7C7C7C7678000000ULL, 0x3838383000000000ULL, 0x0010100000000000ULL, 0x0000000000000000ULL,
+  0x0004040000000000ULL, 0x0E0E0E0600000000ULL, 0x1F1F1F370F000000ULL, 0x3F3F3F773F1F0000ULL,
+  0x7C7C7F7678000000ULL, 0x38383E3000000000ULL, 0x10101C0000000000ULL, 0x00001C0000000000ULL,
+  0x04041C0000000000ULL, 0x0E0E3E0600000000ULL, 0x1F1F7F370F000000ULL, 0x3F3FFF777F1F0000ULL,
+  0xFFFFFFFFFEFFFCFCULL, 0xFFFFFFFFFEFFF8F8ULL, 0xFFFFFFFFFEFFF1F1ULL, 0xFFFFFFFFFEFFE3E3ULL,
+  0xFFFFFFFFFEFFC7C7ULL, 0xFFFFFFFFFEFF8F8FULL, 0xFFFFFFFFFEFF1F1FULL, 0xFFFFFFFFFEFF3F3FULL,
+  0xFFFFFFFFFEFCFCFCULL, 0xFFFFFFFFFEF8F8F8ULL, 0xFFFFFFFFFEF1F1F1ULL, 0xFFFFFFFFFEE3E3E3ULL,
+  0xFFFFFFFFFEC7C7C7ULL, 0xFFFFFFFFFE8F8F8FULL, 0xFFFFFFFFFE1F1F1FULL, 0xFFFFFFFFFE3F3F3FULL,
+  0xFFFFFFFFFCFCFCFFULL, 0xFFFFFFFFF8F8F8FFULL, 0xFFFFFFFFF0F1F1FFULL, 0xFFFFFFFFE2E3E3FFULL,
+  0xFFFFFFFFC6C7C7FFULL, 0xFFFFFFFF8E8F8FFFULL, 0xFFFFFFFF1E1F1FFFULL, 0xFFFFFFFF3E3F3FFFULL,
+  0x0000000000000000ULL, 0x0000030000000000ULL, 0x0007070100000000ULL, 0x070F0F0302030000ULL,
+  0x0F1F1F0706070000ULL, 0xFFFFFF8F8E8FFFFFULL, 0xFFFFFF1F1E1FFFFFULL, 0xFFFFFF3F3E3FFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0002000000000000ULL, 0x0707030302000000ULL,
+  0x0F0F070706000000ULL, 0xFFFF8F8F8EFFFFFFULL, 0xFFFF1F1F1EFFFFFFULL, 0xFFFF3F3F3EFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0703030300000000ULL,
+  0x0F07070700000000ULL, 0xFF8F8F8FFEFFFFFFULL, 0xFF1F1F1FFEFFFFFFULL, 0xFF3F3F3FFEFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0303030000000000ULL,
+  0x0707070F00000000ULL, 0x8F8F8FFFFEFFFFFFULL, 0x1F1F1FFFFEFFFFFFULL, 0x3F3F3FFFFEFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0303070000000000ULL,
+  0x07070F0F00000000ULL, 0x8F8FFFFFFEFFFFFFULL, 0x1F1FFFFFFEFFFFFFULL, 0x3F3FFFFFFEFFFFFFULL,
+  0xFFFFFFFFFEFFFCFCULL, 0xFFFFFFFFFEFFF8F8ULL, 0xFFFFFFFFFEFFF1F1ULL, 0xFFFFFFFFFEFFE3E3ULL,
+  0xFFFFFFFFFEFFC7C7ULL, 0xFFFFFFFFFEFF8F8FULL, 0xFFFFFFFFFEFF1F1FULL, 0xFFFFFFFFFEFF3F3FULL,
+  0xFFFFFFFFFEFCFCFCULL, 0xFFFFFFFFFEF8F8F8ULL, 0xFFFFFFFFFEF1F1F1ULL, 0xFFFFFFFFFEE3E3E3ULL,
+  0xFFFFFFFFFEC7C7C7ULL, 0xFFFFFFFFFE8F8F8FULL, 0xFFFFFFFFFE1F1F1FULL, 0xFFFFFFFFFE3F3F3FULL,
+  0x0000000300000000ULL, 0x0000000300000000ULL, 0x0000030700000000ULL, 0x0007070F02020000ULL,
+  0x070F0F1F06070000ULL, 0x0F1F1F3F0E0F0000ULL, 0xFFFFFFFF1E1F1FFFULL, 0xFFFFFFFF3E3F3FFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000020000000000ULL, 0x0002060202000000ULL,
+  0x07070F0706000000ULL, 0x0F0F1F0F0E000000ULL, 0xFFFFFF1F1E1FFFFFULL, 0xFFFFFF3F3E3FFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0002020200000000ULL,
+  0x0707070700000000ULL, 0x0F0F0F0F00000000ULL, 0xFFFF1F1F1EFFFFFFULL, 0xFFFF3F3F3EFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0002020000000000ULL,
+  0x0707070000000000ULL, 0x0F0F0F0F00000000ULL, 0xFF1F1F1FFEFFFFFFULL, 0xFF3F3F3FFEFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0002000000000000ULL,
+  0x0707070000000000ULL, 0x0F0F0F0F00000000ULL, 0x1F1F1FFFFEFFFFFFULL, 0x3F3F3FFFFEFFFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0202000000000000ULL,
+  0x0707070000000000ULL, 0x0F0F0F0F00000000ULL, 0x1F1FFFFFFEFFFFFFULL, 0x3F3FFFFFFEFFFFFFULL,
+  0xFFFFFFFFFDFFFCFCULL, 0xFFFFFFFFFDFFF8F8ULL, 0xFFFFFFFFFDFFF1F1ULL, 0xFFFFFFFFFDFFE3E3ULL,
+  0xFFFFFFFFFDFFC7C7ULL, 0xFFFFFFFFFDFF8F8FULL, 0xFFFFFFFFFDFF1F1FULL, 0xFFFFFFFFFDFF3F3FULL,
+  0xFFFFFFFFFDFCFCFCULL, 0xFFFFFFFFFDF8F8F8ULL, 0xFFFFFFFFFDF1F1F1ULL, 0xFFFFFFFFFDE3E3E3ULL,
+  0xFFFFFFFFFDC7C7C7ULL, 0xFFFFFFFFFD8F8F8FULL, 0xFFFFFFFFFD1F1F1FULL, 0xFFFFFFFFFD3F3F3FULL,
+  0xFFFFFFFFFCFCFCFFULL, 0xFFFFFFFFF8F8F8FFULL, 0xFFFFFFFFF1F1F1FFULL, 0xFFFFFFFFE1E3E3FFULL,
+  0xFFFFFFFFC5C7C7FFULL, 0xFFFFFFFF8D8F8FFFULL, 0xFFFFFFFF1D1F1FFFULL, 0xFFFFFFFF3D3F3FFFULL,
+  0x00000F0C0C0C0000ULL, 0x0000000000000000ULL, 0x0000070101010000ULL, 0x000F0F0301030700ULL,
+  0x0F1F1F0705070700ULL, 0x1F3F3F0F0D0F1F0FULL, 0xFFFFFF1F1D1FFFFFULL, 0xFFFFFF3F3D3FFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0007030301030000ULL,
+  0x0F0F0707050F0700ULL, 0x1F1F0F0F0D1F1F0FULL, 0xFFFF1F1F1DFFFFFFULL, 0xFFFF3F3F3DFFFFFFULL,
+  0x000C0C0C0C000000ULL, 0x0000000000000000ULL, 0x0001010101000000ULL, 0x0703030305030000ULL,
+  0x0F0707070D0F0700ULL, 0x1F0F0F0F1D1F1F0FULL, 0xFF1F1F1FFDFFFFFFULL, 0xFF3F3F3FFDFFFFFFULL,
+  0x0C0C0C0E0D000000ULL, 0x0000000505000000ULL, 0x0101010B0D000000ULL, 0x030303171D030000ULL,
+  0x0707072F3D0F0700ULL, 0x0F0F0F5F7D1F1F0FULL, 0x1F1F1FFFFDFFFFFFULL, 0x3F3F3FFFFDFFFFFFULL,
+  0x0C0C0F0F0C000000ULL, 0x00080F0F00000000ULL, 0x01010F0F01000000ULL, 0x03031F1F05030000ULL,
+  0x07073F3F0D0F0700ULL, 0x0F0F7F7F1D1F1F0FULL, 0x1F1FFFFFFDFFFFFFULL, 0x3F3FFFFFFDFFFFFFULL,
+  0xFFFFFFFFFDFFFCFCULL, 0xFFFFFFFFFDFFF8F8ULL, 0xFFFFFFFFFDFFF1F1ULL, 0xFFFFFFFFFDFFE3E3ULL,
+  0xFFFFFFFFFDFFC7C7ULL, 0xFFFFFFFFFDFF8F8FULL, 0xFFFFFFFFFDFF1F1FULL, 0xFFFFFFFFFDFF3F3FULL,
+  0xFFFFFFFFFDFCFCFCULL, 0xFFFFFFFFFDF8F8F8ULL, 0xFFFFFFFFFDF1F1F1ULL, 0xFFFFFFFFFDE3E3E3ULL,
+  0xFFFFFFFFFDC7C7C7ULL, 0xFFFFFFFFFD8F8F8FULL, 0xFFFFFFFFFD1F1F1FULL, 0xFFFFFFFFFD3F3F3FULL,
+  0x0000000704040000ULL, 0x0000000700000000ULL, 0x0000000701010000ULL, 0x0000070F01030000ULL,
+  0x000F0F1F05070700ULL, 0x0F1F1F3F0D0F0700ULL, 0x1F3F3F7F1D1F1F0FULL, 0xFFFFFFFF3D3F3FFFULL,
+  0x0000000404000000ULL, 0x0000000000000000ULL, 0x0000000101000000ULL, 0x0000070301030000ULL,
+  0x00070F0705030000ULL, 0x0F0F1F0F0D0F0700ULL, 0x1F1F3F1F1D1F1F0FULL, 0xFFFFFF3F3D3FFFFFULL,
+  0x0000000400000000ULL, 0x0000000000000000ULL, 0x0000000100000000ULL, 0x0000030301000000ULL,
+  0x0007070705030000ULL, 0x0F0F0F0F0D0F0700ULL, 0x1F1F1F1F1D1F1F0FULL, 0xFFFF3F3F3DFFFFFFULL,
+  0x0000040400000000ULL, 0x0000000000000000ULL, 0x0000010100000000ULL, 0x0003030301000000ULL,
+  0x0007070705030000ULL, 0x0F0F0F0F0D0F0700ULL, 0x1F1F1F1F1D1F1F0FULL, 0xFF3F3F3FFDFFFFFFULL,
+  0x0004040500000000ULL, 0x0000000200000000ULL, 0x0001010500000000ULL, 0x0003030B01000000ULL,
+  0x0707071705030000ULL, 0x0F0F0F2F0D0F0700ULL, 0x1F1F1F5F1D1F1F0FULL, 0x3F3F3FFFFDFFFFFFULL,
+  0x0404070400000000ULL, 0x0000070000000000ULL, 0x0101070100000000ULL, 0x03030F0301000000ULL,
+  0x07071F0705030000ULL, 0x0F0F3F0F0D0F0700ULL, 0x1F1F7F5F1D1F1F0FULL, 0x3F3FFFFFFDFFFFFFULL,
+  0xFFFFFFFFFBFFFCFCULL, 0xFFFFFFFFFBFFF8F8ULL, 0xFFFFFFFFFBFFF1F1ULL, 0xFFFFFFFFFBFFE3E3ULL,
+  0xFFFFFFFFFBFFC7C7ULL, 0xFFFFFFFFFBFF8F8FULL, 0xFFFFFFFFFBFF1F1FULL, 0xFFFFFFFFFBFF3F3FULL,
+  0xFFFFFFFFFBFCFCFCULL, 0xFFFFFFFFFBF8F8F8ULL, 0xFFFFFFFFFBF1F1F1ULL, 0xFFFFFFFFFBE3E3E3ULL,
+  0xFFFFFFFFFBC7C7C7ULL, 0xFFFFFFFFFB8F8F8FULL, 0xFFFFFFFFFB1F1F1FULL, 0xFFFFFFFFFB3F3F3FULL,
+  0xFFFFFFFFF8FCFCFFULL, 0xFFFFFFFFF8F8F8FFULL, 0xFFFFFFFFF1F1F1FFULL, 0xFFFFFFFFE3E3E3FFULL,
+  0xFFFFFFFFC3C7C7FFULL, 0xFFFFFFFF8B8F8FFFULL, 0xFFFFFFFF1B1F1FFFULL, 0xFFFFFFFF3B3F3FFFULL,
+  0x003F3F3C383C3E00ULL, 0x00001E1818180000ULL, 0x0000000000000000ULL, 0x00000F0303030000ULL,
+  0x001F1F0703070F00ULL, 0x1F3F3F0F0B0F0F00ULL, 0x3F7F7F1F1B1F3F1FULL, 0xFFFFFF3F3B3FFFFFULL,
+  0x003E3C3C383C0000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+  0x000F070703070000ULL, 0x1F1F0F0F0B1F0F00ULL, 0x3F3F1F1F1B3F3F1FULL, 0xFFFF3F3F3BFFFFFFULL,
+  0x3E3C3C3C3A3C0000ULL, 0x0018181818000000ULL, 0x0000000000000000ULL, 0x0003030303000000ULL,
+  0x0F0707070B070000ULL, 0x1F0F0F0F1B1F0F00ULL, 0x3F1F1F1F3B3F3F1FULL, 0xFF3F3F3FFBFFFFFFULL,
+  0x3C3C3C3E3B3C0000ULL, 0x1818181D1B000000ULL, 0x0000000A0A000000ULL, 0x030303171B000000ULL,
+  0x0707072F3B070000ULL, 0x0F0F0F5F7B1F0F00ULL, 0x1F1F1FBFFB3F3F1FULL, 0x3F3F3FFFFBFFFFFFULL,
+  0x3C3C3F3F3A3C0000ULL, 0x18181F1F18000000ULL, 0x00111F1F00000000ULL, 0x03031F1F03000000ULL,
+  0x07073F3F0B070000ULL, 0x0F0F7F7F1B1F0F00ULL, 0x1F1FFFFF3B3F3F1FULL, 0x3F3FFFFFFBFFFFFFULL,
+  0xFFFFFFFFFBFFFCFCULL, 0xFFFFFFFFFBFFF8F8ULL, 0xFFFFFFFFFBFFF1F1ULL, 0xFFFFFFFFFBFFE3E3ULL,
+  0xFFFFFFFFFBFFC7C7ULL, 0xFFFFFFFFFBFF8F8FULL, 0xFFFFFFFFFBFF1F1FULL, 0xFFFFFFFFFBFF3F3FULL,
+  0xFFFFFFFFFBFCFCFCULL, 0xFFFFFFFFFBF8F8F8ULL, 0xFFFFFFFFFBF1F1F1ULL, 0xFFFFFFFFFBE3E3E3ULL,
+  0xFFFFFFFFFBC7C7C7ULL, 0xFFFFFFFFFB8F8F8FULL, 0xFFFFFFFFFB1F1F1FULL, 0xFFFFFFFFFB3F3F3FULL,
+  0x00001E1F181C0000ULL, 0x0000000E08080000ULL, 0x0000000E00000000ULL, 0x0000000E02020000ULL,
+  0x00000F1F03070000ULL, 0x001F1F3F0B0F0F00ULL, 0x1F3F3F7F1B1F0F00ULL, 0x3F7F7FFF3B3F3F1FULL,
+  0x00001E1C181C0000ULL, 0x0000000808000000ULL, 0x0000000000000000ULL, 0x0000000202000000ULL,
+  0x00000F0703070000ULL, 0x000F1F0F0B070000ULL, 0x1F1F3F1F1B1F0F00ULL, 0x3F3F7F3F3B3F3F1FULL,
+  0x00001C1C18000000ULL, 0x0000000800000000ULL, 0x0000000000000000ULL, 0x0000000200000000ULL,
+  0x0000070703000000ULL, 0x000F0F0F0B070000ULL, 0x1F1F1F1F1B1F0F00ULL, 0x3F3F3F3F3B3F3F1FULL,
+  0x001C1C1C18000000ULL, 0x0000080800000000ULL, 0x0000000000000000ULL, 0x0000020200000000ULL,
+  0x0007070703000000ULL, 0x000F0F0F0B070000ULL, 0x1F1F1F1F1B1F0F00ULL, 0x3F3F3F3F3B3F3F1FULL,
+  0x001C1C1D18000000ULL, 0x0008080A00000000ULL, 0x0000000400000000ULL, 0x0002020A00000000ULL,
+  0x0007071703000000ULL, 0x0F0F0F2F0B070000ULL, 0x1F1F1F5F1B1F0F00ULL, 0x3F3F3FBF3B3F3F1FULL,
+  0x1C1C1F1C18000000ULL, 0x08080E0800000000ULL, 0x00000E0000000000ULL, 0x02020E0200000000ULL,
+  0x07071F0703000000ULL, 0x0F0F3F0F0B070000ULL, 0x1F1F7F1F1B1F0F00ULL, 0x3F3FFFBF3B3F3F1FULL,
+  0xFFFFFFFFF7FFFCFCULL, 0xFFFFFFFFF7FFF8F8ULL, 0xFFFFFFFFF7FFF1F1ULL, 0xFFFFFFFFF7FFE3E3ULL,
+  0xFFFFFFFFF7FFC7C7ULL, 0xFFFFFFFFF7FF8F8FULL, 0xFFFFFFFFF7FF1F1FULL, 0xFFFFFFFFF7FF3F3FULL,
+  0xFFFFFFFFF7FCFCFCULL, 0xFFFFFFFFF7F8F8F8ULL, 0xFFFFFFFFF7F1F1F1ULL, 0xFFFFFFFFF7E3E3E3ULL,
+  0xFFFFFFFFF7C7C7C7ULL, 0xFFFFFFFFF78F8F8FULL, 0xFFFFFFFFF71F1F1FULL, 0xFFFFFFFFF73F3F3FULL,
+  0xFFFFFFFFF4FCFCFFULL, 0xFFFFFFFFF0F8F8FFULL, 0xFFFFFFFFF1F1F1FFULL, 0xFFFFFFFFE3E3E3FFULL,
+  0xFFFFFFFFC7C7C7FFULL, 0xFFFFFFFF878F8FFFULL, 0xFFFFFFFF171F1FFFULL, 0xFFFFFFFF373F3FFFULL,
+  0xFEFFFFFCF4FCFC00ULL, 0x007E7E7870787C00ULL, 0x00003C3030300000ULL, 0x0000000000000000ULL,
+  0x00001E0606060000ULL, 0x003F3F0F070F1F00ULL, 0x3F7F7F1F171F1F00ULL, 0x7FFFFF3F373F7F3FULL,
+  0xFEFEFCFCF4FEFC00ULL, 0x007C787870780000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+  0x0000000000000000ULL, 0x001F0F0F070F0000ULL, 0x3F3F1F1F173F1F00ULL, 0x7F7F3F3F377F7F3FULL,
+  0xFEFCFCFCF6FEFC00ULL, 0x7C78787874780000ULL, 0x0030303030000000ULL, 0x0000000000000000ULL,
+  0x0006060606000000ULL, 0x1F0F0F0F170F0000ULL, 0x3F1F1F1F373F1F00ULL, 0x7F3F3F3F777F7F3FULL,
+  0xFCFCFCFEF7FEFC00ULL, 0x7878787D77780000ULL, 0x3030303A36000000ULL, 0x0000001414000000ULL,
+  0x0606062E36000000ULL, 0x0F0F0F5F770F0000ULL, 0x1F1F1FBFF73F1F00ULL, 0x3F3F3F7FF77F7F3FULL,
+  0xFCFCFFFFF6FEFC00ULL, 0x78787F7F74780000ULL, 0x30303E3E30000000ULL, 0x00223E3E00000000ULL,
+  0x06063E3E06000000ULL, 0x0F0F7F7F170F0000ULL, 0x1F1FFFFF373F1F00ULL, 0x3F3FFFFF777F7F3FULL,
+  0xFFFFFFFFF7FFFCFCULL, 0xFFFFFFFFF7FFF8F8ULL, 0xFFFFFFFFF7FFF1F1ULL, 0xFFFFFFFFF7FFE3E3ULL,
+  0xFFFFFFFFF7FFC7C7ULL, 0xFFFFFFFFF7FF8F8FULL, 0xFFFFFFFFF7FF1F1FULL, 0xFFFFFFFFF7FF3F3FULL,
+  0xFFFFFFFFF7FCFCFCULL, 0xFFFFFFFFF7F8F8F8ULL, 0xFFFFFFFFF7F1F1F1ULL, 0xFFFFFFFFF7E3E3E3ULL,
+  0xFFFFFFFFF7C7C7C7ULL, 0xFFFFFFFFF78F8F8FULL, 0xFFFFFFFFF71F1F1FULL, 0xFFFFFFFFF73F3F3FULL,
+  0x007E7E7F747C7C00ULL, 0x00003C3E30380000ULL, 0x0000001C10100000ULL, 0x0000001C00000000ULL,
+  0x0000001C04040000ULL, 0x00001E3E060E0000ULL, 0x003F3F7F171F1F00ULL, 0x3F7F7FFF373F1F00ULL,
+  0x007C7E7C74780000ULL, 0x00003C3830380000ULL, 0x0000001010000000ULL, 0x0000000000000000ULL,
+  0x0000000404000000ULL, 0x00001E0E060E0000ULL, 0x001F3F1F170F0000ULL, 0x3F3F7F3F373F1F00ULL,
+  0x007C7C7C74780000ULL, 0x0000383830000000ULL, 0x0000001000000000ULL, 0x0000000000000000ULL,
+  0x0000000400000000ULL, 0x00000E0E06000000ULL, 0x001F1F1F170F0000ULL, 0x3F3F3F3F373F1F00ULL,
+  0x007C7C7C74780000ULL, 0x0038383830000000ULL, 0x0000101000000000ULL, 0x0000000000000000ULL,
+  0x0000040400000000ULL, 0x000E0E0E06000000ULL, 0x001F1F1F170F0000ULL, 0x3F3F3F3F373F1F00ULL,
+  0x7C7C7C7D74780000ULL, 0x0038383A30000000ULL, 0x0010101400000000ULL, 0x0000000800000000ULL,
+  0x0004041400000000ULL, 0x000E0E2E06000000ULL, 0x1F1F1F5F170F0000ULL, 0x3F3F3FBF373F1F00ULL,
+  0x7C7C7F7C74780000ULL, 0x38383E3830000000ULL, 0x10101C1000000000ULL, 0x00001C0000000000ULL,
+  0x04041C0400000000ULL, 0x0E0E3E0E06000000ULL, 0x1F1F7F1F170F0000ULL, 0x3F3FFF3F373F1F00ULL,
+  0xFFFFFFFFFFFEFCFCULL, 0xFFFFFFFFFFFEF8F8ULL, 0xFFFFFFFFFFFEF1F1ULL, 0xFFFFFFFFFFFEE3E3ULL,
+  0xFFFFFFFFFFFEC7C7ULL, 0xFFFFFFFFFFFE8F8FULL, 0xFFFFFFFFFFFE1F1FULL, 0xFFFFFFFFFFFE3F3FULL,
+  0xFFFFFFFFFFFCFCFCULL, 0xFFFFFFFFFFF8F8F8ULL, 0xFFFFFFFFFFF0F1F1ULL, 0xFFFFFFFFFFE2E3E3ULL,
+  0xFFFFFFFFFFC6C7C7ULL, 0xFFFFFFFFFF8E8F8FULL, 0xFFFFFFFFFF1E1F1FULL, 0xFFFFFFFFFF3E3F3FULL,
+  0x0000000000000000ULL, 0x0000000300000000ULL, 0x0000070701000000ULL, 0x00070F0F03020300ULL,
+  0x0F0F1F1F07060700ULL, 0x1F1F3F3F0F0E0F00ULL, 0xFFFFFFFF1F1E1FFFULL, 0xFFFFFFFF3F3E3FFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000020000000000ULL, 0x0007070303020000ULL,
+  0x0F0F0F0707060000ULL, 0x1F1F1F0F0F0E0000ULL, 0xFFFFFF1F1F1EFFFFULL, 0xFFFFFF3F3F3EFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0007030303000000ULL,
+  0x0F0F070707000000ULL, 0x1F1F0F0F0F000000ULL, 0xFFFF1F1F1FFEFFFFULL, 0xFFFF3F3F3FFEFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0003030300000000ULL,
+  0x0F07070700000000ULL, 0x1F0F0F0F1F000000ULL, 0xFF1F1F1FFFFEFFFFULL, 0xFF3F3F3FFFFEFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0303030000000000ULL,
+  0x0707070F00000000ULL, 0x0F0F0F1F1F000000ULL, 0x1F1F1FFFFFFEFFFFULL, 0x3F3F3FFFFFFEFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0303070000000000ULL,
+  0x07070F0F00000000ULL, 0x0F0F1F1F1F000000ULL, 0x1F1FFFFFFFFEFFFFULL, 0x3F3FFFFFFFFEFFFFULL,
+  0xFFFFFFFFFFFEFCFCULL, 0xFFFFFFFFFFFEF8F8ULL, 0xFFFFFFFFFFFEF1F1ULL, 0xFFFFFFFFFFFEE3E3ULL,
+  0xFFFFFFFFFFFEC7C7ULL, 0xFFFFFFFFFFFE8F8FULL, 0xFFFFFFFFFFFE1F1FULL, 0xFFFFFFFFFFFE3F3FULL,
+  0x0000000003000000ULL, 0x0000000003000000ULL, 0x0000000307000000ULL, 0x000007070F020200ULL,
+  0x00070F0F1F060700ULL, 0x0F0F1F1F3F0E0F00ULL, 0x1F1F3F3F7F1E1F00ULL, 0xFFFFFFFFFF3E3F3FULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000200000000ULL, 0x0000020602020000ULL,
+  0x0007070F07060000ULL, 0x0F0F0F1F0F0E0000ULL, 0x1F1F1F3F1F1E0000ULL, 0xFFFFFFFF3F3E3FFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000020202000000ULL,
+  0x0007070707000000ULL, 0x0F0F0F0F0F000000ULL, 0x1F1F1F1F1F000000ULL, 0xFFFFFF3F3F3EFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000020200000000ULL,
+  0x0007070700000000ULL, 0x0F0F0F0F00000000ULL, 0x1F1F1F1F1F000000ULL, 0xFFFF3F3F3FFEFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000020000000000ULL,
+  0x0007070000000000ULL, 0x0F0F0F0F00000000ULL, 0x1F1F1F1F1F000000ULL, 0xFF3F3F3FFFFEFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0002000000000000ULL,
+  0x0007070000000000ULL, 0x0F0F0F0F00000000ULL, 0x1F1F1F1F1F000000ULL, 0x3F3F3FFFFFFEFFFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0202000000000000ULL,
+  0x0707070000000000ULL, 0x0F0F0F0F00000000ULL, 0x1F1F1F1F1F000000ULL, 0x3F3FFFFFFFFEFFFFULL,
+  0xFFFFFFFFFFFDFCFCULL, 0xFFFFFFFFFFFDF8F8ULL, 0xFFFFFFFFFFFDF1F1ULL, 0xFFFFFFFFFFFDE3E3ULL,
+  0xFFFFFFFFFFFDC7C7ULL, 0xFFFFFFFFFFFD8F8FULL, 0xFFFFFFFFFFFD1F1FULL, 0xFFFFFFFFFFFD3F3FULL,
+  0xFFFFFFFFFFFCFCFCULL, 0xFFFFFFFFFFF8F8F8ULL, 0xFFFFFFFFFFF1F1F1ULL, 0xFFFFFFFFFFE1E3E3ULL,
+  0xFFFFFFFFFFC5C7C7ULL, 0xFFFFFFFFFF8D8F8FULL, 0xFFFFFFFFFF1D1F1FULL, 0xFFFFFFFFFF3D3F3FULL,
+  0x0000000F0C0C0C00ULL, 0x0000000000000000ULL, 0x0000000701010100ULL, 0x00000F0F03010307ULL,
+  0x000F1F1F07050707ULL, 0x1F1F3F3F0F0D0F1FULL, 0x3F3F7F7F1F1D1F3FULL, 0xFFFFFFFF3F3D3FFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000070303010300ULL,
+  0x000F0F0707050F07ULL, 0x1F1F1F0F0F0D1F1FULL, 0x3F3F3F1F1F1D3F3FULL, 0xFFFFFF3F3F3DFFFFULL,
+  0x00000C0C0C0C0000ULL, 0x0000000000000000ULL, 0x0000010101010000ULL, 0x0007030303050300ULL,
+  0x000F0707070D0F07ULL, 0x1F1F0F0F0F1D1F1FULL, 0x3F3F1F1F1F3D3F3FULL, 0xFFFF3F3F3FFDFFFFULL,
+  0x000C0C0C0E0D0000ULL, 0x0000000005050000ULL, 0x000101010B0D0000ULL, 0x00030303171D0300ULL,
+  0x0F0707072F3D0F07ULL, 0x1F0F0F0F5F7D1F1FULL, 0x3F1F1F1FBFFD3F3FULL, 0xFF3F3F3FFFFDFFFFULL,
+  0x0C0C0C0F0F0C0000ULL, 0x0000080F0F000000ULL, 0x0101010F0F010000ULL, 0x0303031F1F050300ULL,
+  0x0707073F3F0D0F07ULL, 0x0F0F0F7F7F1D1F1FULL, 0x1F1F1FFFFF3D3F3FULL, 0x3F3F3FFFFFFDFFFFULL,
+  0x0C1C1F1F1F1D0000ULL, 0x00181F1F1F1D0000ULL, 0x01111F1F1F1D0000ULL, 0x03031F1F1F1D0300ULL,
+  0x07073F3F3F3D0F07ULL, 0x0F0F7F7F7F7D1F1FULL, 0x1F1FFFFFFFFD3F3FULL, 0x3F3FFFFFFFFDFFFFULL,
+  0xFFFFFFFFFFFDFCFCULL, 0xFFFFFFFFFFFDF8F8ULL, 0xFFFFFFFFFFFDF1F1ULL, 0xFFFFFFFFFFFDE3E3ULL,
+  0xFFFFFFFFFFFDC7C7ULL, 0xFFFFFFFFFFFD8F8FULL, 0xFFFFFFFFFFFD1F1FULL, 0xFFFFFFFFFFFD3F3FULL,
+  0x0000000007040400ULL, 0x0000000007000000ULL, 0x0000000007010100ULL, 0x000000070F010300ULL,
+  0x00000F0F1F050707ULL, 0x000F1F1F3F0D0F07ULL, 0x1F1F3F3F7F1D1F1FULL, 0x3F3F7F7FFF3D3F3FULL,
+  0x0000000004040000ULL, 0x0000000000000000ULL, 0x0000000001010000ULL, 0x0000000703010300ULL,
+  0x0000070F07050300ULL, 0x000F0F1F0F0D0F07ULL, 0x1F1F1F3F1F1D1F1FULL, 0x3F3F3F7F3F3D3F3FULL,
+  0x0000000004000000ULL, 0x0000000000000000ULL, 0x0000000001000000ULL, 0x0000000303010000ULL,
+  0x0000070707050300ULL, 0x000F0F0F0F0D0F07ULL, 0x1F1F1F1F1F1D1F1FULL, 0x3F3F3F3F3F3D3F3FULL,
+  0x0000000404000000ULL, 0x0000000000000000ULL, 0x0000000101000000ULL, 0x0000030303010000ULL,
+  0x0000070707050300ULL, 0x000F0F0F0F0D0F07ULL, 0x1F1F1F1F1F1D1F1FULL, 0x3F3F3F3F3F3D3F3FULL,
+  0x0000040405000000ULL, 0x0000000002000000ULL, 0x0000010105000000ULL, 0x000003030B010000ULL,
+  0x0007070717050300ULL, 0x000F0F0F2F0D0F07ULL, 0x1F1F1F1F5F1D1F1FULL, 0x3F3F3F3FBF3D3F3FULL,
+  0x0004040704000000ULL, 0x0000000700000000ULL, 0x0001010701000000ULL, 0x0003030F03010000ULL,
+  0x0007071F07050300ULL, 0x0F0F0F3F0F0D0F07ULL, 0x1F1F1F7F1F1D1F1FULL, 0x3F3F3FFFBF3D3F3FULL,
+  0x04040F0F0F000000ULL, 0x00000F0F0F000000ULL, 0x01010F0F0F000000ULL, 0x03030F0F0F010000ULL,
+  0x07071F1F1F050300ULL, 0x0F0F3F3F3F0D0F07ULL, 0x1F1F7F7F7F1D1F1FULL, 0x3F3FFFFFFF3D3F3FULL,
+  0xFFFFFFFFFFFBFCFCULL, 0xFFFFFFFFFFFBF8F8ULL, 0xFFFFFFFFFFFBF1F1ULL, 0xFFFFFFFFFFFBE3E3ULL,
+  0xFFFFFFFFFFFBC7C7ULL, 0xFFFFFFFFFFFB8F8FULL, 0xFFFFFFFFFFFB1F1FULL, 0xFFFFFFFFFFFB3F3FULL,
+  0xFFFFFFFFFFF8FCFCULL, 0xFFFFFFFFFFF8F8F8ULL, 0xFFFFFFFFFFF1F1F1ULL, 0xFFFFFFFFFFE3E3E3ULL,
+  0xFFFFFFFFFFC3C7C7ULL, 0xFFFFFFFFFF8B8F8FULL, 0xFFFFFFFFFF1B1F1FULL, 0xFFFFFFFFFF3B3F3FULL,
+  0x00003F3F3C383C3EULL, 0x0000001E18181800ULL, 0x0000000000000000ULL, 0x0000000F03030300ULL,
+  0x00001F1F0703070FULL, 0x001F3F3F0F0B0F0FULL, 0x3F3F7F7F1F1B1F3FULL, 0x7F7FFFFF3F3B3F7FULL,
+  0x00003E3C3C383C00ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+  0x00000F0707030700ULL, 0x001F1F0F0F0B1F0FULL, 0x3F3F3F1F1F1B3F3FULL, 0x7F7F7F3F3F3B7F7FULL,
+  0x003E3C3C3C3A3C00ULL, 0x0000181818180000ULL, 0x0000000000000000ULL, 0x0000030303030000ULL,
+  0x000F0707070B0700ULL, 0x001F0F0F0F1B1F0FULL, 0x3F3F1F1F1F3B3F3FULL, 0x7F7F3F3F3F7B7F7FULL,
+  0x003C3C3C3E3B3C00ULL, 0x001818181D1B0000ULL, 0x000000000A0A0000ULL, 0x00030303171B0000ULL,
+  0x000707072F3B0700ULL, 0x1F0F0F0F5F7B1F0FULL, 0x3F1F1F1FBFFB3F3FULL, 0x7F3F3F3F7FFB7F7FULL,
+  0x3C3C3C3F3F3A3C00ULL, 0x1818181F1F180000ULL, 0x0000111F1F000000ULL, 0x0303031F1F030000ULL,
+  0x0707073F3F0B0700ULL, 0x0F0F0F7F7F1B1F0FULL, 0x1F1F1FFFFF3B3F3FULL, 0x3F3F3FFFFF7B7F7FULL,
+  0x3C3C3F3F3F3B3C00ULL, 0x18383F3F3F3B0000ULL, 0x00313F3F3F3B0000ULL, 0x03233F3F3F3B0000ULL,
+  0x07073F3F3F3B0700ULL, 0x0F0F7F7F7F7B1F0FULL, 0x1F1FFFFFFFFB3F3FULL, 0x3F3FFFFFFFFB7F7FULL,
+  0xFFFFFFFFFFFBFCFCULL, 0xFFFFFFFFFFFBF8F8ULL, 0xFFFFFFFFFFFBF1F1ULL, 0xFFFFFFFFFFFBE3E3ULL,
+  0xFFFFFFFFFFFBC7C7ULL, 0xFFFFFFFFFFFB8F8FULL, 0xFFFFFFFFFFFB1F1FULL, 0xFFFFFFFFFFFB3F3FULL,
+  0x0000001E1F181C00ULL, 0x000000000E080800ULL, 0x000000000E000000ULL, 0x000000000E020200ULL,
+  0x0000000F1F030700ULL, 0x00001F1F3F0B0F0FULL, 0x001F3F3F7F1B1F0FULL, 0x3F3F7F7FFF3B3F3FULL,
+  0x0000001E1C181C00ULL, 0x0000000008080000ULL, 0x0000000000000000ULL, 0x0000000002020000ULL,
+  0x0000000F07030700ULL, 0x00000F1F0F0B0700ULL, 0x001F1F3F1F1B1F0FULL, 0x3F3F3F7F3F3B3F3FULL,
+  0x0000001C1C180000ULL, 0x0000000008000000ULL, 0x0000000000000000ULL, 0x0000000002000000ULL,
+  0x0000000707030000ULL, 0x00000F0F0F0B0700ULL, 0x001F1F1F1F1B1F0FULL, 0x3F3F3F3F3F3B3F3FULL,
+  0x00001C1C1C180000ULL, 0x0000000808000000ULL, 0x0000000000000000ULL, 0x0000000202000000ULL,
+  0x0000070707030000ULL, 0x00000F0F0F0B0700ULL, 0x001F1F1F1F1B1F0FULL, 0x3F3F3F3F3F3B3F3FULL,
+  0x00001C1C1D180000ULL, 0x000008080A000000ULL, 0x0000000004000000ULL, 0x000002020A000000ULL,
+  0x0000070717030000ULL, 0x000F0F0F2F0B0700ULL, 0x001F1F1F5F1B1F0FULL, 0x3F3F3F3FBF3B3F3FULL,
+  0x001C1C1F1C180000ULL, 0x0008080E08000000ULL, 0x0000000E00000000ULL, 0x0002020E02000000ULL,
+  0x0007071F07030000ULL, 0x000F0F3F0F0B0700ULL, 0x1F1F1F7F1F1B1F0FULL, 0x3F3F3FFF3F3B3F3FULL,
+  0x1C1C1F1F1F180000ULL, 0x08081F1F1F000000ULL, 0x00001F1F1F000000ULL, 0x02021F1F1F000000ULL,
+  0x07071F1F1F030000ULL, 0x0F0F3F3F3F0B0700ULL, 0x1F1F7F7F7F1B1F0FULL, 0x3F3FFFFFFF3B3F3FULL,
+  0xFFFFFFFFFFF7FCFCULL, 0xFFFFFFFFFFF7F8F8ULL, 0xFFFFFFFFFFF7F1F1ULL, 0xFFFFFFFFFFF7E3E3ULL,
+  0xFFFFFFFFFFF7C7C7ULL, 0xFFFFFFFFFFF78F8FULL, 0xFFFFFFFFFFF71F1FULL, 0xFFFFFFFFFFF73F3FULL,
+  0xFFFFFFFFFFF4FCFCULL, 0xFFFFFFFFFFF0F8F8ULL, 0xFFFFFFFFFFF1F1F1ULL, 0xFFFFFFFFFFE3E3E3ULL,
+  0xFFFFFFFFFFC7C7C7ULL, 0xFFFFFFFFFF878F8FULL, 0xFFFFFFFFFF171F1FULL, 0xFFFFFFFFFF373F3FULL,
+  0x00FEFFFFFCF4FCFCULL, 0x00007E7E7870787CULL, 0x0000003C30303000ULL, 0x0000000000000000ULL,
+  0x0000001E06060600ULL, 0x00003F3F0F070F1FULL, 0x003F7F7F1F171F1FULL, 0x7F7FFFFF3F373F7FULL,
+  0x00FEFEFCFCF4FEFCULL, 0x00007C7878707800ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+  0x0000000000000000ULL, 0x00001F0F0F070F00ULL, 0x003F3F1F1F173F1FULL, 0x7F7F7F3F3F377F7FULL,
+  0x00FEFCFCFCF6FEFCULL, 0x007C787878747800ULL, 0x0000303030300000ULL, 0x0000000000000000ULL,
+  0x0000060606060000ULL, 0x001F0F0F0F170F00ULL, 0x003F1F1F1F373F1FULL, 0x7F7F3F3F3F777F7FULL,
+  0xFEFCFCFCFEF7FEFCULL, 0x007878787D777800ULL, 0x003030303A360000ULL, 0x0000000014140000ULL,
+  0x000606062E360000ULL, 0x000F0F0F5F770F00ULL, 0x3F1F1F1FBFF73F1FULL, 0x7F3F3F3F7FF77F7FULL,
+  0xFCFCFCFFFFF6FEFCULL, 0x7878787F7F747800ULL, 0x3030303E3E300000ULL, 0x0000223E3E000000ULL,
+  0x0606063E3E060000ULL, 0x0F0F0F7F7F170F00ULL, 0x1F1F1FFFFF373F1FULL, 0x3F3F3FFFFF777F7FULL,
+  0xFCFCFFFFFFF7FEFCULL, 0x78787F7F7F777800ULL, 0x30717F7F7F770000ULL, 0x00637F7F7F770000ULL,
+  0x06477F7F7F770000ULL, 0x0F0F7F7F7F770F00ULL, 0x1F1FFFFFFFF73F1FULL, 0x3F3FFFFFFFF77F7FULL,
+  0xFFFFFFFFFFF7FCFCULL, 0xFFFFFFFFFFF7F8F8ULL, 0xFFFFFFFFFFF7F1F1ULL, 0xFFFFFFFFFFF7E3E3ULL,
+  0xFFFFFFFFFFF7C7C7ULL, 0xFFFFFFFFFFF78F8FULL, 0xFFFFFFFFFFF71F1FULL, 0xFFFFFFFFFFF73F3FULL,
+  0x00007E7E7F747C7CULL, 0x0000003C3E303800ULL, 0x000000001C101000ULL, 0x000000001C000000ULL,
+  0x000000001C040400ULL, 0x0000001E3E060E00ULL, 0x00003F3F7F171F1FULL, 0x003F7F7FFF373F1FULL,
+  0x00007C7E7C747800ULL, 0x0000003C38303800ULL, 0x0000000010100000ULL, 0x0000000000000000ULL,
+  0x0000000004040000ULL, 0x0000001E0E060E00ULL, 0x00001F3F1F170F00ULL, 0x003F3F7F3F373F1FULL,
+  0x00007C7C7C747800ULL, 0x0000003838300000ULL, 0x0000000010000000ULL, 0x0000000000000000ULL,
+  0x0000000004000000ULL, 0x0000000E0E060000ULL, 0x00001F1F1F170F00ULL, 0x003F3F3F3F373F1FULL,
+  0x00007C7C7C747800ULL, 0x0000383838300000ULL, 0x0000001010000000ULL, 0x0000000000000000ULL,
+  0x0000000404000000ULL, 0x00000E0E0E060000ULL, 0x00001F1F1F170F00ULL, 0x003F3F3F3F373F1FULL,
+  0x007C7C7C7D747800ULL, 0x000038383A300000ULL, 0x0000101014000000ULL, 0x0000000008000000ULL,
+  0x0000040414000000ULL, 0x00000E0E2E060000ULL, 0x001F1F1F5F170F00ULL, 0x003F3F3FBF373F1FULL,
+  0x007C7C7F7C747800ULL, 0x0038383E38300000ULL, 0x0010101C10000000ULL, 0x0000001C00000000ULL,
+  0x0004041C04000000ULL, 0x000E0E3E0E060000ULL, 0x001F1F7F1F170F00ULL, 0x3F3F3FFF3F373F1FULL,
+  0x7C7C7F7F7F747800ULL, 0x38383E3E3E300000ULL, 0x10103E3E3E000000ULL, 0x00003E3E3E000000ULL,
+  0x04043E3E3E000000ULL, 0x0E0E3E3E3E060000ULL, 0x1F1F7F7F7F170F00ULL, 0x3F3FFFFFFF373F1FULL,
+  0xFFFFFFFFFFFFFCFCULL, 0xFFFFFFFFFFFFF8F8ULL, 0xFFFFFFFFFFFFF0F1ULL, 0xFFFFFFFFFFFFE2E3ULL,
+  0xFFFFFFFFFFFFC6C7ULL, 0xFFFFFFFFFFFF8E8FULL, 0xFFFFFFFFFFFF1E1FULL, 0xFFFFFFFFFFFF3E3FULL,
+  0x0000000000000000ULL, 0xFFFFFFFFFFF8F8F8ULL, 0xFFFFFFFFFFF1F0F1ULL, 0xFFFFFFFFFFE3E2E3ULL,
+  0xFFFFFFFFFFC7C6C7ULL, 0xFFFFFFFFFF8F8E8FULL, 0xFFFFFFFFFF1F1E1FULL, 0xFFFFFFFFFF3F3E3FULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x00000F0F01000000ULL, 0x00071F1F03030200ULL,
+  0x0F0F3F3F07070600ULL, 0x1F1F7F7F0F0F0E00ULL, 0xFFFFFFFF1F1F1EFFULL, 0xFFFFFFFF3F3F3EFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000020000000000ULL, 0x0007070303030000ULL,
+  0x0F0F0F0707070000ULL, 0x1F1F1F0F0F0F0000ULL, 0xFFFFFF1F1F1FFEFFULL, 0xFFFFFF3F3F3FFEFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0007030303000000ULL,
+  0x0F0F070707000000ULL, 0x1F1F0F0F0F000000ULL, 0xFFFF1F1F1FFFFEFFULL, 0xFFFF3F3F3FFFFEFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0003030300000000ULL,
+  0x0F07070700000000ULL, 0x1F0F0F0F1F000000ULL, 0xFF1F1F1FFFFFFEFFULL, 0xFF3F3F3FFFFFFEFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0303030000000000ULL,
+  0x0707070F00000000ULL, 0x0F0F0F1F1F000000ULL, 0x1F1F1FFFFFFFFEFFULL, 0x3F3F3FFFFFFFFEFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0303070000000000ULL,
+  0x07070F0F00000000ULL, 0x0F0F1F1F1F000000ULL, 0x1F1FFFFFFFFFFEFFULL, 0x3F3FFFFFFFFFFEFFULL,
+  0x0000000000030000ULL, 0x0000000000030000ULL, 0xFFFFFFFFFFFFF0F1ULL, 0xFFFFFFFFFFFFE2E3ULL,
+  0xFFFFFFFFFFFFC6C7ULL, 0xFFFFFFFFFFFF8E8FULL, 0xFFFFFFFFFFFF1E1FULL, 0xFFFFFFFFFFFF3E3FULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x00000F0F0F000000ULL, 0x00000F0F0F020200ULL,
+  0x00071F1F1F070600ULL, 0x0F0F3F3F3F0F0E00ULL, 0x1F1F7F7F7F1F1E00ULL, 0xFFFFFFFFFF3F3E3FULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000600000000ULL, 0x0000020E02020000ULL,
+  0x0007071F07070000ULL, 0x0F0F0F3F0F0F0000ULL, 0x1F1F1F7F1F1F0000ULL, 0xFFFFFFFF3F3F3EFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000020202000000ULL,
+  0x0007070707000000ULL, 0x0F0F0F0F0F000000ULL, 0x1F1F1F1F1F000000ULL, 0xFFFFFF3F3F3FFEFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000020200000000ULL,
+  0x0007070700000000ULL, 0x0F0F0F0F00000000ULL, 0x1F1F1F1F1F000000ULL, 0xFFFF3F3F3FFFFEFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000020000000000ULL,
+  0x0007070000000000ULL, 0x0F0F0F0F00000000ULL, 0x1F1F1F1F1F000000ULL, 0xFF3F3F3FFFFFFEFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0002000000000000ULL,
+  0x0007070000000000ULL, 0x0F0F0F0F00000000ULL, 0x1F1F1F1F1F000000ULL, 0x3F3F3FFFFFFFFEFFULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0202000000000000ULL,
+  0x0707070000000000ULL, 0x0F0F0F0F00000000ULL, 0x1F1F1F1F1F000000ULL, 0x3F3FFFFFFFFFFEFFULL,
+  0xFFFFFFFFFFFFFCFCULL, 0xFFFFFFFFFFFFF8F8ULL, 0xFFFFFFFFFFFFF1F1ULL, 0xFFFFFFFFFFFFE1E3ULL,
+  0xFFFFFFFFFFFFC5C7ULL, 0xFFFFFFFFFFFF8D8FULL, 0xFFFFFFFFFFFF1D1FULL, 0xFFFFFFFFFFFF3D3FULL,
+  0xFFFFFFFFFFFCFCFCULL, 0x0000000000000000ULL, 0xFFFFFFFFFFF1F1F1ULL, 0xFFFFFFFFFFE3E1E3ULL,
+  0xFFFFFFFFFFC7C5C7ULL, 0xFFFFFFFFFF8F8D8FULL, 0xFFFFFFFFFF1F1D1FULL, 0xFFFFFFFFFF3F3D3FULL,
+  0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x00001F1F03030103ULL,
+  0x000F3F3F0707050FULL, 0x1F1F7F7F0F0F0D1FULL, 0x3F3FFFFF1F1F1D3FULL, 0xFFFFFFFF3F3F3DFFULL,
+  0x0000000C0C0C0C00ULL, 0x0000000000000000ULL, 0x0000000101010100ULL, 0x0000070303030503ULL,
+  0x000F0F0707070D0FULL, 0x1F1F1F0F0F0F1D1FULL, 0x3F3F3F1F1F1F3D3FULL, 0xFFFFFF3F3F3FFDFFULL,
+  0x00000C0C0C0E0D00ULL, 0x0000000000050500ULL, 0x00000101010B0D00ULL, 0x0000030303171D03ULL,
+  0x000F0707072F3D0FULL, 0x1F1F0F0F0F5F7D1FULL, 0x3F3F1F1F1FBFFD3FULL, 0xFFFF3F3F3FFFFDFFULL,
+  0x000C0C0C0F0F0C00ULL, 0x000000080F0F0000ULL, 0x000101010F0F0100ULL, 0x000303031F1F0503ULL,
+  0x000707073F3F0D0FULL, 0x1F0F0F0F7F7F1D1FULL, 0x3F1F1F1FFFFF3D3FULL, 0xFF3F3F3FFFFFFDFFULL,
+  0x0C0C1C1F1F1F1D00ULL, 0x0000181F1F1F1D00ULL, 0x0101111F1F1F1D00ULL, 0x0303031F1F1F1D03ULL,
+  0x0707073F3F3F3D0FULL, 0x0F0F0F7F7F7F7D1FULL, 0x1F1F1FFFFFFFFD3FULL, 0x3F3F3FFFFFFFFDFFULL,
+  0x0C3C3F3F3F3F3D3FULL, 0x00383F3F3F3F3D3FULL, 0x01313F3F3F3F3D3FULL, 0x03233F3F3F3F3D3FULL,
+  0x07073F3F3F3F3D3FULL, 0x0F0F7F7F7F7F7D7FULL, 0x1F1FFFFFFFFFFDFFULL, 0x3F3FFFFFFFFFFDFFULL,
+  0x0000000000070404ULL, 0x0000000000070000ULL, 0x0000000000070101ULL, 0xFFFFFFFFFFFFE1E3ULL,
+  0xFFFFFFFFFFFFC5C7ULL, 0xFFFFFFFFFFFF8D8FULL, 0xFFFFFFFFFFFF1D1FULL, 0xFFFFFFFFFFFF3D3FULL,
+  0x0000000000040400ULL, 0x0000000000000000ULL, 0x0000000000010100ULL, 0x00001F1F1F030103ULL,
+  0x00001F1F1F070503ULL, 0x000F3F3F3F0F0D0FULL, 0x1F1F7F7F7F1F1D1FULL, 0x3F3FFFFFFF3F3D3FULL,
+  0x0000000000040000ULL, 0x0000000000000000ULL, 0x0000000000010000ULL, 0x0000000F03030100ULL,
+  0x0000071F07070503ULL, 0x000F0F3F0F0F0D0FULL, 0x1F1F1F7F1F1F1D1FULL, 0x3F3F3FFF3F3F3D3FULL,
+  0x0000000004040000ULL, 0x0000000000000000ULL, 0x0000000001010000ULL, 0x0000000303030100ULL,
+  0x0000070707070503ULL, 0x000F0F0F0F0F0D0FULL, 0x1F1F1F1F1F1F1D1FULL, 0x3F3F3F3F3F3F3D3FULL,
+  0x0000000404050000ULL, 0x0000000000020000ULL, 0x0000000101050000ULL, 0x00000003030B0100ULL,
+  0x0000070707170503ULL, 0x000F0F0F0F2F0D0FULL, 0x1F1F1F1F1F5F1D1FULL, 0x3F3F3F3F3FBF3D3FULL,
+  0x0000040407040000ULL, 0x0000000007000000ULL, 0x0000010107010000ULL, 0x000003030F030100ULL,
+  0x000007071F070503ULL, 0x000F0F0F3F0F0D0FULL, 0x1F1F1F1F7F1F1D1FULL, 0x3F3F3F3FFFBF3D3FULL,
+  0x0004040F0F0F0000ULL, 0x0000000F0F0F0000ULL, 0x0001010F0F0F0000ULL, 0x0003030F0F0F0100ULL,
+  0x0007071F1F1F0503ULL, 0x000F0F3F3F3F0D0FULL, 0x1F1F1F7F7F7F1D1FULL, 0x3F3F3FFFFFFF3D3FULL,
+  0x04041F1F1F1F1D00ULL, 0x00001F1F1F1F1D00ULL, 0x01011F1F1F1F1D00ULL, 0x03031F1F1F1F1D00ULL,
+  0x07071F1F1F1F1D03ULL, 0x0F0F3F3F3F3F3D0FULL, 0x1F1F7F7F7F7F7D1FULL, 0x3F3FFFFFFFFFFD3FULL,
+  0xFFFFFFFFFFFFF8FCULL, 0xFFFFFFFFFFFFF8F8ULL, 0xFFFFFFFFFFFFF1F1ULL, 0xFFFFFFFFFFFFE3E3ULL,
+  0xFFFFFFFFFFFFC3C7ULL, 0xFFFFFFFFFFFF8B8FULL, 0xFFFFFFFFFFFF1B1FULL, 0xFFFFFFFFFFFF3B3FULL,
+  0xFFFFFFFFFFFCF8FCULL, 0xFFFFFFFFFFF8F8F8ULL, 0x0000000000000000ULL, 0xFFFFFFFFFFE3E3E3ULL,
+  0xFFFFFFFFFFC7C3C7ULL, 0xFFFFFFFFFF8F8B8FULL, 0xFFFFFFFFFF1F1B1FULL, 0xFFFFFFFFFF3F3B3FULL,
+  0x00003F3F3C3C383CULL, 0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+  0x00003F3F07070307ULL, 0x001F7F7F0F0F0B1FULL, 0x3F3FFFFF1F1F1B3FULL, 0x7F7FFFFF3F3F3B7FULL,
+  0x00003E3C3C3C3A3CULL, 0x0000001818181800ULL, 0x0000000000000000ULL, 0x0000000303030300ULL,
+  0x00000F0707070B07ULL, 0x001F1F0F0F0F1B1FULL, 0x3F3F3F1F1F1F3B3FULL, 0x7F7F7F3F3F3F7B7FULL,
+  0x00003C3C3C3E3B3CULL, 0x00001818181D1B00ULL, 0x00000000000A0A00ULL, 0x0000030303171B00ULL,
+  0x00000707072F3B07ULL, 0x001F0F0F0F5F7B1FULL, 0x3F3F1F1F1FBFFB3FULL, 0x7F7F3F3F3F7FFB7FULL,
+  0x003C3C3C3F3F3A3CULL, 0x001818181F1F1800ULL, 0x000000111F1F0000ULL, 0x000303031F1F0300ULL,
+  0x000707073F3F0B07ULL, 0x000F0F0F7F7F1B1FULL, 0x3F1F1F1FFFFF3B3FULL, 0x7F3F3F3FFFFF7B7FULL,
+  0x3C3C3C3F3F3F3B3CULL, 0x1818383F3F3F3B00ULL, 0x0000313F3F3F3B00ULL, 0x0303233F3F3F3B00ULL,
+  0x0707073F3F3F3B07ULL, 0x0F0F0F7F7F7F7B1FULL, 0x1F1F1FFFFFFFFB3FULL, 0x3F3F3FFFFFFFFB7FULL,
+  0x3C7C7F7F7F7F7B7FULL, 0x18787F7F7F7F7B7FULL, 0x00717F7F7F7F7B7FULL, 0x03637F7F7F7F7B7FULL,
+  0x07477F7F7F7F7B7FULL, 0x0F0F7F7F7F7F7B7FULL, 0x1F1FFFFFFFFFFBFFULL, 0x3F3FFFFFFFFFFBFFULL,
+  0xFFFFFFFFFFFFF8FCULL, 0x00000000000E0808ULL, 0x00000000000E0000ULL, 0x00000000000E0202ULL,
+  0xFFFFFFFFFFFFC3C7ULL, 0xFFFFFFFFFFFF8B8FULL, 0xFFFFFFFFFFFF1B1FULL, 0xFFFFFFFFFFFF3B3FULL,
+  0x00003F3F3F3C383CULL, 0x0000000000080800ULL, 0x0000000000000000ULL, 0x0000000000020200ULL,
+  0x00003F3F3F070307ULL, 0x00003F3F3F0F0B07ULL, 0x001F7F7F7F1F1B1FULL, 0x3F3FFFFFFF3F3B3FULL,
+  0x0000001F1C1C1800ULL, 0x0000000000080000ULL, 0x0000000000000000ULL, 0x0000000000020000ULL,
+  0x0000001F07070300ULL, 0x00000F3F0F0F0B07ULL, 0x001F1F7F1F1F1B1FULL, 0x3F3F3FFF3F3F3B3FULL,
+  0x0000001C1C1C1800ULL, 0x0000000008080000ULL, 0x0000000000000000ULL, 0x0000000002020000ULL,
+  0x0000000707070300ULL, 0x00000F0F0F0F0B07ULL, 0x001F1F1F1F1F1B1FULL, 0x3F3F3F3F3F3F3B3FULL,
+  0x0000001C1C1D1800ULL, 0x00000008080A0000ULL, 0x0000000000040000ULL, 0x00000002020A0000ULL,
+  0x0000000707170300ULL, 0x00000F0F0F2F0B07ULL, 0x001F1F1F1F5F1B1FULL, 0x3F3F3F3F3FBF3B3FULL,
+  0x00001C1C1F1C1800ULL, 0x000008080E080000ULL, 0x000000000E000000ULL, 0x000002020E020000ULL,
+  0x000007071F070300ULL, 0x00000F0F3F0F0B07ULL, 0x001F1F1F7F1F1B1FULL, 0x3F3F3F3FFF3F3B3FULL,
+  0x001C1C1F1F1F1800ULL, 0x0008081F1F1F0000ULL, 0x0000001F1F1F0000ULL, 0x0002021F1F1F0000ULL,
+  0x0007071F1F1F0300ULL, 0x000F0F3F3F3F0B07ULL, 0x001F1F7F7F7F1B1FULL, 0x3F3F3FFFFFFF3B3FULL,
+  0x1C1C3F3F3F3F3B00ULL, 0x08083F3F3F3F3B00ULL, 0x00003F3F3F3F3B00ULL, 0x02023F3F3F3F3B00ULL,
+  0x07073F3F3F3F3B00ULL, 0x0F0F3F3F3F3F3B07ULL, 0x1F1F7F7F7F7F7B1FULL, 0x3F3FFFFFFFFFFB3FULL,
+  0xFFFFFFFFFFFFF4FCULL, 0xFFFFFFFFFFFFF0F8ULL, 0xFFFFFFFFFFFFF1F1ULL, 0xFFFFFFFFFFFFE3E3ULL,
+  0xFFFFFFFFFFFFC7C7ULL, 0xFFFFFFFFFFFF878FULL, 0xFFFFFFFFFFFF171FULL, 0xFFFFFFFFFFFF373FULL,
+  0xFFFFFFFFFFFCF4FCULL, 0xFFFFFFFFFFF8F0F8ULL, 0xFFFFFFFFFFF1F1F1ULL, 0x0000000000000000ULL,
+  0xFFFFFFFFFFC7C7C7ULL, 0xFFFFFFFFFF8F878FULL, 0xFFFFFFFFFF1F171FULL, 0xFFFFFFFFFF3F373FULL,
+  0x00FEFFFFFCFCF4FEULL, 0x00007F7F78787078ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
+  0x0000000000000000ULL, 0x00007F7F0F0F070FULL, 0x003FFFFF1F1F173FULL, 0x7F7FFFFF3F3F377FULL,
+  0x00FEFEFCFCFCF6FEULL, 0x00007C7878787478ULL, 0x0000003030303000ULL, 0x0000000000000000ULL,
+  0x0000000606060600ULL, 0x00001F0F0F0F170FULL, 0x003F3F1F1F1F373FULL, 0x7F7F7F3F3F3F777FULL,
+  0x00FEFCFCFCFEF7FEULL, 0x00007878787D7778ULL, 0x00003030303A3600ULL, 0x0000000000141400ULL,
+  0x00000606062E3600ULL, 0x00000F0F0F5F770FULL, 0x003F1F1F1FBFF73FULL, 0x7F7F3F3F3F7FF77FULL,
+  0x00FCFCFCFFFFF6FEULL, 0x007878787F7F7478ULL, 0x003030303E3E3000ULL, 0x000000223E3E0000ULL,
+  0x000606063E3E0600ULL, 0x000F0F0F7F7F170FULL, 0x001F1F1FFFFF373FULL, 0x7F3F3F3FFFFF777FULL,
+  0xFCFCFCFFFFFFF7FEULL, 0x7878787F7F7F7778ULL, 0x3030717F7F7F7700ULL, 0x0000637F7F7F7700ULL,
+  0x0606477F7F7F7700ULL, 0x0F0F0F7F7F7F770FULL, 0x1F1F1FFFFFFFF73FULL, 0x3F3F3FFFFFFFF77FULL,
+  0xFCFCFFFFFFFFF7FFULL, 0x78F8FFFFFFFFF7FFULL, 0x30F1FFFFFFFFF7FFULL, 0x00E3FFFFFFFFF7FFULL,
+  0x06C7FFFFFFFFF7FFULL, 0x0F8FFFFFFFFFF7FFULL, 0x1F1FFFFFFFFFF7FFULL, 0x3F3FFFFFFFFFF7FFULL,
+  0xFFFFFFFFFFFFF4FCULL, 0xFFFFFFFFFFFFF0F8ULL, 0x00000000001C1010ULL, 0x00000000001C0000ULL,
+  0x00000000001C0404ULL, 0xFFFFFFFFFFFF878FULL, 0xFFFFFFFFFFFF171FULL, 0xFFFFFFFFFFFF373FULL,
+  0x00007F7F7F7C7478ULL, 0x00007F7F7F787078ULL, 0x0000000000101000ULL, 0x0000000000000000ULL,
+  0x0000000000040400ULL, 0x00007F7F7F0F070FULL, 0x00007F7F7F1F170FULL, 0x003FFFFFFF3F373FULL,
+  0x00007C7F7C7C7478ULL, 0x0000003E38383000ULL, 0x0000000000100000ULL, 0x0000000000000000ULL,
+  0x0000000000040000ULL, 0x0000003E0E0E0600ULL, 0x00001F7F1F1F170FULL, 0x003F3FFF3F3F373FULL,
+  0x00007C7C7C7C7478ULL, 0x0000003838383000ULL, 0x0000000010100000ULL, 0x0000000000000000ULL,
+  0x0000000004040000ULL, 0x0000000E0E0E0600ULL, 0x00001F1F1F1F170FULL, 0x003F3F3F3F3F373FULL,
+  0x00007C7C7C7D7478ULL, 0x00000038383A3000ULL, 0x0000001010140000ULL, 0x0000000000080000ULL,
+  0x0000000404140000ULL, 0x0000000E0E2E0600ULL, 0x00001F1F1F5F170FULL, 0x003F3F3F3FBF373FULL,
+  0x00007C7C7F7C7478ULL, 0x000038383E383000ULL, 0x000010101C100000ULL, 0x000000001C000000ULL,
+  0x000004041C040000ULL, 0x00000E0E3E0E0600ULL, 0x00001F1F7F1F170FULL, 0x003F3F3FFF3F373FULL,
+  0x007C7C7F7F7F7478ULL, 0x0038383E3E3E3000ULL, 0x0010103E3E3E0000ULL, 0x0000003E3E3E0000ULL,
+  0x0004043E3E3E0000ULL, 0x000E0E3E3E3E0600ULL, 0x001F1F7F7F7F170FULL, 0x003F3FFFFFFF373FULL,
+  0x7C7C7F7F7F7F7778ULL, 0x38387F7F7F7F7700ULL, 0x10107F7F7F7F7700ULL, 0x00007F7F7F7F7700ULL,
+  0x04047F7F7F7F7700ULL, 0x0E0E7F7F7F7F7700ULL, 0x1F1F7F7F7F7F770FULL, 0x3F3FFFFFFFFFF73FULL
+};
+
+} // namespace Stockfish::Bitbases
+
+} // namespace Stockfish
+
+#endif // #ifndef BITBASE_DATA_H_INCLUDED
@@ -17,21 +17,229 @@
 */
 
 #include <algorithm>
-#include <bitset>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <vector>
 
 #include "bitboard.h"
 #include "misc.h"
 
 namespace Stockfish {
 
-uint8_t PopCnt16[1 << 16];
-uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
+namespace {
+
+  // The tables below, except the attacks of the magic bitboards, are computed
+  // at compile time. They are in the read-only data of the executable, shared
+  // by all the running engines, and cost nothing at startup. The functions
+  // used are constexpr counterparts of those of bitboard.h, that read the
+  // tables.
+
+  constexpr Bitboard make_bb(int f, int r) {
+    return f >= 0 && f < 8 && r >= 0 && r < 8 ? 1ULL << (8 * r + f) : 0;
+  }
+
+  // ray_attack() returns the squares from 's' in the direction (df, dr) up to
+  // and including the first occupied one.
+  constexpr Bitboard ray_attack(Square s, int df, int dr, Bitboard occupied) {
+
+    Bitboard attacks = 0;
+
+    for (int f = file_of(s) + df, r = rank_of(s) + dr; make_bb(f, r); f += df, r += dr)
+    {
+        attacks |= make_bb(f, r);
+
+        if (occupied & make_bb(f, r))
+            break;
+    }
+
+    return attacks;
+  }
+
+  constexpr Bitboard sliding_attack(PieceType pt, Square s, Bitboard occupied) {
+
+    return pt == ROOK ?  ray_attack(s,  0,  1, occupied) | ray_attack(s,  1,  0, occupied)
+                       | ray_attack(s,  0, -1, occupied) | ray_attack(s, -1,  0, occupied)
+                      :  ray_attack(s,  1,  1, occupied) | ray_attack(s, -1,  1, occupied)
+                       | ray_attack(s,  1, -1, occupied) | ray_attack(s, -1, -1, occupied);
+  }
+
+  constexpr Bitboard leaper_attack(Square s, const int (&steps)[8][2]) {
+
+    Bitboard attacks = 0;
+
+    for (const auto& step : steps)
+        attacks |= make_bb(file_of(s) + step[0], rank_of(s) + step[1]);
+
+    return attacks;
+  }
+
+  constexpr int KingSteps[8][2]   = { {-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1} };
+  constexpr int KnightSteps[8][2] = { {-1, -2}, {1, -2}, {-2, -1}, {2, -1}, {-2, 1}, {2, 1}, {-1, 2}, {1, 2} };
+
+  constexpr std::array<uint8_t, 1 << 16> popcnt16_table() {
+
+    std::array<uint8_t, 1 << 16> t{};
+
+    for (unsigned i = 1; i < t.size(); ++i)
+        t[i] = uint8_t(t[i / 2] + (i & 1));
+
+    return t;
+  }
+
+  constexpr std::array<std::array<uint8_t, SQUARE_NB>, SQUARE_NB> distance_table() {
+
+    std::array<std::array<uint8_t, SQUARE_NB>, SQUARE_NB> t{};
+
+    for (int s1 = SQ_A1; s1 <= SQ_H8; ++s1)
+        for (int s2 = SQ_A1; s2 <= SQ_H8; ++s2)
+        {
+            int df = (s1 & 7) - (s2 & 7), dr = (s1 >> 3) - (s2 >> 3);
+            t[s1][s2] = uint8_t(std::max(df < 0 ? -df : df, dr < 0 ? -dr : dr));
+        }
+
+    return t;
+  }
+
+  constexpr std::array<Bitboard, SQUARE_NB> square_table() {
+
+    std::array<Bitboard, SQUARE_NB> t{};
+
+    for (int s = SQ_A1; s <= SQ_H8; ++s)
+        t[s] = 1ULL << s;
+
+    return t;
+  }
+
+  constexpr std::array<std::array<Bitboard, SQUARE_NB>, PIECE_TYPE_NB> pseudo_attacks_table() {
+
+    std::array<std::array<Bitboard, SQUARE_NB>, PIECE_TYPE_NB> t{};
+
+    for (int s = SQ_A1; s <= SQ_H8; ++s)
+    {
+        t[KING][s]   = leaper_attack(Square(s), KingSteps);
+        t[KNIGHT][s] = leaper_attack(Square(s), KnightSteps);
+        t[BISHOP][s] = sliding_attack(BISHOP, Square(s), 0);
+        t[ROOK][s]   = sliding_attack(ROOK, Square(s), 0);
+        t[QUEEN][s]  = t[BISHOP][s] | t[ROOK][s];
+    }
+
+    return t;
+  }
+
+  constexpr std::array<std::array<Bitboard, SQUARE_NB>, COLOR_NB> pawn_attacks_table() {
+
+    std::array<std::array<Bitboard, SQUARE_NB>, COLOR_NB> t{};
+
+    for (int s = SQ_A1; s <= SQ_H8; ++s)
+    {
+        t[WHITE][s] = pawn_attacks_bb<WHITE>(1ULL << s);
+        t[BLACK][s] = pawn_attacks_bb<BLACK>(1ULL << s);
+    }
+
+    return t;
+  }
+
+  // line_table() computes LineBB and, if 'between' is set, BetweenBB: the
+  // squares from s1 to s2, s2 included, or just s2 if they are not aligned.
+  constexpr std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> line_table(bool between) {
+
+    std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> t{};
+
+    for (int s1 = SQ_A1; s1 <= SQ_H8; ++s1)
+        for (int s2 = SQ_A1; s2 <= SQ_H8; ++s2)
+        {
+            int df = (s2 & 7) - (s1 & 7), dr = (s2 >> 3) - (s1 >> 3);
+
+            if (s1 == s2 || (df && dr && df != dr && df != -dr))
+            {
+                t[s1][s2] = between ? 1ULL << s2 : 0;
+                continue;
+            }
+
+            df = (df > 0) - (df < 0), dr = (dr > 0) - (dr < 0);
+
+            t[s1][s2] = between ? ray_attack(Square(s1), df, dr, 1ULL << s2)
+                                :  ray_attack(Square(s1),  df,  dr, 0)
+                                 | ray_attack(Square(s1), -df, -dr, 0) | (1ULL << s1);
+        }
+
+    return t;
+  }
+
+} // namespace
+
+constexpr std::array<uint8_t, 1 << 16> PopCnt16 = popcnt16_table();
+constexpr std::array<std::array<uint8_t, SQUARE_NB>, SQUARE_NB> SquareDistance = distance_table();
+
+constexpr std::array<Bitboard, SQUARE_NB> SquareBB = square_table();
+constexpr std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> LineBB = line_table(false);
+constexpr std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> BetweenBB = line_table(true);
+constexpr std::array<std::array<Bitboard, SQUARE_NB>, PIECE_TYPE_NB> PseudoAttacks = pseudo_attacks_table();
+constexpr std::array<std::array<Bitboard, SQUARE_NB>, COLOR_NB> PawnAttacks = pawn_attacks_table();
+
+#if defined(USE_HQ_SLIDERS)
+
+namespace {
 
-Bitboard SquareBB[SQUARE_NB];
-Bitboard LineBB[SQUARE_NB][SQUARE_NB];
-Bitboard BetweenBB[SQUARE_NB][SQUARE_NB];
-Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
-Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
+  constexpr std::array<HQMasks, SQUARE_NB> hq_lines_table() {
+
+    std::array<HQMasks, SQUARE_NB> t{};
+
+    for (int s = SQ_A1; s <= SQ_H8; ++s)
+    {
+        t[s].file         = ray_attack(Square(s), 0, 1, 0) | ray_attack(Square(s),  0, -1, 0);
+        t[s].diagonal     = ray_attack(Square(s), 1, 1, 0) | ray_attack(Square(s), -1, -1, 0);
+        t[s].antiDiagonal = ray_attack(Square(s), 1, -1, 0) | ray_attack(Square(s), -1, 1, 0);
+    }
+
+    return t;
+  }
+
+  // Attacks of a rook on the first rank, for each occupancy of the 6 inner squares
+  constexpr std::array<std::array<uint8_t, FILE_NB>, 64> first_rank_table() {
+
+    std::array<std::array<uint8_t, FILE_NB>, 64> t{};
+
+    for (int inner = 0; inner < 64; ++inner)
+        for (int f = FILE_A; f <= FILE_H; ++f)
+            t[inner][f] = uint8_t(  ray_attack(Square(f),  1, 0, Bitboard(inner) << 1)
+                                  | ray_attack(Square(f), -1, 0, Bitboard(inner) << 1));
+
+    return t;
+  }
+
+} // namespace
+
+constexpr std::array<HQMasks, SQUARE_NB> HQLines = hq_lines_table();
+constexpr std::array<std::array<uint8_t, FILE_NB>, 64> FirstRankAttacks = first_rank_table();
+
+#elif defined(USE_RAY_SLIDERS)
+
+namespace {
+
+  // The rays from each square in the 4 given directions
+  constexpr std::array<std::array<Bitboard, 4>, SQUARE_NB> rays_table(const int (&directions)[4][2]) {
+
+    std::array<std::array<Bitboard, 4>, SQUARE_NB> t{};
+
+    for (int s = SQ_A1; s <= SQ_H8; ++s)
+        for (int i = 0; i < 4; ++i)
+            t[s][i] = ray_attack(Square(s), directions[i][0], directions[i][1], 0);
+
+    return t;
+  }
+
+  constexpr int RookDirections[4][2]   = { {0, 1}, {1, 0}, {0, -1}, {-1, 0} };  // N, E, S, W
+  constexpr int BishopDirections[4][2] = { {1, 1}, {-1, 1}, {1, -1}, {-1, -1} }; // NE, NW, SE, SW
+
+} // namespace
+
+alignas(32) constexpr std::array<std::array<Bitboard, 4>, SQUARE_NB> RookRays = rays_table(RookDirections);
+alignas(32) constexpr std::array<std::array<Bitboard, 4>, SQUARE_NB> BishopRays = rays_table(BishopDirections);
+
+#else
 
 Magic RookMagics[SQUARE_NB];
 Magic BishopMagics[SQUARE_NB];
@@ -41,17 +249,52 @@ namespace {
   Bitboard RookTable[0x19000];  // To store rook attacks
   Bitboard BishopTable[0x1480]; // To store bishop attacks
 
-  void init_magics(PieceType pt, Bitboard table[], Magic magics[]);
+  // Magics of 64 bit targets, as found by the search of init_magics() with the
+  // seeds of its PRNG. Having them here saves the search at startup. 32 bit
+  // targets, whose index uses another multiplication, still search them.
+  constexpr Bitboard RookMagicNumbers[SQUARE_NB] = {
+    0x0A80004000801220ULL, 0x8040004010002008ULL, 0x2080200010008008ULL, 0x1100100008210004ULL,
+    0xC200209084020008ULL, 0x2100010004000208ULL, 0x0400081000822421ULL, 0x0200010422048844ULL,
+    0x0800800080400024ULL, 0x0001402000401000ULL, 0x3000801000802001ULL, 0x4400800800100083ULL,
+    0x0904802402480080ULL, 0x4040800400020080ULL, 0x0018808042000100ULL, 0x4040800080004100ULL,
+    0x0040048001458024ULL, 0x00A0004000205000ULL, 0x3100808010002000ULL, 0x4825010010000820ULL,
+    0x5004808008000401ULL, 0x2024818004000A00ULL, 0x0005808002000100ULL, 0x2100060004806104ULL,
+    0x0080400880008421ULL, 0x4062220600410280ULL, 0x010A004A00108022ULL, 0x0000100080080080ULL,
+    0x0021000500080010ULL, 0x0044000202001008ULL, 0x0000100400080102ULL, 0xC020128200040545ULL,
+    0x0080002000400040ULL, 0x0000804000802004ULL, 0x0000120022004080ULL, 0x010A386103001001ULL,
+    0x9010080080800400ULL, 0x8440020080800400ULL, 0x0004228824001001ULL, 0x000000490A000084ULL,
+    0x0080002000504000ULL, 0x200020005000C000ULL, 0x0012088020420010ULL, 0x0010010080080800ULL,
+    0x0085001008010004ULL, 0x0002000204008080ULL, 0x0040413002040008ULL, 0x0000304081020004ULL,
+    0x0080204000800080ULL, 0x3008804000290100ULL, 0x1010100080200080ULL, 0x2008100208028080ULL,
+    0x5000850800910100ULL, 0x8402019004680200ULL, 0x0120911028020400ULL, 0x0000008044010200ULL,
+    0x0020850200244012ULL, 0x0020850200244012ULL, 0x0000102001040841ULL, 0x140900040A100021ULL,
+    0x000200282410A102ULL, 0x000200282410A102ULL, 0x000200282410A102ULL, 0x4048240043802106ULL
+  };
+
+  constexpr Bitboard BishopMagicNumbers[SQUARE_NB] = {
+    0x40106000A1160020ULL, 0x0020010250810120ULL, 0x2010010220280081ULL, 0x002806004050C040ULL,
+    0x0002021018000000ULL, 0x2001112010000400ULL, 0x0881010120218080ULL, 0x1030820110010500ULL,
+    0x0000120222042400ULL, 0x2000020404040044ULL, 0x8000480094208000ULL, 0x0003422A02000001ULL,
+    0x000A220210100040ULL, 0x8004820202226000ULL, 0x0018234854100800ULL, 0x0100004042101040ULL,
+    0x0004001004082820ULL, 0x0010000810010048ULL, 0x1014004208081300ULL, 0x2080818802044202ULL,
+    0x0040880C00A00100ULL, 0x0080400200522010ULL, 0x0001000188180B04ULL, 0x0080249202020204ULL,
+    0x1004400004100410ULL, 0x00013100A0022206ULL, 0x2148500001040080ULL, 0x4241080011004300ULL,
+    0x4020848004002000ULL, 0x10101380D1004100ULL, 0x0008004422020284ULL, 0x01010A1041008080ULL,
+    0x0808080400082121ULL, 0x0808080400082121ULL, 0x0091128200100C00ULL, 0x0202200802010104ULL,
+    0x8C0A020200440085ULL, 0x01A0008080B10040ULL, 0x0889520080122800ULL, 0x100902022202010AULL,
+    0x04081A0816002000ULL, 0x0000681208005000ULL, 0x8170840041008802ULL, 0x0A00004200810805ULL,
+    0x0830404408210100ULL, 0x2602208106006102ULL, 0x1048300680802628ULL, 0x2602208106006102ULL,
+    0x0602010120110040ULL, 0x0941010801043000ULL, 0x000040440A210428ULL, 0x0008240020880021ULL,
+    0x0400002012048200ULL, 0x00AC102001210220ULL, 0x0220021002009900ULL, 0x84440C080A013080ULL,
+    0x0001008044200440ULL, 0x0004C04410841000ULL, 0x2000500104011130ULL, 0x1A0C010011C20229ULL,
+    0x0044800112202200ULL, 0x0434804908100424ULL, 0x0300404822C08200ULL, 0x48081010008A2A80ULL
+  };
+
+  void init_magics(PieceType pt, Bitboard table[], Magic magics[], const Bitboard magicNumbers[]);
 
 }
 
-/// safe_destination() returns the bitboard of target square for the given step
-/// from the given square. If the step is off the board, returns empty bitboard.
-
-inline Bitboard safe_destination(Square s, int step) {
-    Square to = Square(s + step);
-    return is_ok(to) && distance(s, to) <= 2 ? square_bb(to) : Bitboard(0);
-}
+#endif
 
 
 /// Bitboards::pretty() returns an ASCII representation of a bitboard suitable
@@ -74,76 +317,28 @@ std::string Bitboards::pretty(Bitboard b) {
 }
 
 
-/// Bitboards::init() initializes various bitboard tables. It is called at
-/// startup and relies on global objects to be already zero-initialized.
+/// Bitboards::init() fills the attack tables of the magic bitboards at startup,
+/// all the other tables being computed at compile time. It relies on global
+/// objects to be already zero-initialized.
 
 void Bitboards::init() {
 
-  for (unsigned i = 0; i < (1 << 16); ++i)
-      PopCnt16[i] = uint8_t(std::bitset<16>(i).count());
-
-  for (Square s = SQ_A1; s <= SQ_H8; ++s)
-      SquareBB[s] = (1ULL << s);
-
-  for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
-      for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
-          SquareDistance[s1][s2] = std::max(distance<File>(s1, s2), distance<Rank>(s1, s2));
-
-  init_magics(ROOK, RookTable, RookMagics);
-  init_magics(BISHOP, BishopTable, BishopMagics);
-
-  for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
-  {
-      PawnAttacks[WHITE][s1] = pawn_attacks_bb<WHITE>(square_bb(s1));
-      PawnAttacks[BLACK][s1] = pawn_attacks_bb<BLACK>(square_bb(s1));
-
-      for (int step : {-9, -8, -7, -1, 1, 7, 8, 9} )
-         PseudoAttacks[KING][s1] |= safe_destination(s1, step);
-
-      for (int step : {-17, -15, -10, -6, 6, 10, 15, 17} )
-         PseudoAttacks[KNIGHT][s1] |= safe_destination(s1, step);
-
-      PseudoAttacks[QUEEN][s1]  = PseudoAttacks[BISHOP][s1] = attacks_bb<BISHOP>(s1, 0);
-      PseudoAttacks[QUEEN][s1] |= PseudoAttacks[  ROOK][s1] = attacks_bb<  ROOK>(s1, 0);
-
-      for (PieceType pt : { BISHOP, ROOK })
-          for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
-          {
-              if (PseudoAttacks[pt][s1] & s2)
-              {
-                  LineBB[s1][s2]    = (attacks_bb(pt, s1, 0) & attacks_bb(pt, s2, 0)) | s1 | s2;
-                  BetweenBB[s1][s2] = (attacks_bb(pt, s1, square_bb(s2)) & attacks_bb(pt, s2, square_bb(s1)));
-              }
-              BetweenBB[s1][s2] |= s2;
-          }
-  }
+#if !defined(USE_HQ_SLIDERS) && !defined(USE_RAY_SLIDERS)
+  init_magics(ROOK, RookTable, RookMagics, RookMagicNumbers);
+  init_magics(BISHOP, BishopTable, BishopMagics, BishopMagicNumbers);
+#endif
 }
 
-namespace {
-
-  Bitboard sliding_attack(PieceType pt, Square sq, Bitboard occupied) {
-
-    Bitboard attacks = 0;
-    Direction   RookDirections[4] = {NORTH, SOUTH, EAST, WEST};
-    Direction BishopDirections[4] = {NORTH_EAST, SOUTH_EAST, SOUTH_WEST, NORTH_WEST};
-
-    for (Direction d : (pt == ROOK ? RookDirections : BishopDirections))
-    {
-        Square s = sq;
-        while (safe_destination(s, d) && !(occupied & s))
-            attacks |= (s += d);
-    }
-
-    return attacks;
-  }
+#if !defined(USE_HQ_SLIDERS) && !defined(USE_RAY_SLIDERS)
 
+namespace {
 
   // init_magics() computes all rook and bishop attacks at startup. Magic
   // bitboards are used to look up attacks of sliding pieces. As a reference see
   // www.chessprogramming.org/Magic_Bitboards. In particular, here we use the so
   // called "fancy" approach.
 
-  void init_magics(PieceType pt, Bitboard table[], Magic magics[]) {
+  void init_magics(PieceType pt, Bitboard table[], Magic magics[], const Bitboard magicNumbers[]) {
 
     // Optimal PRNG seeds to pick the correct magics in the shortest time
     int seeds[][RANK_NB] = { { 8977, 44560, 54343, 38998,  5731, 95205, 104912, 17020 },
@@ -177,16 +372,37 @@ namespace {
             occupancy[size] = b;
             reference[size] = sliding_attack(pt, s, b);
 
-            if (HasPext)
+            if (PextMagics)
                 m.attacks[pext(b, m.mask)] = reference[size];
 
             size++;
             b = (b - m.mask) & m.mask;
         } while (b);
 
-        if (HasPext)
+        if (PextMagics)
             continue;
 
+        if (Is64Bit)
+        {
+            m.magic = magicNumbers[s];
+
+            // As in the search below, two occupancies may share an index only
+            // if they have the same attacks, else the stored magic is wrong.
+            ++cnt;
+
+            for (int i = 0; i < size; ++i)
+            {
+                unsigned idx = m.index(occupancy[i]);
+
+                assert(epoch[idx] < cnt || m.attacks[idx] == reference[i]);
+
+                epoch[idx] = cnt;
+                m.attacks[idx] = reference[i];
+            }
+
+            continue;
+        }
+
         PRNG rng(seeds[Is64Bit][rank_of(s)]);
 
         // Find a magic for square 's' picking up an (almost) random number
@@ -217,6 +433,94 @@ namespace {
         }
     }
   }
+
+} // namespace
+
+#endif
+
+
+/// Bitboards::benchmark() times attacks_bb() of the sliding pieces on random
+/// occupancies, after checking the results of the backend against a plain
+/// ray walk. The throughput is measured with independent lookups, the latency
+/// with lookups whose occupancy depends on the result of the previous one.
+
+std::string Bitboards::benchmark(int iterations) {
+
+  constexpr int N = 4096;
+
+  std::vector<Square> squares(N);
+  std::vector<Bitboard> occupancies(N);
+  PRNG rng(1070372);
+
+  // About 24 occupied squares, as in a middlegame position, one of them
+  // being the square of the slider.
+  for (int i = 0; i < N; ++i)
+  {
+      squares[i] = Square(rng.rand<unsigned>() & 63);
+      occupancies[i] = (rng.rand<Bitboard>() & (rng.rand<Bitboard>() | rng.rand<Bitboard>())) | squares[i];
+  }
+
+  int errors = 0;
+  for (int i = 0; i < N; ++i)
+  {
+      Square s = squares[i];
+      Bitboard b = occupancies[i];
+      errors += (attacks_bb<BISHOP>(s, b) != sliding_attack(BISHOP, s, b ^ s))
+              + (attacks_bb<  ROOK>(s, b) != sliding_attack(  ROOK, s, b ^ s));
+  }
+
+  // A zero unknown to the compiler, so that the loops are really run
+  volatile Bitboard zero = 0;
+  volatile Bitboard sink = 0;
+
+  auto time = [&](auto attacks, bool dependent) {
+
+      auto start = std::chrono::steady_clock::now();
+      Bitboard sum = 0;
+
+      for (int it = 0; it < iterations; ++it)
+      {
+          const Bitboard mask = zero;
+
+          for (int i = 0; i < N; ++i)
+              sum += attacks(squares[i], occupancies[i] ^ (dependent ? sum & mask : mask));
+      }
+
+      sink = sink + sum;
+      std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+      return elapsed.count() / (double(N) * iterations);
+  };
+
+  auto bishop = [](Square s, Bitboard b) { return attacks_bb<BISHOP>(s, b); };
+  auto rook   = [](Square s, Bitboard b) { return attacks_bb<  ROOK>(s, b); };
+  auto queen  = [](Square s, Bitboard b) { return attacks_bb< QUEEN>(s, b); };
+
+  std::stringstream ss;
+
+  ss << "Sliding attacks backend: "
+#if defined(USE_HQ_SLIDERS)
+     << "hyperbola quintessence"
+#elif defined(USE_RAY_SLIDERS) && defined(USE_AVX512_RAYS)
+     << "rays with AVX-512"
+#elif defined(USE_RAY_SLIDERS)
+     << "rays"
+#else
+     << (PextMagics ? "fancy magics with pext" : "fancy magics")
+#endif
+     << "\nVerified " << N << " bishop and rook lookups: "
+     << (errors ? std::to_string(errors) + " errors" : "ok")
+     << "\n\n" << std::left << std::setw(12) << "Lookup" << std::right
+     << std::setw(20) << "throughput (ns)" << std::setw(18) << "latency (ns)"
+     << std::fixed << std::setprecision(2);
+
+  ss << "\n" << std::left << std::setw(12) << "bishop" << std::right
+     << std::setw(20) << time(bishop, false) << std::setw(18) << time(bishop, true);
+  ss << "\n" << std::left << std::setw(12) << "rook" << std::right
+     << std::setw(20) << time(rook, false) << std::setw(18) << time(rook, true);
+  ss << "\n" << std::left << std::setw(12) << "queen" << std::right
+     << std::setw(20) << time(queen, false) << std::setw(18) << time(queen, true);
+
+  return ss.str();
 }
 
 } // namespace Stockfish
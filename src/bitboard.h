@@ -19,10 +19,16 @@
 #ifndef BITBOARD_H_INCLUDED
 #define BITBOARD_H_INCLUDED
 
+#include <array>
 #include <string>
 
 #include "types.h"
 
+#if defined(USE_RAY_SLIDERS) && defined(USE_AVX512) && defined(__AVX512VL__) && defined(__AVX512CD__)
+#  include <immintrin.h>
+#  define USE_AVX512_RAYS
+#endif
+
 namespace Stockfish {
 
 namespace Bitbases {
@@ -36,6 +42,7 @@ namespace Bitboards {
 
 void init();
 std::string pretty(Bitboard b);
+std::string benchmark(int iterations);
 
 } // namespace Stockfish::Bitboards
 
@@ -71,15 +78,55 @@ constexpr Bitboard KingFlank[FILE_NB] = {
   KingSide, KingSide, KingSide ^ FileEBB
 };
 
-extern uint8_t PopCnt16[1 << 16];
-extern uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
+extern const std::array<uint8_t, 1 << 16> PopCnt16;
+extern const std::array<std::array<uint8_t, SQUARE_NB>, SQUARE_NB> SquareDistance;
+
+extern const std::array<Bitboard, SQUARE_NB> SquareBB;
+extern const std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> BetweenBB;
+extern const std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> LineBB;
+extern const std::array<std::array<Bitboard, SQUARE_NB>, PIECE_TYPE_NB> PseudoAttacks;
+extern const std::array<std::array<Bitboard, SQUARE_NB>, COLOR_NB> PawnAttacks;
+
+
+/// The attacks of the sliding pieces are computed by one of these backends,
+/// selected at compile time with the 'sliders' option of the Makefile:
+///
+/// (default)           | Fancy magic bitboards, indexed with pext if USE_PEXT
+/// -DUSE_FANCY_SLIDERS | Fancy magic bitboards, never indexed with pext. For
+///                     | CPUs where pext is slow, like AMD Zen 1 and Zen 2
+/// -DUSE_HQ_SLIDERS    | Hyperbola quintessence for files and diagonals and a
+///                     | 512 bytes table for ranks, instead of 800 KB of magics
+/// -DUSE_RAY_SLIDERS   | Nearest blocker on each ray, vectorized with AVX-512
+///                     | when built for it, instead of 800 KB of magics
+
+#if defined(USE_HQ_SLIDERS)
+
+/// HQMasks holds the lines through a square used by hyperbola quintessence,
+/// each without the square itself
+struct HQMasks {
+  Bitboard file;
+  Bitboard diagonal;
+  Bitboard antiDiagonal;
+};
+
+extern const std::array<HQMasks, SQUARE_NB> HQLines;
+extern const std::array<std::array<uint8_t, FILE_NB>, 64> FirstRankAttacks;
 
-extern Bitboard SquareBB[SQUARE_NB];
-extern Bitboard BetweenBB[SQUARE_NB][SQUARE_NB];
-extern Bitboard LineBB[SQUARE_NB][SQUARE_NB];
-extern Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
-extern Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
+#elif defined(USE_RAY_SLIDERS)
 
+/// The rays of a rook from a square, in the order north, east, south, west,
+/// and of a bishop, north east, north west, south east, south west: the 2 rays
+/// towards higher squares first.
+extern const std::array<std::array<Bitboard, 4>, SQUARE_NB> RookRays;
+extern const std::array<std::array<Bitboard, 4>, SQUARE_NB> BishopRays;
+
+#else
+
+#if defined(USE_FANCY_SLIDERS)
+constexpr bool PextMagics = false;
+#else
+constexpr bool PextMagics = HasPext;
+#endif
 
 /// Magic holds all magic bitboards relevant data for a single square
 struct Magic {
@@ -91,7 +138,7 @@ struct Magic {
   // Compute the attack's index using the 'magic bitboards' approach
   unsigned index(Bitboard occupied) const {
 
-    if (HasPext)
+    if (PextMagics)
         return unsigned(pext(occupied, mask));
 
     if (Is64Bit)
@@ -106,6 +153,11 @@ struct Magic {
 extern Magic RookMagics[SQUARE_NB];
 extern Magic BishopMagics[SQUARE_NB];
 
+#endif
+
+inline Bitboard bishop_attacks_bb(Square s, Bitboard occupied);
+inline Bitboard rook_attacks_bb(Square s, Bitboard occupied);
+
 inline Bitboard square_bb(Square s) {
   assert(is_ok(s));
   return SquareBB[s];
@@ -311,8 +363,8 @@ inline Bitboard attacks_bb(Square s, Bitboard occupied) {
 
   switch (Pt)
   {
-  case BISHOP: return BishopMagics[s].attacks[BishopMagics[s].index(occupied)];
-  case ROOK  : return   RookMagics[s].attacks[  RookMagics[s].index(occupied)];
+  case BISHOP: return bishop_attacks_bb(s, occupied);
+  case ROOK  : return   rook_attacks_bb(s, occupied);
   case QUEEN : return attacks_bb<BISHOP>(s, occupied) | attacks_bb<ROOK>(s, occupied);
   default    : return PseudoAttacks[Pt][s];
   }
@@ -446,6 +498,111 @@ inline Square frontmost_sq(Color c, Bitboard b) {
   return c == WHITE ? msb(b) : lsb(b);
 }
 
+
+/// bishop_attacks_bb() and rook_attacks_bb() return the attacks of a bishop
+/// and of a rook with the backend selected at compile time.
+
+#if defined(USE_HQ_SLIDERS)
+
+inline Bitboard byteswap(Bitboard b) {
+
+#if defined(_MSC_VER) && !defined(__clang__)
+  return _byteswap_uint64(b);
+#else
+  return __builtin_bswap64(b);
+#endif
+}
+
+/// hyperbola_attacks() returns the attacks along a line with at most one square
+/// per rank, which byteswap() reverses. The mask is the line without the square.
+inline Bitboard hyperbola_attacks(Square s, Bitboard occupied, Bitboard mask) {
+
+  Bitboard forward = occupied & mask;
+  Bitboard reverse = byteswap(forward);
+
+  forward -= square_bb(s);
+  reverse -= byteswap(square_bb(s));
+
+  return (forward ^ byteswap(reverse)) & mask;
+}
+
+inline Bitboard bishop_attacks_bb(Square s, Bitboard occupied) {
+
+  return  hyperbola_attacks(s, occupied, HQLines[s].diagonal)
+        | hyperbola_attacks(s, occupied, HQLines[s].antiDiagonal);
+}
+
+inline Bitboard rook_attacks_bb(Square s, Bitboard occupied) {
+
+  // The 6 inner squares of the rank index the attacks on the first rank
+  const int shift = 8 * rank_of(s);
+  const unsigned inner = unsigned(occupied >> (shift + 1)) & 63;
+
+  return  hyperbola_attacks(s, occupied, HQLines[s].file)
+        | Bitboard(FirstRankAttacks[inner][file_of(s)]) << shift;
+}
+
+#elif defined(USE_RAY_SLIDERS)
+
+/// ray_attacks() returns the attacks along 4 rays, the first 2 towards higher
+/// squares. On each ray the attacks stop at the nearest blocker: the lowest
+/// occupied square on the first 2 rays, the highest on the other 2. Or-ing
+/// a1 in before taking the highest square gives all the ray when empty.
+inline Bitboard ray_attacks(const std::array<Bitboard, 4>& rays, Bitboard occupied) {
+
+#if defined(USE_AVX512_RAYS)
+  const __m256i ones = _mm256_set1_epi64x(1);
+  const __m256i r    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rays.data()));
+  const __m256i b    = _mm256_and_si256(r, _mm256_set1_epi64x(int64_t(occupied)));
+
+  // Squares up to the lowest blocker: b ^ (b - 1)
+  const __m256i up   = _mm256_xor_si256(b, _mm256_sub_epi64(b, ones));
+
+  // Squares from the highest blocker: all squares << msb(b | 1)
+  const __m256i lz   = _mm256_lzcnt_epi64(_mm256_or_si256(b, ones));
+  const __m256i down = _mm256_sllv_epi64(_mm256_set1_epi64x(-1),
+                                         _mm256_sub_epi64(_mm256_set1_epi64x(63), lz));
+
+  const __m256i a = _mm256_and_si256(r, _mm256_blend_epi32(up, down, 0xF0));
+  const __m128i x = _mm_or_si128(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+
+  return Bitboard(_mm_cvtsi128_si64(_mm_or_si128(x, _mm_unpackhi_epi64(x, x))));
+#else
+  Bitboard attacks = 0;
+
+  for (int i = 0; i < 2; ++i)
+  {
+      Bitboard b = occupied & rays[i];
+      attacks |= rays[i] & (b ^ (b - 1));
+  }
+
+  for (int i = 2; i < 4; ++i)
+      attacks |= rays[i] & (AllSquares << msb((occupied & rays[i]) | 1));
+
+  return attacks;
+#endif
+}
+
+inline Bitboard bishop_attacks_bb(Square s, Bitboard occupied) {
+  return ray_attacks(BishopRays[s], occupied);
+}
+
+inline Bitboard rook_attacks_bb(Square s, Bitboard occupied) {
+  return ray_attacks(RookRays[s], occupied);
+}
+
+#else
+
+inline Bitboard bishop_attacks_bb(Square s, Bitboard occupied) {
+  return BishopMagics[s].attacks[BishopMagics[s].index(occupied)];
+}
+
+inline Bitboard rook_attacks_bb(Square s, Bitboard occupied) {
+  return RookMagics[s].attacks[RookMagics[s].index(occupied)];
+}
+
+#endif
+
 } // namespace Stockfish
 
 #endif // #ifndef BITBOARD_H_INCLUDED
@@ -60,8 +60,8 @@ namespace Stockfish {
 
 namespace Eval {
 
-  bool useNNUE;
-  string currentEvalFileName = "None";
+  bool useNNUE, useSmallNNUE;
+  string currentEvalFileName = "None", currentSmallEvalFileName = "None";
 
   /// NNUE::init() tries to load a NNUE network at startup time, or when the engine
   /// receives a UCI command "setoption name EvalFile value nn-[a-z0-9]{12}.nnue"
@@ -70,6 +70,8 @@ namespace Eval {
   /// network may be embedded in the binary), in the active working directory and
   /// in the engine directory. Distro packagers may define the DEFAULT_NNUE_DIRECTORY
   /// variable to have the engine search in a special directory in their distro.
+  /// The optional small net, given by the EvalFileSmall option, is searched in
+  /// the same way, except that it is never embedded.
 
   void NNUE::init() {
 
@@ -95,7 +97,8 @@ namespace Eval {
             if (directory != "<internal>")
             {
                 ifstream stream(directory + eval_file, ios::binary);
-                if (load_eval(eval_file, stream))
+                if (   load_mapped_eval(eval_file, directory + eval_file)
+                    || load_eval(eval_file, stream))
                     currentEvalFileName = eval_file;
             }
 
@@ -115,11 +118,34 @@ namespace Eval {
                     currentEvalFileName = eval_file;
             }
         }
+
+    string small_file = string(Options["EvalFileSmall"]);
+    if (small_file == "<empty>")
+        small_file.clear();
+
+    for (string directory : dirs)
+        if (   !small_file.empty()
+            && directory != "<internal>"
+            && currentSmallEvalFileName != small_file)
+        {
+            // A failed attempt leaves the previous small net unusable
+            ifstream stream(directory + small_file, ios::binary);
+            currentSmallEvalFileName =
+                   load_mapped_eval(small_file, directory + small_file, Small)
+                || load_eval(small_file, stream, Small) ? small_file : "None";
+        }
+
+    useSmallNNUE = !small_file.empty() && currentSmallEvalFileName == small_file;
+
+    // The accumulators are only valid for the net they were computed with
+    Threads.run_on_all(clear_thread);
   }
 
   /// NNUE::verify() verifies that the last net used was loaded successfully
   void NNUE::verify() {
 
+    assert(Startup::finished()); // The UCI command must have called ready()
+
     string eval_file = string(Options["EvalFile"]);
     if (eval_file.empty())
         eval_file = EvalFileDefaultName;
@@ -130,7 +156,11 @@ namespace Eval {
         string msg1 = "If the UCI option \"Use NNUE\" is set to true, network evaluation parameters compatible with the engine must be available.";
         string msg2 = "The option is set to true, but the network file " + eval_file + " was not loaded successfully.";
         string msg3 = "The UCI option EvalFile might need to specify the full path, including the directory name, to the network file.";
+#if defined(NNUE_SMALL)
+        string msg4 = "This binary is built with nnue=small, EvalFile must be a network of the small architecture.";
+#else
         string msg4 = "The default net can be downloaded from: https://tests.stockfishchess.org/api/nn/" + std::string(EvalFileDefaultName);
+#endif
         string msg5 = "The engine will be terminated now.";
 
         sync_cout << "info string ERROR: " << msg1 << sync_endl;
@@ -144,7 +174,17 @@ namespace Eval {
 
     if (useNNUE)
         sync_cout << "info string NNUE evaluation using " << eval_file << " enabled" << sync_endl;
-    else
+
+    string small_file = string(Options["EvalFileSmall"]);
+
+    if (useNNUE && useSmallNNUE)
+        sync_cout << "info string NNUE evaluation using " << small_file << " as small net enabled" << sync_endl;
+
+    else if (useNNUE && small_file != "<empty>" && !small_file.empty())
+        sync_cout << "info string ERROR: The small network file " << small_file
+                  << " was not loaded successfully, only the main network is used." << sync_endl;
+
+    if (!useNNUE)
         sync_cout << "info string classical evaluation enabled" << sync_endl;
   }
 }
@@ -197,6 +237,10 @@ namespace {
   constexpr Value LazyThreshold2    =  Value(2084);
   constexpr Value SpaceThreshold    =  Value(11551);
 
+  // Threshold for using the small net, and for falling back to the main net
+  constexpr Value SmallNetThreshold =  Value(1050);
+  constexpr Value SmallNetFallback  =  Value(500);
+
   // KingAttackWeights[PieceType] contains king attack weights by piece type
   constexpr int KingAttackWeights[PIECE_TYPE_NB] = { 0, 0, 76, 46, 45, 14 };
 
@@ -305,7 +349,7 @@ namespace {
     Value winnable(Score score) const;
 
     const Position& pos;
-    Material::Entry* me;
+    const Material::Entry* me;
     Pawns::Entry* pe;
     Bitboard mobilityArea[COLOR_NB];
     Score mobility[COLOR_NB] = { SCORE_ZERO, SCORE_ZERO };
@@ -1098,11 +1142,20 @@ Value Eval::evaluate(const Position& pos) {
   // If result of a classical evaluation is much lower than threshold fall back to NNUE
   if (useNNUE && !useClassical)
   {
-       Value nnue     = NNUE::evaluate(pos, true);     // NNUE
-       int scale      = 1036 + 22 * pos.non_pawn_material() / 1024;
        Color stm      = pos.side_to_move();
-       Value optimism = pos.this_thread()->optimism[stm];
        Value psq      = (stm == WHITE ? 1 : -1) * eg_value(pos.psq_score());
+
+       // Deciding between the small and the main net: for high PSQ imbalance we
+       // use the small net, but we fall back to the main net when the small net
+       // does not confirm that the position is clearly decided.
+       bool smallNet  = useSmallNNUE && abs(psq) > SmallNetThreshold;
+       Value nnue     = smallNet ? NNUE::evaluate(pos, true, NNUE::Small) : VALUE_ZERO;
+
+       if (!smallNet || (nnue > 0) != (psq > 0) || abs(nnue) < SmallNetFallback)
+           nnue       = NNUE::evaluate(pos, true);     // NNUE
+
+       int scale      = 1036 + 22 * pos.non_pawn_material() / 1024;
+       Value optimism = pos.this_thread()->optimism[stm];
        int complexity = 35 * abs(nnue - psq) / 256;
 
        optimism = optimism * (44 + complexity) / 31;
@@ -1183,6 +1236,12 @@ std::string Eval::trace(Position& pos) {
       v = pos.side_to_move() == WHITE ? v : -v;
       ss << "NNUE evaluation        " << to_cp(v) << " (white side)\n";
   }
+  if (Eval::useNNUE && Eval::useSmallNNUE)
+  {
+      v = NNUE::evaluate(pos, false, NNUE::Small);
+      v = pos.side_to_move() == WHITE ? v : -v;
+      ss << "Small NNUE evaluation  " << to_cp(v) << " (white side)\n";
+  }
 
   v = evaluate(pos);
   v = pos.side_to_move() == WHITE ? v : -v;
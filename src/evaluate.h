@@ -27,29 +27,45 @@
 namespace Stockfish {
 
 class Position;
+class Thread;
 
 namespace Eval {
 
   std::string trace(Position& pos);
   Value evaluate(const Position& pos);
 
-  extern bool useNNUE;
-  extern std::string currentEvalFileName;
+  extern bool useNNUE, useSmallNNUE;
+  extern std::string currentEvalFileName, currentSmallEvalFileName;
 
   // The default net name MUST follow the format nn-[SHA256 first 12 digits].nnue
   // for the build process (profile-build and fishtest) to work. Do not change the
-  // name of the macro, as it is used in the Makefile.
+  // name of the macro, as it is used in the Makefile. Builds with nnue=small embed
+  // instead the net of the small architecture given by smallnet= to the Makefile.
+  #if defined(NNUE_SMALL)
+  #define EvalFileDefaultName   NNUE_SMALL_NET
+  #else
   #define EvalFileDefaultName   "nn-d0b74ce1e5eb.nnue"
+  #endif
 
   namespace NNUE {
 
+    // The main net of the build, given by EvalFile, and the optional small
+    // net, given by EvalFileSmall
+    enum NetSize { Big, Small };
+
     std::string trace(Position& pos);
-    Value evaluate(const Position& pos, bool adjusted = false);
+    Value evaluate(const Position& pos, bool adjusted = false, NetSize netSize = Big);
+    void evaluate(const Position* const* positions, std::size_t count, Value* values,
+                  Thread& th, bool adjusted = false);
+    std::string benchmark(Position* const* positions, std::size_t count, Thread& th, int iterations);
 
     void init();
     void verify();
+    void clear_thread(Thread& th);
 
-    bool load_eval(std::string name, std::istream& stream);
+    bool load_eval(std::string name, std::istream& stream, NetSize netSize = Big);
+    bool load_mapped_eval(std::string name, const std::string& path, NetSize netSize = Big);
+    bool save_mapped_eval(const std::string& filename);
     bool save_eval(std::ostream& stream);
     bool save_eval(const std::optional<std::string>& filename);
 
@@ -35,19 +35,20 @@ int main(int argc, char* argv[]) {
   std::cout << engine_info() << std::endl;
 
   CommandLine::init(argc, argv);
-  UCI::init(Options);
-  Tune::init();
-  PSQT::init();
-  Bitboards::init();
-  Position::init();
-  Bitbases::init();
-  Endgames::init();
-  Threads.set(size_t(Options["Threads"]));
-  Search::clear(); // After threads are up
-  Eval::NNUE::init();
+  Startup::run("UCI::init", [] { UCI::init(Options); });
+  Startup::run("Tune::init", Tune::init);
+  Startup::run("PSQT::init", PSQT::init);
+  Startup::run("Bitboards::init", Bitboards::init);
+  Startup::run("Position::init", Position::init);
+  Startup::run("Bitbases::init", Bitbases::init);
+  Startup::defer("Endgames::init", Endgames::init);
+  Startup::run("Threads.set", [] { Threads.set(size_t(Options["Threads"])); });
+  Startup::defer("Tablebases::init", [] { Tablebases::init(Options["SyzygyPath"]); });
+  Startup::defer("Eval::NNUE::init", Eval::NNUE::init);
 
   UCI::loop(argc, argv);
 
+  TT.wait_for_allocation(); // The engine may quit before the hash is ready
   Threads.set(0);
   return 0;
 }
@@ -16,7 +16,9 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
 #include <cassert>
+#include <cstddef>   // For offsetof
 #include <cstring>   // For std::memset
 
 #include "material.h"
@@ -66,24 +68,56 @@ namespace {
   Endgame<KPsK>   ScaleKPsK[]   = { Endgame<KPsK>(WHITE),   Endgame<KPsK>(BLACK) };
   Endgame<KPKP>   ScaleKPKP[]   = { Endgame<KPKP>(WHITE),   Endgame<KPKP>(BLACK) };
 
+  // The material of a configuration, as numbers of pieces of each color and
+  // type. The bishop pair is counted with PIECE_TYPE_NONE, see init_entry().
+  typedef int PieceCounts[COLOR_NB][PIECE_TYPE_NB];
+
+  Value non_pawn_material(const PieceCounts& count, Color c) {
+    return  count[c][KNIGHT] * KnightValueMg + count[c][BISHOP] * BishopValueMg
+          + count[c][ROOK]   * RookValueMg   + count[c][QUEEN]  * QueenValueMg;
+  }
+
   // Helper used to detect a given material distribution
-  bool is_KXK(const Position& pos, Color us) {
-    return  !more_than_one(pos.pieces(~us))
-          && pos.non_pawn_material(us) >= RookValueMg;
+  bool is_KXK(const PieceCounts& count, Color us) {
+    return  !(count[~us][PAWN] + count[~us][KNIGHT] + count[~us][BISHOP] + count[~us][ROOK] + count[~us][QUEEN])
+          && non_pawn_material(count, us) >= RookValueMg;
   }
 
-  bool is_KBPsK(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) == BishopValueMg
-          && pos.count<PAWN>(us) >= 1;
+  bool is_KBPsK(const PieceCounts& count, Color us) {
+    return   non_pawn_material(count, us) == BishopValueMg
+          && count[us][PAWN] >= 1;
   }
 
-  bool is_KQKRPs(const Position& pos, Color us) {
-    return  !pos.count<PAWN>(us)
-          && pos.non_pawn_material(us) == QueenValueMg
-          && pos.count<ROOK>(~us) == 1
-          && pos.count<PAWN>(~us) >= 1;
+  bool is_KQKRPs(const PieceCounts& count, Color us) {
+    return  !count[us][PAWN]
+          && non_pawn_material(count, us) == QueenValueMg
+          && count[~us][ROOK] == 1
+          && count[~us][PAWN] >= 1;
   }
 
+  // The material configurations with at most 8 pawns, 2 knights, 2 bishops,
+  // 2 rooks and 1 queen per side, that is all of them but a few ones after
+  // a promotion, have their entry in a table shared by all the threads and
+  // indexed by the signatures of both sides, filled at their first probe.
+  constexpr int MaxCount[PIECE_TYPE_NB] = { 0, 8, 2, 2, 2, 1 };
+  constexpr int SignatureNb = 9 * 3 * 3 * 3 * 2;
+
+  Material::Entry SignatureTable[SignatureNb * SignatureNb];
+
+  static_assert(offsetof(Material::Entry, key) == 0, "probe() writes the key last");
+
+  // The signature of the material of one side, or -1 if it is not covered
+  int signature(const PieceCounts& count, Color c) {
+
+    int sig = 0;
+    for (PieceType pt = PAWN; pt <= QUEEN; ++pt)
+    {
+        if (count[c][pt] > MaxCount[pt])
+            return -1;
+        sig = sig * (MaxCount[pt] + 1) + count[c][pt];
+    }
+    return sig;
+  }
 
   /// imbalance() calculates the imbalance by comparing the piece count of each
   /// piece type for both colors.
@@ -113,114 +147,156 @@ namespace {
     return bonus;
   }
 
-} // namespace
+  /// init_entry() computes the Entry of a material configuration, given by its
+  /// material key and its piece counts.
 
-namespace Material {
+  void init_entry(Material::Entry* e, Key key, PieceCounts& count) {
 
+    std::memset(e, 0, sizeof(Material::Entry));
+    e->key = key;
+    e->factor[WHITE] = e->factor[BLACK] = (uint8_t)SCALE_FACTOR_NORMAL;
 
-/// Material::probe() looks up the current position's material configuration in
-/// the material hash table. It returns a pointer to the Entry if the position
-/// is found. Otherwise a new Entry is computed and stored there, so we don't
-/// have to recompute all when the same material configuration occurs again.
+    Value npm_w = non_pawn_material(count, WHITE);
+    Value npm_b = non_pawn_material(count, BLACK);
+    Value npm   = std::clamp(npm_w + npm_b, EndgameLimit, MidgameLimit);
 
-Entry* probe(const Position& pos) {
+    // Map total non-pawn material into [PHASE_ENDGAME, PHASE_MIDGAME]
+    e->gamePhase = Phase(((npm - EndgameLimit) * PHASE_MIDGAME) / (MidgameLimit - EndgameLimit));
 
-  Key key = pos.material_key();
-  Entry* e = pos.this_thread()->materialTable[key];
+    // Let's look if we have a specialized evaluation function for this particular
+    // material configuration. Firstly we look for a fixed configuration one, then
+    // for a generic one if the previous search failed.
+    if ((e->evaluationFunction = Endgames::probe<Value>(key)) != nullptr)
+        return;
 
-  if (e->key == key)
-      return e;
+    for (Color c : { WHITE, BLACK })
+        if (is_KXK(count, c))
+        {
+            e->evaluationFunction = &EvaluateKXK[c];
+            return;
+        }
 
-  std::memset(e, 0, sizeof(Entry));
-  e->key = key;
-  e->factor[WHITE] = e->factor[BLACK] = (uint8_t)SCALE_FACTOR_NORMAL;
+    // OK, we didn't find any special evaluation function for the current material
+    // configuration. Is there a suitable specialized scaling function?
+    const auto* sf = Endgames::probe<ScaleFactor>(key);
 
-  Value npm_w = pos.non_pawn_material(WHITE);
-  Value npm_b = pos.non_pawn_material(BLACK);
-  Value npm   = std::clamp(npm_w + npm_b, EndgameLimit, MidgameLimit);
+    if (sf)
+    {
+        e->scalingFunction[sf->strongSide] = sf; // Only strong color assigned
+        return;
+    }
 
-  // Map total non-pawn material into [PHASE_ENDGAME, PHASE_MIDGAME]
-  e->gamePhase = Phase(((npm - EndgameLimit) * PHASE_MIDGAME) / (MidgameLimit - EndgameLimit));
+    // We didn't find any specialized scaling function, so fall back on generic
+    // ones that refer to more than one material distribution. Note that in this
+    // case we don't return after setting the function.
+    for (Color c : { WHITE, BLACK })
+    {
+        if (is_KBPsK(count, c))
+            e->scalingFunction[c] = &ScaleKBPsK[c];
 
-  // Let's look if we have a specialized evaluation function for this particular
-  // material configuration. Firstly we look for a fixed configuration one, then
-  // for a generic one if the previous search failed.
-  if ((e->evaluationFunction = Endgames::probe<Value>(key)) != nullptr)
-      return e;
+        else if (is_KQKRPs(count, c))
+            e->scalingFunction[c] = &ScaleKQKRPs[c];
+    }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KXK(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKXK[c];
-          return e;
-      }
+    if (npm_w + npm_b == VALUE_ZERO && (count[WHITE][PAWN] || count[BLACK][PAWN])) // Only pawns on the board
+    {
+        if (!count[BLACK][PAWN])
+        {
+            assert(count[WHITE][PAWN] >= 2);
+
+            e->scalingFunction[WHITE] = &ScaleKPsK[WHITE];
+        }
+        else if (!count[WHITE][PAWN])
+        {
+            assert(count[BLACK][PAWN] >= 2);
+
+            e->scalingFunction[BLACK] = &ScaleKPsK[BLACK];
+        }
+        else if (count[WHITE][PAWN] == 1 && count[BLACK][PAWN] == 1)
+        {
+            // This is a special case because we set scaling functions
+            // for both colors instead of only one.
+            e->scalingFunction[WHITE] = &ScaleKPKP[WHITE];
+            e->scalingFunction[BLACK] = &ScaleKPKP[BLACK];
+        }
+    }
 
-  // OK, we didn't find any special evaluation function for the current material
-  // configuration. Is there a suitable specialized scaling function?
-  const auto* sf = Endgames::probe<ScaleFactor>(key);
+    // Zero or just one pawn makes it difficult to win, even with a small material
+    // advantage. This catches some trivial draws like KK, KBK and KNK and gives a
+    // drawish scale factor for cases such as KRKBP and KmmKm (except for KBBKN).
+    if (!count[WHITE][PAWN] && npm_w - npm_b <= BishopValueMg)
+        e->factor[WHITE] = uint8_t(npm_w <  RookValueMg   ? SCALE_FACTOR_DRAW :
+                                   npm_b <= BishopValueMg ? 4 : 14);
 
-  if (sf)
-  {
-      e->scalingFunction[sf->strongSide] = sf; // Only strong color assigned
-      return e;
+    if (!count[BLACK][PAWN] && npm_b - npm_w <= BishopValueMg)
+        e->factor[BLACK] = uint8_t(npm_b <  RookValueMg   ? SCALE_FACTOR_DRAW :
+                                   npm_w <= BishopValueMg ? 4 : 14);
+
+    // Evaluate the material imbalance. We use PIECE_TYPE_NONE as a place holder
+    // for the bishop pair "extended piece", which allows us to be more flexible
+    // in defining bishop pair bonuses.
+    for (Color c : { WHITE, BLACK })
+        count[c][NO_PIECE_TYPE] = count[c][BISHOP] > 1;
+
+    e->score = (imbalance<WHITE>(count) - imbalance<BLACK>(count)) / 16;
   }
 
-  // We didn't find any specialized scaling function, so fall back on generic
-  // ones that refer to more than one material distribution. Note that in this
-  // case we don't return after setting the function.
+
+} // namespace
+
+namespace Material {
+
+
+/// Material::probe() returns the Entry of the current position's material
+/// configuration. Most configurations are found in the shared table, where
+/// their entry is computed at their first probe. The other ones are looked up
+/// in the material hash table of the thread, and if missing a new Entry is
+/// computed and stored there, so we don't have to recompute all when the same
+/// configuration occurs again.
+
+const Entry* probe(const Position& pos) {
+
+  PieceCounts count;
+
   for (Color c : { WHITE, BLACK })
   {
-    if (is_KBPsK(pos, c))
-        e->scalingFunction[c] = &ScaleKBPsK[c];
-
-    else if (is_KQKRPs(pos, c))
-        e->scalingFunction[c] = &ScaleKQKRPs[c];
+      count[c][PAWN]   = pos.count<PAWN>(c);
+      count[c][KNIGHT] = pos.count<KNIGHT>(c);
+      count[c][BISHOP] = pos.count<BISHOP>(c);
+      count[c][ROOK]   = pos.count<ROOK>(c);
+      count[c][QUEEN]  = pos.count<QUEEN>(c);
   }
 
-  if (npm_w + npm_b == VALUE_ZERO && pos.pieces(PAWN)) // Only pawns on the board
-  {
-      if (!pos.count<PAWN>(BLACK))
-      {
-          assert(pos.count<PAWN>(WHITE) >= 2);
+  int w = signature(count, WHITE), b = signature(count, BLACK);
+  Key key = pos.material_key();
 
-          e->scalingFunction[WHITE] = &ScaleKPsK[WHITE];
-      }
-      else if (!pos.count<PAWN>(WHITE))
-      {
-          assert(pos.count<PAWN>(BLACK) >= 2);
+  if (w >= 0 && b >= 0)
+  {
+      Entry* e = &SignatureTable[w * SignatureNb + b];
 
-          e->scalingFunction[BLACK] = &ScaleKPsK[BLACK];
-      }
-      else if (pos.count<PAWN>(WHITE) == 1 && pos.count<PAWN>(BLACK) == 1)
+      // Threads may fill the same entry concurrently, but they all write the
+      // same content and the key only after the rest, so an entry with the
+      // right key is complete.
+      if (e->key != key)
       {
-          // This is a special case because we set scaling functions
-          // for both colors instead of only one.
-          e->scalingFunction[WHITE] = &ScaleKPKP[WHITE];
-          e->scalingFunction[BLACK] = &ScaleKPKP[BLACK];
+          Entry tmp;
+          init_entry(&tmp, key, count);
+          std::memcpy(reinterpret_cast<char*>(e) + sizeof(Key),
+                      reinterpret_cast<char*>(&tmp) + sizeof(Key), sizeof(Entry) - sizeof(Key));
+          std::atomic_thread_fence(std::memory_order_release);
+          e->key = key;
       }
+      else
+          std::atomic_thread_fence(std::memory_order_acquire);
+
+      return e;
   }
 
-  // Zero or just one pawn makes it difficult to win, even with a small material
-  // advantage. This catches some trivial draws like KK, KBK and KNK and gives a
-  // drawish scale factor for cases such as KRKBP and KmmKm (except for KBBKN).
-  if (!pos.count<PAWN>(WHITE) && npm_w - npm_b <= BishopValueMg)
-      e->factor[WHITE] = uint8_t(npm_w <  RookValueMg   ? SCALE_FACTOR_DRAW :
-                                 npm_b <= BishopValueMg ? 4 : 14);
-
-  if (!pos.count<PAWN>(BLACK) && npm_b - npm_w <= BishopValueMg)
-      e->factor[BLACK] = uint8_t(npm_b <  RookValueMg   ? SCALE_FACTOR_DRAW :
-                                 npm_w <= BishopValueMg ? 4 : 14);
-
-  // Evaluate the material imbalance. We use PIECE_TYPE_NONE as a place holder
-  // for the bishop pair "extended piece", which allows us to be more flexible
-  // in defining bishop pair bonuses.
-  const int pieceCount[COLOR_NB][PIECE_TYPE_NB] = {
-  { pos.count<BISHOP>(WHITE) > 1, pos.count<PAWN>(WHITE), pos.count<KNIGHT>(WHITE),
-    pos.count<BISHOP>(WHITE)    , pos.count<ROOK>(WHITE), pos.count<QUEEN >(WHITE) },
-  { pos.count<BISHOP>(BLACK) > 1, pos.count<PAWN>(BLACK), pos.count<KNIGHT>(BLACK),
-    pos.count<BISHOP>(BLACK)    , pos.count<ROOK>(BLACK), pos.count<QUEEN >(BLACK) } };
-
-  e->score = (imbalance<WHITE>(pieceCount) - imbalance<BLACK>(pieceCount)) / 16;
+  Entry* e = pos.this_thread()->materialTable[key];
+
+  if (e->key != key)
+      init_entry(e, key, count);
+
   return e;
 }
 
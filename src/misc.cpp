@@ -41,16 +41,24 @@ typedef WORD(*fun5_t)();
 }
 #endif
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <tuple>
 #include <vector>
 #include <cstdlib>
 
 #if defined(__linux__) && !defined(__ANDROID__)
+#include <cerrno>
+#include <cstring>
+#include <sched.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) || (defined(__GLIBCXX__) && !defined(_GLIBCXX_HAVE_ALIGNED_ALLOC) && !defined(_WIN32)) || defined(__e2k__)
@@ -612,6 +620,280 @@ void bindThisThread(size_t idx) {
 
 } // namespace WinProcGroup
 
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+namespace {
+
+  /// read_cpu_id() reads the cpu id at p, skipping the spaces around it, and
+  /// moves p past it. Returns -1 if there is no id or if it is not below
+  /// CPU_SETSIZE, the most cpus that an affinity mask can hold.
+
+  long read_cpu_id(const char*& p) {
+
+    while (*p == ' ')
+        ++p;
+
+    if (!isdigit(*p))
+        return -1;
+
+    char* end;
+    long id = strtol(p, &end, 10); // LONG_MAX on overflow
+
+    for (p = end; *p == ' '; ++p) {}
+
+    return id < CPU_SETSIZE ? id : -1;
+  }
+
+  /// parse_cpu_list() converts a sysfs list in the format "0-3,8,10-11" to
+  /// the vector of the listed ids. An empty vector is returned if the list
+  /// is malformed.
+
+  vector<int> parse_cpu_list(const string& list) {
+
+    vector<int> ids;
+    stringstream ss(list);
+    string range;
+
+    while (getline(ss, range, ','))
+    {
+        const char* p = range.c_str();
+        long first = read_cpu_id(p), last = first;
+
+        if (*p == '-')
+            last = read_cpu_id(++p);
+
+        if (first < 0 || last < first || *p)
+            return {};
+
+        for (long id = first; id <= last; ++id)
+            ids.push_back(int(id));
+    }
+
+    return ids;
+  }
+
+  string read_sysfs(const string& path) {
+
+    ifstream file(path);
+    string line;
+    getline(file, line);
+    return line;
+  }
+
+} // namespace
+
+#endif
+
+
+namespace Numa {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+namespace {
+
+  /// node_cpus() returns the cpus of each online node. The topology is read
+  /// only once, at the first call. If sysfs is not available we assume a
+  /// single node and an empty cpu list, so that binding is skipped.
+
+  const vector<vector<int>>& node_cpus() {
+
+    static const vector<vector<int>> cpus = [] {
+
+        vector<vector<int>> v;
+        for (int node : parse_cpu_list(read_sysfs("/sys/devices/system/node/online")))
+            v.push_back(parse_cpu_list(read_sysfs("/sys/devices/system/node/node"
+                                                  + std::to_string(node) + "/cpulist")));
+        return v;
+    }();
+
+    return cpus;
+  }
+
+  /// best_node() returns the node for the thread with index idx. As on Windows,
+  /// we run as many threads as possible on the same node until its cpus are
+  /// exhausted, then move on filling the next node. Returns -1 if there are
+  /// more threads than cpus, leaving the choice to the OS.
+
+  int best_node(size_t idx) {
+
+    const auto& cpus = node_cpus();
+
+    for (size_t n = 0; n < cpus.size(); ++n)
+    {
+        if (idx < cpus[n].size())
+            return int(n);
+
+        idx -= cpus[n].size();
+    }
+
+    return -1;
+  }
+
+} // namespace
+
+
+size_t nodes() {
+  return std::max(node_cpus().size(), size_t(1));
+}
+
+
+/// bind_to_node() sets the affinity of the current thread to the cpus of the
+/// given node. Nothing is done on single node systems.
+
+void bind_to_node(size_t node) {
+
+  const auto& cpus = node_cpus();
+
+  if (cpus.size() < 2 || node >= cpus.size() || cpus[node].empty())
+      return;
+
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+
+  for (int cpu : cpus[node])
+      if (cpu < CPU_SETSIZE)
+          CPU_SET(cpu, &mask);
+
+  sched_setaffinity(0, sizeof(cpu_set_t), &mask);
+}
+
+
+/// bindThisThread() binds the current thread to the best node for index idx
+
+void bindThisThread(size_t idx) {
+
+  int node = best_node(idx);
+
+  if (node != -1)
+      bind_to_node(size_t(node));
+}
+
+
+/// interleave() sets an interleaved memory policy over all the online nodes
+/// for the given memory area, so that its pages will be spread round-robin
+/// across the nodes at first touch. The area must be page aligned. If the
+/// kernel refuses the policy, the first failure is reported with an info string.
+
+void interleave(void* mem, size_t size) {
+
+  constexpr int MPOL_INTERLEAVE_POLICY = 3; // As in <linux/mempolicy.h>
+  constexpr size_t BitsPerWord = 8 * sizeof(unsigned long);
+
+  const auto& cpus = node_cpus();
+
+  if (!mem || cpus.size() < 2)
+      return;
+
+  // The nodemask must have a bit for each node id, not just for online nodes
+  vector<int> ids = parse_cpu_list(read_sysfs("/sys/devices/system/node/online"));
+  size_t maxNode = size_t(*std::max_element(ids.begin(), ids.end())) + 1;
+  vector<unsigned long> nodemask(maxNode / BitsPerWord + 1, 0);
+
+  for (int id : ids)
+      nodemask[id / BitsPerWord] |= 1UL << (id % BitsPerWord);
+
+  if (syscall(SYS_mbind, mem, size, MPOL_INTERLEAVE_POLICY, nodemask.data(),
+              nodemask.size() * BitsPerWord, 0) == -1)
+  {
+      const int err = errno;
+      static std::once_flag reported;
+
+      std::call_once(reported, [err] {
+          sync_cout << "info string NUMA interleaving failed: " << std::strerror(err)
+                    << ", the hash is placed by the OS" << sync_endl;
+      });
+  }
+}
+
+#else
+
+size_t nodes() { return 1; }
+void bind_to_node(size_t) {}
+void bindThisThread(size_t) {}
+void interleave(void*, size_t) {}
+
+#endif
+
+} // namespace Numa
+
+
+namespace Affinity {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+/// cpu_order() returns the list of cpus the search threads are bound to, in
+/// thread index order. The list is empty if no binding is requested, if the
+/// topology can not be read or if the given cpu list is malformed.
+
+vector<int> cpu_order(Mode mode, const string& cpuList) {
+
+  if (mode == NONE)
+      return {};
+
+  if (mode == LIST)
+  {
+      vector<int> ids = parse_cpu_list(cpuList);
+
+      if (ids.empty() && !cpuList.empty())
+          sync_cout << "info string Invalid CPU List '" << cpuList
+                    << "', the threads are not bound" << sync_endl;
+      return ids;
+  }
+
+  struct Cpu { int id, package, smt; };
+  vector<Cpu> cpus;
+
+  for (int id : parse_cpu_list(read_sysfs("/sys/devices/system/cpu/online")))
+  {
+      const string topology = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+      const string package = read_sysfs(topology + "physical_package_id");
+      const vector<int> siblings = parse_cpu_list(read_sysfs(topology + "thread_siblings_list"));
+
+      if (package.empty() || siblings.empty())
+          return {};
+
+      // The rank of the cpu among its SMT siblings, zero for the first one
+      int smt = int(std::find(siblings.begin(), siblings.end(), id) - siblings.begin());
+
+      cpus.push_back({ id, stoi(package), smt });
+  }
+
+  std::stable_sort(cpus.begin(), cpus.end(), [mode](const Cpu& a, const Cpu& b) {
+      return mode == CORES ? std::tie(a.smt, a.package) < std::tie(b.smt, b.package)
+                           : std::tie(a.package, a.smt) < std::tie(b.package, b.smt);
+  });
+
+  vector<int> order;
+  for (const Cpu& c : cpus)
+      order.push_back(c.id);
+
+  return order;
+}
+
+
+/// bind_to_cpu() sets the affinity of the current thread to a single cpu
+
+void bind_to_cpu(int cpu) {
+
+  if (cpu < 0 || cpu >= CPU_SETSIZE)
+      return;
+
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CPU_SET(cpu, &mask);
+  sched_setaffinity(0, sizeof(cpu_set_t), &mask);
+}
+
+#else
+
+vector<int> cpu_order(Mode, const string&) { return {}; }
+void bind_to_cpu(int) {}
+
+#endif
+
+} // namespace Affinity
+
 #ifdef _WIN32
 #include <direct.h>
 #define GETCWD _getcwd
@@ -669,4 +951,147 @@ void init(int argc, char* argv[]) {
 
 } // namespace CommandLine
 
+
+namespace Startup {
+
+namespace {
+
+  struct Phase {
+    string name;
+    int64_t begin, end; // Microseconds since the process started, -1 if not run yet
+    void (*init)();     // Only set for the deferred phases
+    bool background;    // Run concurrently with the other phases
+  };
+
+  const auto processStart = std::chrono::steady_clock::now();
+
+  // Phases are only appended, but record() may be called by a background thread
+  std::vector<Phase> phases;
+  std::mutex phasesMutex;
+  bool done = false; // Set by finish(), only used by the UCI thread
+}
+
+
+/// Startup::elapsed() returns the microseconds since the process started
+
+int64_t elapsed() {
+
+  return std::chrono::duration_cast<std::chrono::microseconds>
+        (std::chrono::steady_clock::now() - processStart).count();
+}
+
+
+/// Startup::record() adds a phase that has already run, between begin and end
+
+void record(const string& phase, int64_t begin, int64_t end, bool background) {
+
+  std::lock_guard<std::mutex> lock(phasesMutex);
+  phases.push_back({phase, begin, end, nullptr, background});
+}
+
+
+/// Startup::run() runs and times a phase
+
+void run(const string& phase, void (*init)()) {
+
+  int64_t begin = elapsed();
+  init();
+  record(phase, begin, elapsed());
+}
+
+
+/// Startup::defer() registers a phase that finish() will run. Without
+/// USE_LAZY_INIT the phase is run at once.
+
+void defer(const string& phase, void (*init)()) {
+
+  if (!Lazy)
+  {
+      run(phase, init);
+      return;
+  }
+
+  std::lock_guard<std::mutex> lock(phasesMutex);
+  phases.push_back({phase, -1, -1, init, false});
+}
+
+
+/// Startup::finish() runs the deferred phases not run yet, in the order they
+/// were registered. It must be called from the UCI thread.
+
+void finish() {
+
+  for (size_t idx = 0; ; ++idx)
+  {
+      void (*init)() = nullptr;
+
+      {
+          std::lock_guard<std::mutex> lock(phasesMutex);
+          if (idx >= phases.size())
+              break;
+
+          if (phases[idx].begin < 0)
+              init = phases[idx].init;
+      }
+
+      if (!init)
+          continue;
+
+      int64_t begin = elapsed();
+      init();
+      int64_t end = elapsed();
+
+      std::lock_guard<std::mutex> lock(phasesMutex);
+      phases[idx].begin = begin;
+      phases[idx].end = end;
+  }
+
+  done = true;
+}
+
+
+/// Startup::finished() returns true once finish() has run, and always without
+/// USE_LAZY_INIT. Work started later is not part of the startup and is not
+/// recorded, and the options that set up a deferred phase leave it to finish().
+
+bool finished() {
+
+  return !Lazy || done;
+}
+
+
+/// Startup::report() returns the start time and the duration of each phase,
+/// and the total time of the phases not run in the background
+
+string report() {
+
+  std::lock_guard<std::mutex> lock(phasesMutex);
+  std::stringstream ss;
+  int64_t total = 0;
+
+  ss << std::left << std::setw(28) << "Phase" << std::right
+     << std::setw(14) << "start (us)" << std::setw(14) << "time (us)" << "\n";
+
+  for (const Phase& p : phases)
+  {
+      ss << std::left << std::setw(28) << p.name << std::right;
+
+      if (p.begin < 0)
+          ss << std::setw(14) << "deferred" << "\n";
+      else
+          ss << std::setw(14) << p.begin << std::setw(14) << p.end - p.begin << "\n";
+  }
+
+  for (const Phase& p : phases)
+      if (p.begin >= 0 && !p.background)
+          total += p.end - p.begin;
+
+  ss << std::left << std::setw(28) << "Total (foreground)" << std::right
+     << std::setw(28) << total;
+
+  return ss.str();
+}
+
+} // namespace Startup
+
 } // namespace Stockfish
@@ -226,6 +226,31 @@ namespace WinProcGroup {
   void bindThisThread(size_t idx);
 }
 
+/// Under Linux the NUMA topology is read from sysfs, so that no external library
+/// is needed. Threads can be bound to the cpus of a node and the memory of the
+/// transposition table can be interleaved or partitioned across the nodes. On
+/// other systems, or with a single node, all these functions are no-ops.
+
+namespace Numa {
+  enum Policy { NONE, INTERLEAVE, PARTITION };
+  size_t nodes();
+  void bindThisThread(size_t idx);
+  void bind_to_node(size_t node);
+  void interleave(void* mem, size_t size);
+}
+
+/// Under Linux each search thread can also be pinned to a single cpu. The cpu
+/// order is derived from the topology in /sys/devices/system/cpu: physical
+/// cores of all sockets first and then their SMT siblings (CORES), all the
+/// cpus of one socket before the next one (SOCKET), or an explicit cpu list
+/// in the sysfs format, e.g. "0-7,16-23" (LIST).
+
+namespace Affinity {
+  enum Mode { NONE, CORES, SOCKET, LIST };
+  std::vector<int> cpu_order(Mode mode, const std::string& cpuList);
+  void bind_to_cpu(int cpu);
+}
+
 namespace CommandLine {
   void init(int argc, char* argv[]);
 
@@ -233,6 +258,28 @@ namespace CommandLine {
   extern std::string workingDirectory; // path of the working directory
 }
 
+/// Startup times the initialization phases run from main(), in microseconds
+/// since the process started, for the report of the 'startup' command. With
+/// USE_LAZY_INIT the phases only needed to search or evaluate are deferred, and
+/// finish() runs them when the first command that needs them arrives.
+
+namespace Startup {
+
+#if defined(USE_LAZY_INIT)
+  constexpr bool Lazy = true;
+#else
+  constexpr bool Lazy = false;
+#endif
+
+  int64_t elapsed();
+  void record(const std::string& phase, int64_t begin, int64_t end, bool background = false);
+  void run(const std::string& phase, void (*init)());
+  void defer(const std::string& phase, void (*init)());
+  void finish();
+  bool finished();
+  std::string report();
+}
+
 } // namespace Stockfish
 
 #endif // #ifndef MISC_H_INCLUDED
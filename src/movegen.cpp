@@ -42,7 +42,33 @@ namespace {
   }
 
 
-  template<Color Us, GenType Type>
+  // attacked_squares() returns the squares attacked by the pieces of color Them.
+  // Sliders see through the king of the other side, so that this king can't
+  // step back along the line of a slider giving check.
+  template<Color Them>
+  Bitboard attacked_squares(const Position& pos) {
+
+    const Bitboard occupied = pos.pieces() ^ pos.square<KING>(~Them);
+    Bitboard attacked =  pawn_attacks_bb<Them>(pos.pieces(Them, PAWN))
+                       | attacks_bb<KING>(pos.square<KING>(Them));
+
+    Bitboard b = pos.pieces(Them, KNIGHT);
+    while (b)
+        attacked |= attacks_bb<KNIGHT>(pop_lsb(b));
+
+    b = pos.pieces(Them, BISHOP, QUEEN);
+    while (b)
+        attacked |= attacks_bb<BISHOP>(pop_lsb(b), occupied);
+
+    b = pos.pieces(Them, ROOK, QUEEN);
+    while (b)
+        attacked |= attacks_bb<ROOK>(pop_lsb(b), occupied);
+
+    return attacked;
+  }
+
+
+  template<Color Us, GenType Type, bool Legal>
   ExtMove* generate_pawn_moves(const Position& pos, ExtMove* moveList, Bitboard target) {
 
     constexpr Color     Them     = ~Us;
@@ -59,10 +85,33 @@ namespace {
     Bitboard pawnsOn7    = pos.pieces(Us, PAWN) &  TRank7BB;
     Bitboard pawnsNotOn7 = pos.pieces(Us, PAWN) & ~TRank7BB;
 
+    // A pinned pawn may only move along the line of the pin: compute the pawns
+    // allowed to push and to capture in each direction.
+    Bitboard pushers = pos.pieces(Us, PAWN), rightCapturers = pushers, leftCapturers = pushers;
+
+    if (Legal)
+    {
+        const Square ksq = pos.square<KING>(Us);
+        Bitboard pinned = pos.blockers_for_king(Us) & pos.pieces(Us, PAWN);
+
+        while (pinned)
+        {
+            Square s = pop_lsb(pinned);
+            Bitboard line = line_bb(ksq, s);
+
+            if (!(shift<Up     >(square_bb(s)) & line))
+                pushers ^= s;
+            if (!(shift<UpRight>(square_bb(s)) & line))
+                rightCapturers ^= s;
+            if (!(shift<UpLeft >(square_bb(s)) & line))
+                leftCapturers ^= s;
+        }
+    }
+
     // Single and double pawn pushes, no promotions
     if (Type != CAPTURES)
     {
-        Bitboard b1 = shift<Up>(pawnsNotOn7)   & emptySquares;
+        Bitboard b1 = shift<Up>(pawnsNotOn7 & pushers) & emptySquares;
         Bitboard b2 = shift<Up>(b1 & TRank3BB) & emptySquares;
 
         if (Type == EVASIONS) // Consider only blocking squares
@@ -98,9 +147,9 @@ namespace {
     // Promotions and underpromotions
     if (pawnsOn7)
     {
-        Bitboard b1 = shift<UpRight>(pawnsOn7) & enemies;
-        Bitboard b2 = shift<UpLeft >(pawnsOn7) & enemies;
-        Bitboard b3 = shift<Up     >(pawnsOn7) & emptySquares;
+        Bitboard b1 = shift<UpRight>(pawnsOn7 & rightCapturers) & enemies;
+        Bitboard b2 = shift<UpLeft >(pawnsOn7 & leftCapturers ) & enemies;
+        Bitboard b3 = shift<Up     >(pawnsOn7 & pushers       ) & emptySquares;
 
         if (Type == EVASIONS)
             b3 &= target;
@@ -118,8 +167,8 @@ namespace {
     // Standard and en passant captures
     if (Type == CAPTURES || Type == EVASIONS || Type == NON_EVASIONS)
     {
-        Bitboard b1 = shift<UpRight>(pawnsNotOn7) & enemies;
-        Bitboard b2 = shift<UpLeft >(pawnsNotOn7) & enemies;
+        Bitboard b1 = shift<UpRight>(pawnsNotOn7 & rightCapturers) & enemies;
+        Bitboard b2 = shift<UpLeft >(pawnsNotOn7 & leftCapturers ) & enemies;
 
         while (b1)
         {
@@ -145,8 +194,14 @@ namespace {
 
             assert(b1);
 
+            // En passant captures may uncover a check along the rank of the
+            // two pawns, they are rare enough to be tested the slow way.
             while (b1)
-                *moveList++ = make<EN_PASSANT>(pop_lsb(b1), pos.ep_square());
+            {
+                Move m = make<EN_PASSANT>(pop_lsb(b1), pos.ep_square());
+                if (!Legal || pos.legal(m))
+                    *moveList++ = m;
+            }
         }
     }
 
@@ -154,13 +209,17 @@ namespace {
   }
 
 
-  template<Color Us, PieceType Pt, bool Checks>
+  template<Color Us, PieceType Pt, bool Checks, bool Legal>
   ExtMove* generate_moves(const Position& pos, ExtMove* moveList, Bitboard target) {
 
     static_assert(Pt != KING && Pt != PAWN, "Unsupported piece type in generate_moves()");
 
     Bitboard bb = pos.pieces(Us, Pt);
 
+    // A pinned knight can never move
+    if (Legal && Pt == KNIGHT)
+        bb &= ~pos.blockers_for_king(Us);
+
     while (bb)
     {
         Square from = pop_lsb(bb);
@@ -170,6 +229,10 @@ namespace {
         if (Checks && (Pt == QUEEN || !(pos.blockers_for_king(~Us) & from)))
             b &= pos.check_squares(Pt);
 
+        // A pinned slider may only move along the line of the pin
+        if (Legal && (pos.blockers_for_king(Us) & from))
+            b &= line_bb(pos.square<KING>(Us), from);
+
         while (b)
             *moveList++ = make_move(from, pop_lsb(b));
     }
@@ -178,7 +241,7 @@ namespace {
   }
 
 
-  template<Color Us, GenType Type>
+  template<Color Us, GenType Type, bool Legal>
   ExtMove* generate_all(const Position& pos, ExtMove* moveList) {
 
     static_assert(Type != LEGAL, "Unsupported type in generate_all()");
@@ -195,11 +258,11 @@ namespace {
                : Type == CAPTURES     ?  pos.pieces(~Us)
                                       : ~pos.pieces(   ); // QUIETS || QUIET_CHECKS
 
-        moveList = generate_pawn_moves<Us, Type>(pos, moveList, target);
-        moveList = generate_moves<Us, KNIGHT, Checks>(pos, moveList, target);
-        moveList = generate_moves<Us, BISHOP, Checks>(pos, moveList, target);
-        moveList = generate_moves<Us,   ROOK, Checks>(pos, moveList, target);
-        moveList = generate_moves<Us,  QUEEN, Checks>(pos, moveList, target);
+        moveList = generate_pawn_moves<Us, Type, Legal>(pos, moveList, target);
+        moveList = generate_moves<Us, KNIGHT, Checks, Legal>(pos, moveList, target);
+        moveList = generate_moves<Us, BISHOP, Checks, Legal>(pos, moveList, target);
+        moveList = generate_moves<Us,   ROOK, Checks, Legal>(pos, moveList, target);
+        moveList = generate_moves<Us,  QUEEN, Checks, Legal>(pos, moveList, target);
     }
 
     if (!Checks || pos.blockers_for_king(~Us) & ksq)
@@ -208,13 +271,28 @@ namespace {
         if (Checks)
             b &= ~attacks_bb<QUEEN>(pos.square<KING>(~Us));
 
+        const bool castling = (Type == QUIETS || Type == NON_EVASIONS) && pos.can_castle(Us & ANY_CASTLING);
+
+        // The king may not step on, nor castle through, an attacked square
+        const Bitboard attacked = Legal && (b || castling) ? attacked_squares<~Us>(pos) : 0;
+        b &= ~attacked;
+
         while (b)
             *moveList++ = make_move(ksq, pop_lsb(b));
 
-        if ((Type == QUIETS || Type == NON_EVASIONS) && pos.can_castle(Us & ANY_CASTLING))
+        if (castling)
             for (CastlingRights cr : { Us & KING_SIDE, Us & QUEEN_SIDE } )
                 if (!pos.castling_impeded(cr) && pos.can_castle(cr))
-                    *moveList++ = make<CASTLING>(ksq, pos.castling_rook_square(cr));
+                {
+                    Square rsq = pos.castling_rook_square(cr);
+                    Square kto = relative_square(Us, cr & KING_SIDE ? SQ_G1 : SQ_C1);
+
+                    // In Chess960 the castling rook may also block a check
+                    if (   !Legal
+                        || (   !(between_bb(ksq, kto) & attacked)
+                            && !(pos.is_chess960() && (pos.blockers_for_king(Us) & rsq))))
+                        *moveList++ = make<CASTLING>(ksq, rsq);
+                }
     }
 
     return moveList;
@@ -239,8 +317,8 @@ ExtMove* generate(const Position& pos, ExtMove* moveList) {
 
   Color us = pos.side_to_move();
 
-  return us == WHITE ? generate_all<WHITE, Type>(pos, moveList)
-                     : generate_all<BLACK, Type>(pos, moveList);
+  return us == WHITE ? generate_all<WHITE, Type, false>(pos, moveList)
+                     : generate_all<BLACK, Type, false>(pos, moveList);
 }
 
 // Explicit template instantiations
@@ -251,26 +329,40 @@ template ExtMove* generate<QUIET_CHECKS>(const Position&, ExtMove*);
 template ExtMove* generate<NON_EVASIONS>(const Position&, ExtMove*);
 
 
+/// generate_legal() generates the same moves as generate() but only the legal
+/// ones, without a legality test for each move: pinned pieces are restricted
+/// to the line of their pin, using the blockers of the king computed by
+/// do_move(), and the king moves are masked with the squares attacked by the
+/// opponent, computed once if the king has somewhere to go. The moves keep
+/// the order in which generate() would return them.
+
+template<GenType Type>
+ExtMove* generate_legal(const Position& pos, ExtMove* moveList) {
+
+  static_assert(Type != LEGAL, "Unsupported type in generate_legal()");
+  assert((Type == EVASIONS) == (bool)pos.checkers());
+
+  Color us = pos.side_to_move();
+
+  return us == WHITE ? generate_all<WHITE, Type, true>(pos, moveList)
+                     : generate_all<BLACK, Type, true>(pos, moveList);
+}
+
+// Explicit template instantiations
+template ExtMove* generate_legal<CAPTURES>(const Position&, ExtMove*);
+template ExtMove* generate_legal<QUIETS>(const Position&, ExtMove*);
+template ExtMove* generate_legal<EVASIONS>(const Position&, ExtMove*);
+template ExtMove* generate_legal<QUIET_CHECKS>(const Position&, ExtMove*);
+template ExtMove* generate_legal<NON_EVASIONS>(const Position&, ExtMove*);
+
+
 /// generate<LEGAL> generates all the legal moves in the given position
 
 template<>
 ExtMove* generate<LEGAL>(const Position& pos, ExtMove* moveList) {
 
-  Color us = pos.side_to_move();
-  Bitboard pinned = pos.blockers_for_king(us) & pos.pieces(us);
-  Square ksq = pos.square<KING>(us);
-  ExtMove* cur = moveList;
-
-  moveList = pos.checkers() ? generate<EVASIONS    >(pos, moveList)
-                            : generate<NON_EVASIONS>(pos, moveList);
-  while (cur != moveList)
-      if (  ((pinned && pinned & from_sq(*cur)) || from_sq(*cur) == ksq || type_of(*cur) == EN_PASSANT)
-          && !pos.legal(*cur))
-          *cur = (--moveList)->move;
-      else
-          ++cur;
-
-  return moveList;
+  return pos.checkers() ? generate_legal<EVASIONS    >(pos, moveList)
+                        : generate_legal<NON_EVASIONS>(pos, moveList);
 }
 
 } // namespace Stockfish
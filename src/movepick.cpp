@@ -47,6 +47,15 @@ namespace {
         }
   }
 
+  // generate_moves() generates the moves of a stage, only the legal ones
+  // with LegalMoveGen.
+  template<GenType Type>
+  ExtMove* generate_moves(const Position& pos, ExtMove* moveList) {
+
+    return LegalMoveGen ? generate_legal<Type>(pos, moveList)
+                        : generate<Type>(pos, moveList);
+  }
+
 } // namespace
 
 
@@ -68,7 +77,7 @@ MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHist
   assert(d > 0);
 
   stage = (pos.checkers() ? EVASION_TT : MAIN_TT) +
-          !(ttm && pos.pseudo_legal(ttm));
+          !(ttm && pos.pseudo_legal(ttm) && (!LegalMoveGen || pos.legal(ttm)));
 }
 
 /// MovePicker constructor for quiescence search
@@ -83,7 +92,8 @@ MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHist
   stage = (pos.checkers() ? EVASION_TT : QSEARCH_TT) +
           !(   ttm
             && (pos.checkers() || depth > DEPTH_QS_RECAPTURES || to_sq(ttm) == recaptureSquare)
-            && pos.pseudo_legal(ttm));
+            && pos.pseudo_legal(ttm)
+            && (!LegalMoveGen || pos.legal(ttm)));
 }
 
 /// MovePicker constructor for ProbCut: we generate captures with SEE greater
@@ -95,6 +105,7 @@ MovePicker::MovePicker(const Position& p, Move ttm, Value th, Depth d, const Cap
 
   stage = PROBCUT_TT + !(ttm && pos.capture(ttm)
                              && pos.pseudo_legal(ttm)
+                             && (!LegalMoveGen || pos.legal(ttm))
                              && pos.see_ge(ttm, threshold));
 }
 
@@ -180,8 +191,9 @@ Move MovePicker::select(Pred filter) {
 }
 
 /// MovePicker::next_move() is the most important method of the MovePicker class. It
-/// returns a new pseudo-legal move every time it is called until there are no more
-/// moves left, picking the move with the highest score from a list of generated moves.
+/// returns a new pseudo-legal move (legal with LegalMoveGen) every time it is called
+/// until there are no more moves left, picking the move with the highest score from
+/// a list of generated moves.
 Move MovePicker::next_move(bool skipQuiets) {
 
 top:
@@ -198,7 +210,7 @@ top:
   case PROBCUT_INIT:
   case QCAPTURE_INIT:
       cur = endBadCaptures = moves;
-      endMoves = generate<CAPTURES>(pos, cur);
+      endMoves = generate_moves<CAPTURES>(pos, cur);
 
       score<CAPTURES>();
       partial_insertion_sort(cur, endMoves, -3000 * depth);
@@ -227,7 +239,8 @@ top:
   case REFUTATION:
       if (select<Next>([&](){ return    *cur != MOVE_NONE
                                     && !pos.capture(*cur)
-                                    &&  pos.pseudo_legal(*cur); }))
+                                    &&  pos.pseudo_legal(*cur)
+                                    && (!LegalMoveGen || pos.legal(*cur)); }))
           return *(cur - 1);
       ++stage;
       [[fallthrough]];
@@ -236,7 +249,7 @@ top:
       if (!skipQuiets)
       {
           cur = endBadCaptures;
-          endMoves = generate<QUIETS>(pos, cur);
+          endMoves = generate_moves<QUIETS>(pos, cur);
 
           score<QUIETS>();
           partial_insertion_sort(cur, endMoves, -3000 * depth);
@@ -264,7 +277,7 @@ top:
 
   case EVASION_INIT:
       cur = moves;
-      endMoves = generate<EVASIONS>(pos, cur);
+      endMoves = generate_moves<EVASIONS>(pos, cur);
 
       score<EVASIONS>();
       ++stage;
@@ -290,7 +303,7 @@ top:
 
   case QCHECK_INIT:
       cur = moves;
-      endMoves = generate<QUIET_CHECKS>(pos, cur);
+      endMoves = generate_moves<QUIET_CHECKS>(pos, cur);
 
       ++stage;
       [[fallthrough]];
@@ -104,12 +104,23 @@ typedef Stats<int16_t, 29952, PIECE_NB, SQUARE_NB> PieceToHistory;
 typedef Stats<PieceToHistory, NOT_USED, PIECE_NB, SQUARE_NB> ContinuationHistory;
 
 
+/// LegalMoveGen is set by the legalgen=yes build option (-DUSE_LEGAL_MOVEGEN).
+/// The MovePicker then generates only legal moves and also tests the legality
+/// of the TT move and of the refutations, so that the search can skip the
+/// legality test of every move it gets.
+#if defined(USE_LEGAL_MOVEGEN)
+constexpr bool LegalMoveGen = true;
+#else
+constexpr bool LegalMoveGen = false;
+#endif
+
+
 /// MovePicker class is used to pick one pseudo-legal move at a time from the
 /// current position. The most important method is next_move(), which returns a
 /// new pseudo-legal move each time it is called, until there are no moves left,
 /// when MOVE_NONE is returned. In order to improve the efficiency of the
 /// alpha-beta algorithm, MovePicker attempts to return the moves which are most
-/// likely to get a cut-off first.
+/// likely to get a cut-off first. With LegalMoveGen all the moves are legal.
 class MovePicker {
 
   enum PickType { Next, Best };
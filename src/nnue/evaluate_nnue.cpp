@@ -18,15 +18,37 @@
 
 // Code for calculating NNUE evaluation function
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <set>
 #include <sstream>
 #include <iomanip>
 #include <fstream>
+#include <type_traits>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h> // __rdtsc()
+#define HAS_CYCLE_COUNTER
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h> // __rdtsc()
+#define HAS_CYCLE_COUNTER
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "../evaluate.h"
 #include "../position.h"
 #include "../misc.h"
+#include "../movegen.h"
+#include "../thread.h"
 #include "../uci.h"
 #include "../types.h"
 
@@ -34,15 +56,43 @@
 
 namespace Stockfish::Eval::NNUE {
 
-  // Input feature converter
-  LargePagePtr<FeatureTransformer> featureTransformer;
+  // A mapped net stores the parameters as they are laid out in memory, after
+  // the permutations done at load time, so it can be used in place by any
+  // build with the same layout. The header is padded to a page, and so is the
+  // feature transformer, so that all the parameters are suitably aligned.
+  struct MappedNetHeader {
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t hashValue;
+    char          layout[16];
+    std::uint64_t transformerSize;
+    std::uint64_t networkSize;
+    std::uint64_t descriptionSize;
+  };
 
-  // Evaluation function
-  AlignedPtr<Network> network[LayerStacks];
+  constexpr char          MappedNetMagic[8] = "SFNNMAP";
+  constexpr std::uint32_t MappedNetVersion  = 2;
+  constexpr std::size_t   MappedNetPageSize = 4096;
+
+  // Build settings that change the in-memory layout of the parameters
+  constexpr char MappedNetLayout[16] =
+#if defined(USE_AVX512)
+      "avx512"
+#elif defined(USE_AVX2)
+      "avx2"
+#elif defined(USE_SSSE3)
+      "ssse3"
+#elif defined(USE_NEON)
+      "neon"
+#else
+      "generic"
+#endif
+#if defined(USE_SPARSE_INPUT)
+      "-sparse"
+#endif
+      ;
 
-  // Evaluation function file name
-  std::string fileName;
-  std::string netDescription;
+  static_assert(sizeof(MappedNetHeader) <= MappedNetPageSize, "Mapped net header too big");
 
   namespace Detail {
 
@@ -82,14 +132,6 @@ namespace Stockfish::Eval::NNUE {
 
   }  // namespace Detail
 
-  // Initialize the evaluation function parameters
-  void initialize() {
-
-    Detail::initialize(featureTransformer);
-    for (std::size_t i = 0; i < LayerStacks; ++i)
-      Detail::initialize(network[i]);
-  }
-
   // Read network header
   bool read_header(std::istream& stream, std::uint32_t* hashValue, std::string* desc)
   {
@@ -114,52 +156,265 @@ namespace Stockfish::Eval::NNUE {
     return !stream.fail();
   }
 
-  // Read network parameters
-  bool read_parameters(std::istream& stream) {
+  // A loaded net of a given architecture: the input feature converter and the
+  // evaluation function of each layer stack
+  template <typename Arch>
+  struct EvalNet {
 
-    std::uint32_t hashValue;
-    if (!read_header(stream, &hashValue, &netDescription)) return false;
-    if (hashValue != HashValue) return false;
-    if (!Detail::read_parameters(stream, *featureTransformer)) return false;
-    for (std::size_t i = 0; i < LayerStacks; ++i)
-      if (!Detail::read_parameters(stream, *(network[i]))) return false;
-    return stream && stream.peek() == std::ios::traits_type::eof();
-  }
+    using FeatureTransformer = Transformer<Arch>;
 
-  // Write network parameters
-  bool write_parameters(std::ostream& stream) {
+    static constexpr std::size_t MappedTransformerSize =
+        (sizeof(FeatureTransformer) + MappedNetPageSize - 1) / MappedNetPageSize * MappedNetPageSize;
 
-    if (!write_header(stream, HashValue, netDescription)) return false;
-    if (!Detail::write_parameters(stream, *featureTransformer)) return false;
-    for (std::size_t i = 0; i < LayerStacks; ++i)
-      if (!Detail::write_parameters(stream, *(network[i]))) return false;
-    return (bool)stream;
-  }
+    static_assert(   std::is_trivially_copyable_v<FeatureTransformer>
+                  && std::is_trivially_copyable_v<Arch>, "Parameters must be stored verbatim");
 
-  // Evaluation function. Perform differential calculation.
-  Value evaluate(const Position& pos, bool adjusted) {
+    // Release the mapped net, if any
+    void unmap() {
 
-    // We manually align the arrays on the stack because with gcc < 9.3
-    // overaligning stack variables with alignas() doesn't work correctly.
+#ifndef _WIN32
+      if (mappedMem)
+          munmap(mappedMem, mappedSize);
+#endif
+      mappedMem = nullptr;
+      mappedSize = 0;
+    }
 
-    constexpr uint64_t alignment = CacheLineSize;
-    int delta = 10 - pos.non_pawn_material() / 1515;
+    // Initialize the evaluation function parameters
+    void initialize() {
+
+      unmap();
+
+      Detail::initialize(ownedTransformer);
+      featureTransformer = ownedTransformer.get();
+
+      for (std::size_t i = 0; i < LayerStacks; ++i)
+      {
+        Detail::initialize(ownedNetwork[i]);
+        network[i] = ownedNetwork[i].get();
+      }
+    }
+
+    // Read network parameters
+    bool read_parameters(std::istream& stream) {
+
+      std::uint32_t hashValue;
+      if (!read_header(stream, &hashValue, &netDescription)) return false;
+      if (hashValue != HashValue<Arch>) return false;
+      if (!Detail::read_parameters(stream, *featureTransformer)) return false;
+      for (std::size_t i = 0; i < LayerStacks; ++i)
+        if (!Detail::read_parameters(stream, *(network[i]))) return false;
+      return stream && stream.peek() == std::ios::traits_type::eof();
+    }
+
+    // Write network parameters
+    bool write_parameters(std::ostream& stream) const {
+
+      if (!write_header(stream, HashValue<Arch>, netDescription)) return false;
+      if (!Detail::write_parameters(stream, *featureTransformer)) return false;
+      for (std::size_t i = 0; i < LayerStacks; ++i)
+        if (!Detail::write_parameters(stream, *(network[i]))) return false;
+      return (bool)stream;
+    }
+
+    // Load eval, from a file stream or a memory stream
+    bool load(std::string name, std::istream& stream) {
+
+      initialize();
+      fileName = name;
+      return read_parameters(stream);
+    }
+
+    // Load eval from a mapped net, see load_mapped_eval()
+    bool load_mapped(std::string name, const std::string& path) {
+
+      MappedNetHeader header;
+      std::ifstream file(path, std::ios::binary | std::ios::ate);
+      const std::streamoff fileSize = file.tellg();
+
+      file.seekg(0);
+      file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+      const std::size_t networkOffset = MappedNetPageSize + MappedTransformerSize;
+      const std::size_t descriptionOffset = networkOffset + LayerStacks * sizeof(Arch);
+
+      if (   !file
+          || std::memcmp(header.magic, MappedNetMagic, sizeof(header.magic))
+          || header.version != MappedNetVersion
+          || header.hashValue != HashValue<Arch>
+          || std::memcmp(header.layout, MappedNetLayout, sizeof(header.layout))
+          || header.transformerSize != sizeof(FeatureTransformer)
+          || header.networkSize != sizeof(Arch)
+          || fileSize != std::streamoff(descriptionOffset + header.descriptionSize))
+          return false;
+
+      std::string desc(header.descriptionSize, '\0');
+      file.seekg(descriptionOffset);
+      file.read(&desc[0], desc.size());
+
+      if (!file)
+          return false;
+
+#ifndef _WIN32
+      file.close();
+
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd == -1)
+          return false;
+
+      void* mem = mmap(nullptr, std::size_t(fileSize), PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+
+      if (mem == MAP_FAILED)
+          return false;
+
+      unmap();
+      ownedTransformer.reset();
+      for (std::size_t i = 0; i < LayerStacks; ++i)
+          ownedNetwork[i].reset();
+
+      mappedMem  = mem;
+      mappedSize = std::size_t(fileSize);
+
+      char* base = static_cast<char*>(mem);
+      featureTransformer = reinterpret_cast<FeatureTransformer*>(base + MappedNetPageSize);
+      for (std::size_t i = 0; i < LayerStacks; ++i)
+          network[i] = reinterpret_cast<Arch*>(base + networkOffset + i * sizeof(Arch));
+#else
+      // Read into new buffers, so that a failed read leaves the current net
+      LargePagePtr<FeatureTransformer> transformer;
+      AlignedPtr<Arch> nets[LayerStacks];
+
+      Detail::initialize(transformer);
+      for (std::size_t i = 0; i < LayerStacks; ++i)
+          Detail::initialize(nets[i]);
+
+      file.seekg(MappedNetPageSize);
+      file.read(reinterpret_cast<char*>(transformer.get()), sizeof(FeatureTransformer));
+      file.seekg(networkOffset);
+      for (std::size_t i = 0; i < LayerStacks; ++i)
+          file.read(reinterpret_cast<char*>(nets[i].get()), sizeof(Arch));
+
+      if (!file)
+          return false;
+
+      unmap();
+      ownedTransformer = std::move(transformer);
+      featureTransformer = ownedTransformer.get();
+      for (std::size_t i = 0; i < LayerStacks; ++i)
+      {
+          ownedNetwork[i] = std::move(nets[i]);
+          network[i] = ownedNetwork[i].get();
+      }
+#endif
+
+      fileName = name;
+      netDescription = desc;
+      return true;
+    }
+
+    // Save eval, to a mapped net that can be loaded by load_mapped()
+    bool save_mapped(const std::string& filename) const {
+
+      MappedNetHeader header{};
+      std::memcpy(header.magic, MappedNetMagic, sizeof(header.magic));
+      std::memcpy(header.layout, MappedNetLayout, sizeof(header.layout));
+      header.version         = MappedNetVersion;
+      header.hashValue       = HashValue<Arch>;
+      header.transformerSize = sizeof(FeatureTransformer);
+      header.networkSize     = sizeof(Arch);
+      header.descriptionSize = netDescription.size();
+
+      std::vector<char> page(MappedNetPageSize + MappedTransformerSize);
+      std::memcpy(page.data(), &header, sizeof(header));
+      std::memcpy(page.data() + MappedNetPageSize, featureTransformer, sizeof(FeatureTransformer));
+
+      std::ofstream stream(filename, std::ios::binary);
+      stream.write(page.data(), page.size());
+      for (std::size_t i = 0; i < LayerStacks; ++i)
+          stream.write(reinterpret_cast<const char*>(network[i]), sizeof(Arch));
+      stream.write(netDescription.data(), netDescription.size());
+
+      return bool(stream);
+    }
+
+    // Evaluate the position with the given layer stack, updating the
+    // accumulators of the thread for this net
+    void evaluate(const Position& pos,
+                  AccumulatorStack<Arch::TransformedFeatureDimensions>& stack,
+                  AccumulatorCache<Arch::TransformedFeatureDimensions>& cache,
+                  int bucket, std::int32_t& psqt, std::int32_t& positional) const {
+
+      // We manually align the arrays on the stack because with gcc < 9.3
+      // overaligning stack variables with alignas() doesn't work correctly.
+
+      constexpr uint64_t alignment = CacheLineSize;
 
 #if defined(ALIGNAS_ON_STACK_VARIABLES_BROKEN)
-    TransformedFeatureType transformedFeaturesUnaligned[
-      FeatureTransformer::BufferSize + alignment / sizeof(TransformedFeatureType)];
+      TransformedFeatureType transformedFeaturesUnaligned[
+        FeatureTransformer::BufferSize + alignment / sizeof(TransformedFeatureType)];
 
-    auto* transformedFeatures = align_ptr_up<alignment>(&transformedFeaturesUnaligned[0]);
+      auto* transformedFeatures = align_ptr_up<alignment>(&transformedFeaturesUnaligned[0]);
 #else
-    alignas(alignment)
-      TransformedFeatureType transformedFeatures[FeatureTransformer::BufferSize];
+      alignas(alignment)
+        TransformedFeatureType transformedFeatures[FeatureTransformer::BufferSize];
 #endif
 
-    ASSERT_ALIGNED(transformedFeatures, alignment);
+      ASSERT_ALIGNED(transformedFeatures, alignment);
 
-    const int bucket = (pos.count<ALL_PIECES>() - 1) / 4;
-    const auto psqt = featureTransformer->transform(pos, transformedFeatures, bucket);
-    const auto positional = network[bucket]->propagate(transformedFeatures);
+      psqt = featureTransformer->transform(pos, stack, cache, transformedFeatures, bucket);
+      positional = network[bucket]->propagate(transformedFeatures);
+    }
+
+    FeatureTransformer* featureTransformer = nullptr;
+    Arch* network[LayerStacks];
+
+    // Parameters read from a stream are owned by these pointers, the ones of a
+    // mapped net are used in place from the mapping.
+    LargePagePtr<FeatureTransformer> ownedTransformer;
+    AlignedPtr<Arch> ownedNetwork[LayerStacks];
+    void* mappedMem = nullptr;
+    std::size_t mappedSize = 0;
+
+    // Evaluation function file name
+    std::string fileName;
+    std::string netDescription;
+  };
+
+  // The main net, and the optional small one used in lopsided positions
+  EvalNet<Network> bigNet;
+  EvalNet<SmallNetworkArchitecture> smallNet;
+
+  // Reset the accumulators and the caches of a thread for the current nets.
+  // Called from the thread itself, so that it first touches their memory. The
+  // accumulators of the small net only exist while a small net is in use.
+  void clear_thread(Thread& th) {
+
+    if (!useSmallNNUE)
+        th.smallNetAccumulators.reset();
+
+    else if (!th.smallNetAccumulators)
+        th.smallNetAccumulators = std::make_unique<SmallNetAccumulators>();
+
+    th.accumulatorStack.clear();
+#if defined(USE_NNUE_CACHE)
+    th.evalCache.clear();
+#endif
+
+    if (bigNet.featureTransformer)
+        bigNet.featureTransformer->clear_cache(th.accumulatorCache);
+
+    if (th.smallNetAccumulators)
+    {
+        th.smallNetAccumulators->stack.clear();
+        smallNet.featureTransformer->clear_cache(th.smallNetAccumulators->cache);
+    }
+  }
+
+  // Combine the outputs of the net into the evaluation of the position
+  static Value to_value(const Position& pos, std::int32_t psqt, std::int32_t positional, bool adjusted) {
+
+    int delta = 10 - pos.non_pawn_material() / 1515;
 
     // Give more value to positional evaluation when adjusted flag is set
     if (adjusted)
@@ -168,6 +423,99 @@ namespace Stockfish::Eval::NNUE {
         return static_cast<Value>((psqt + positional) / OutputScale);
   }
 
+  // Evaluation function. Perform differential calculation.
+  Value evaluate(const Position& pos, bool adjusted, NetSize netSize) {
+
+    const int bucket = (pos.count<ALL_PIECES>() - 1) / 4;
+
+    Thread* th = pos.this_thread();
+    std::int32_t psqt, positional;
+
+    // The evaluations of the small net are cheap enough not to be cached
+    if (netSize == Small)
+        smallNet.evaluate(pos, th->smallNetAccumulators->stack, th->smallNetAccumulators->cache,
+                          bucket, psqt, positional);
+    else
+    {
+#if defined(USE_NNUE_CACHE)
+        EvalCache::Entry* e = th->evalCache.probe(pos.key());
+
+        if (e && e->key == pos.key())
+        {
+            psqt = e->psqt;
+            positional = e->positional;
+        }
+        else
+        {
+            bigNet.evaluate(pos, th->accumulatorStack, th->accumulatorCache,
+                            bucket, psqt, positional);
+
+            if (e)
+                *e = { pos.key(), psqt, positional };
+        }
+#else
+        bigNet.evaluate(pos, th->accumulatorStack, th->accumulatorCache,
+                        bucket, psqt, positional);
+#endif
+    }
+
+    return to_value(pos, psqt, positional, adjusted);
+  }
+
+  // Evaluation with the main net that bypasses the output cache, for trace()
+  // which removes pieces from the position without changing its key
+  static Value evaluate_uncached(const Position& pos) {
+
+    const int bucket = (pos.count<ALL_PIECES>() - 1) / 4;
+
+    Thread* th = pos.this_thread();
+    std::int32_t psqt, positional;
+
+    bigNet.evaluate(pos, th->accumulatorStack, th->accumulatorCache, bucket, psqt, positional);
+
+    return to_value(pos, psqt, positional, false);
+  }
+
+  // Batched evaluation function, with the main net and the accumulators of the
+  // given thread. All the positions are transformed first, then the layer
+  // stacks are run with the positions grouped by bucket, so that the weights
+  // of each stack stay in cache for all the positions using it.
+  void evaluate(const Position* const* positions, std::size_t count, Value* values,
+                Thread& th, bool adjusted) {
+
+    constexpr std::size_t alignment = CacheLineSize;
+    constexpr std::size_t bufferSize = Transformer<Network>::BufferSize;
+
+    static_assert(bufferSize % alignment == 0);
+
+    std::vector<TransformedFeatureType> storage(count * bufferSize + alignment);
+    auto* transformedFeatures = align_ptr_up<alignment>(storage.data());
+
+    std::vector<std::int32_t> psqt(count);
+    std::vector<std::size_t> order(count);
+
+    auto bucket = [&](std::size_t i) { return (positions[i]->count<ALL_PIECES>() - 1) / 4; };
+
+    // UCI::valid_fen() keeps the positions with more than 32 pieces out of the batch
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        assert(bucket(i) >= 0 && bucket(i) < int(LayerStacks));
+
+        psqt[i] = bigNet.featureTransformer->transform(*positions[i], th.accumulatorStack, th.accumulatorCache,
+                                                       transformedFeatures + i * bufferSize, bucket(i));
+        order[i] = i;
+    }
+
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::size_t a, std::size_t b) { return bucket(a) < bucket(b); });
+
+    for (std::size_t i : order)
+    {
+        std::int32_t positional = bigNet.network[bucket(i)]->propagate(transformedFeatures + i * bufferSize);
+        values[i] = to_value(*positions[i], psqt[i], positional, adjusted);
+    }
+  }
+
   struct NnueEvalTrace {
     static_assert(LayerStacks == PSQTBuckets);
 
@@ -178,28 +526,12 @@ namespace Stockfish::Eval::NNUE {
 
   static NnueEvalTrace trace_evaluate(const Position& pos) {
 
-    // We manually align the arrays on the stack because with gcc < 9.3
-    // overaligning stack variables with alignas() doesn't work correctly.
-
-    constexpr uint64_t alignment = CacheLineSize;
-
-#if defined(ALIGNAS_ON_STACK_VARIABLES_BROKEN)
-    TransformedFeatureType transformedFeaturesUnaligned[
-      FeatureTransformer::BufferSize + alignment / sizeof(TransformedFeatureType)];
-
-    auto* transformedFeatures = align_ptr_up<alignment>(&transformedFeaturesUnaligned[0]);
-#else
-    alignas(alignment)
-      TransformedFeatureType transformedFeatures[FeatureTransformer::BufferSize];
-#endif
-
-    ASSERT_ALIGNED(transformedFeatures, alignment);
-
+    Thread* th = pos.this_thread();
     NnueEvalTrace t{};
     t.correctBucket = (pos.count<ALL_PIECES>() - 1) / 4;
     for (IndexType bucket = 0; bucket < LayerStacks; ++bucket) {
-      const auto materialist = featureTransformer->transform(pos, transformedFeatures, bucket);
-      const auto positional = network[bucket]->propagate(transformedFeatures);
+      std::int32_t materialist, positional;
+      bigNet.evaluate(pos, th->accumulatorStack, th->accumulatorCache, bucket, materialist, positional);
 
       t.psqt[bucket] = static_cast<Value>( materialist / OutputScale );
       t.positional[bucket] = static_cast<Value>( positional / OutputScale );
@@ -283,7 +615,7 @@ namespace Stockfish::Eval::NNUE {
 
     // We estimate the value of each piece by doing a differential evaluation from
     // the current base eval, simulating the removal of the piece from its square.
-    Value base = evaluate(pos);
+    Value base = evaluate_uncached(pos);
     base = pos.side_to_move() == WHITE ? base : -base;
 
     for (File f = FILE_A; f <= FILE_H; ++f)
@@ -295,19 +627,19 @@ namespace Stockfish::Eval::NNUE {
 
         if (pc != NO_PIECE && type_of(pc) != KING)
         {
-          auto st = pos.state();
+          auto& accumulator = pos.this_thread()->accumulatorStack.get(pos.state());
 
           pos.remove_piece(sq);
-          st->accumulator.computed[WHITE] = false;
-          st->accumulator.computed[BLACK] = false;
+          accumulator.computed[WHITE] = false;
+          accumulator.computed[BLACK] = false;
 
-          Value eval = evaluate(pos);
+          Value eval = evaluate_uncached(pos);
           eval = pos.side_to_move() == WHITE ? eval : -eval;
           v = base - eval;
 
           pos.put_piece(pc, sq);
-          st->accumulator.computed[WHITE] = false;
-          st->accumulator.computed[BLACK] = false;
+          accumulator.computed[WHITE] = false;
+          accumulator.computed[BLACK] = false;
         }
 
         writeSquare(f, r, pc, v);
@@ -352,21 +684,264 @@ namespace Stockfish::Eval::NNUE {
   }
 
 
+  // Accumulated time of the timed parts of an operation, in nanoseconds and
+  // in reference cycles of the time stamp counter where there is one.
+  class BenchTimer {
+
+    using Clock = std::chrono::steady_clock;
+
+  public:
+    void start() {
+      startTime = Clock::now();
+      startCycles = cycles();
+    }
+
+    void stop(std::size_t count) {
+      totalCycles += cycles() - startCycles;
+      totalNs += std::chrono::duration<double, std::nano>(Clock::now() - startTime).count();
+      ops += count;
+    }
+
+    // Print a line of the benchmark report, with the time of one operation.
+    // An operation never run, like a move update on positions with only king
+    // moves, is printed as n/a.
+    void print(std::ostream& ss, const std::string& name) const {
+
+      ss << '\n' << std::left << std::setw(28) << name << std::right;
+
+      if (!ops)
+      {
+          ss << std::setw(12) << "n/a" << std::setw(12) << "n/a";
+          return;
+      }
+
+      ss << std::setw(12) << totalNs / ops;
+#if defined(HAS_CYCLE_COUNTER)
+      ss << std::setw(12) << double(totalCycles) / ops;
+#else
+      ss << std::setw(12) << "n/a";
+#endif
+    }
+
+  private:
+    static std::uint64_t cycles() {
+#if defined(HAS_CYCLE_COUNTER)
+      return __rdtsc();
+#else
+      return 0;
+#endif
+    }
+
+    Clock::time_point startTime;
+    std::uint64_t startCycles = 0, totalCycles = 0;
+    double totalNs = 0;
+    std::size_t ops = 0;
+  };
+
+  // Hide a pointer from the optimizer, so that repeated calls on the same data
+  // are not merged into one
+  template<typename T>
+  static T* opaque(T* ptr) {
+    T* volatile p = ptr;
+    return p;
+  }
+
+  // Time the parts of the evaluation with the main net on the given positions,
+  // each operation being repeated on a position the given number of times.
+  // The accumulators and the caches of the thread are used and then reset.
+  std::string benchmark(Position* const* positions, std::size_t count, Thread& th, int iterations) {
+
+    if (!count)
+        return "NNUE benchmark: no valid positions to time";
+
+    using FeatureTransformer = Transformer<Network>;
+    using CacheEntry = AccumulatorCache<TransformedFeatureDimensions>::Entry;
+
+    constexpr std::size_t alignment = CacheLineSize;
+    constexpr std::size_t bufferSize = FeatureTransformer::BufferSize;
+
+    struct alignas(CacheLineSize) Buffer {
+      alignas(CacheLineSize) decltype(Network::fc_0)::OutputBuffer fc_0_out;
+      alignas(CacheLineSize) decltype(Network::ac_0)::OutputBuffer ac_0_out;
+      alignas(CacheLineSize) decltype(Network::fc_1)::OutputBuffer fc_1_out;
+      alignas(CacheLineSize) decltype(Network::ac_1)::OutputBuffer ac_1_out;
+      alignas(CacheLineSize) decltype(Network::fc_2)::OutputBuffer fc_2_out;
+    };
+
+    static Buffer buffer;
+
+    const FeatureTransformer& ft = *bigNet.featureTransformer;
+    auto& stack = th.accumulatorStack;
+    auto& cache = th.accumulatorCache;
+
+    std::vector<TransformedFeatureType> storage(count * bufferSize + alignment);
+    auto* transformedFeatures = align_ptr_up<alignment>(storage.data());
+
+    auto bucket = [&](std::size_t i) { return (positions[i]->count<ALL_PIECES>() - 1) / 4; };
+
+    auto invalidate = [&](const Position& pos) {
+      auto& accumulator = stack.get(pos.state());
+      accumulator.computed[WHITE] = accumulator.computed[BLACK] = false;
+    };
+
+    // Run f() on each move of each position that is not a king move, so that
+    // the accumulators of the resulting positions can be updated incrementally.
+    auto time_moves = [&](BenchTimer& timer, auto f) {
+      for (std::size_t i = 0; i < count; ++i)
+      {
+          Position& pos = *positions[i];
+          StateInfo st;
+
+          ft.update_accumulators(pos, stack, cache);
+          for (const auto& m : MoveList<LEGAL>(pos))
+              if (type_of(pos.moved_piece(m)) != KING)
+              {
+                  pos.do_move(m, st);
+                  timer.start();
+                  for (int it = 0; it < iterations; ++it)
+                      f(pos);
+                  timer.stop(iterations);
+                  pos.undo_move(m);
+              }
+      }
+    };
+
+    clear_thread(th);
+    static CacheEntry emptyEntry;
+    emptyEntry = cache.entry[SQ_A1][WHITE];
+
+    BenchTimer refreshEmpty, refreshCached, update, transform, evaluate;
+    BenchTimer fc_0, ac_0, fc_1, ac_1, fc_2, propagate;
+    volatile std::int32_t sink = 0;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const Position& pos = *positions[i];
+        auto* features = transformedFeatures + i * bufferSize;
+
+        refreshEmpty.start();
+        for (int it = 0; it < iterations; ++it)
+        {
+            cache.entry[pos.square<KING>(WHITE)][WHITE] = emptyEntry;
+            cache.entry[pos.square<KING>(BLACK)][BLACK] = emptyEntry;
+            invalidate(pos);
+            ft.update_accumulators(pos, stack, cache);
+        }
+        refreshEmpty.stop(iterations);
+
+        refreshCached.start();
+        for (int it = 0; it < iterations; ++it)
+        {
+            invalidate(pos);
+            ft.update_accumulators(pos, stack, cache);
+        }
+        refreshCached.stop(iterations);
+
+        // The accumulators are now computed, so only the transform is timed
+        transform.start();
+        for (int it = 0; it < iterations; ++it)
+            sink = sink + ft.transform(pos, stack, cache, features, bucket(i));
+        transform.stop(iterations);
+    }
+
+    time_moves(update, [&](const Position& pos) {
+        invalidate(pos);
+        ft.update_accumulators(pos, stack, cache);
+    });
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Network& net = *bigNet.network[bucket(i)];
+        const auto* features = transformedFeatures + i * bufferSize;
+
+        auto time_layer = [&](BenchTimer& timer, auto& layer, const auto* input, auto* output) {
+          timer.start();
+          for (int it = 0; it < iterations; ++it)
+              layer.propagate(opaque(input), output);
+          timer.stop(iterations);
+        };
+
+        time_layer(fc_0, net.fc_0, features, buffer.fc_0_out);
+        time_layer(ac_0, net.ac_0, buffer.fc_0_out, buffer.ac_0_out);
+        time_layer(fc_1, net.fc_1, buffer.ac_0_out, buffer.fc_1_out);
+        time_layer(ac_1, net.ac_1, buffer.fc_1_out, buffer.ac_1_out);
+        time_layer(fc_2, net.fc_2, buffer.ac_1_out, buffer.fc_2_out);
+        sink = sink + buffer.fc_2_out[0];
+
+        propagate.start();
+        for (int it = 0; it < iterations; ++it)
+            sink = sink + net.propagate(opaque(features));
+        propagate.stop(iterations);
+    }
+
+    time_moves(evaluate, [&](const Position& pos) {
+        std::int32_t psqt, positional;
+        invalidate(pos);
+        bigNet.evaluate(pos, stack, cache, (pos.count<ALL_PIECES>() - 1) / 4, psqt, positional);
+        sink = sink + psqt + positional;
+    });
+
+    clear_thread(th);
+
+    std::stringstream ss;
+
+    ss << "NNUE benchmark of " << bigNet.fileName << ", layout " << MappedNetLayout
+       << ", " << count << " positions, " << iterations << " iterations\n\n"
+       << std::left << std::setw(28) << "Operation" << std::right
+       << std::setw(12) << "ns/op" << std::setw(12) << "cycles/op"
+       << std::fixed << std::setprecision(1);
+
+    refreshEmpty.print(ss, "refresh (empty cache)");
+    refreshCached.print(ss, "refresh (cached)");
+    update.print(ss, "update (one move)");
+    transform.print(ss, "transform");
+    fc_0.print(ss, "fc_0");
+    ac_0.print(ss, "ac_0");
+    fc_1.print(ss, "fc_1");
+    ac_1.print(ss, "ac_1");
+    fc_2.print(ss, "fc_2");
+    propagate.print(ss, "propagate");
+    evaluate.print(ss, "evaluate (one move)");
+
+    return ss.str();
+  }
+
+
   // Load eval, from a file stream or a memory stream
-  bool load_eval(std::string name, std::istream& stream) {
+  bool load_eval(std::string name, std::istream& stream, NetSize netSize) {
+
+    return netSize == Small ? smallNet.load(name, stream)
+                            : bigNet.load(name, stream);
+  }
 
-    initialize();
-    fileName = name;
-    return read_parameters(stream);
+  // Load eval from a mapped net, written by save_mapped_eval(). Where available
+  // the file is mapped read-only and shared, so that the parameters are read
+  // from disk on demand and shared through the page cache by all the processes
+  // using the same file. Returns false, leaving the current net untouched, if
+  // the file is not a mapped net for this build.
+  bool load_mapped_eval(std::string name, const std::string& path, NetSize netSize) {
+
+    return netSize == Small ? smallNet.load_mapped(name, path)
+                            : bigNet.load_mapped(name, path);
+  }
+
+  // Save eval, to a mapped net that can be loaded by load_mapped_eval()
+  bool save_mapped_eval(const std::string& filename) {
+
+    bool saved = !bigNet.fileName.empty() && bigNet.save_mapped(filename);
+
+    sync_cout << (saved ? "Mapped net saved successfully to " + filename
+                        : "Failed to export a mapped net") << sync_endl;
+    return saved;
   }
 
   // Save eval, to a file stream or a memory stream
   bool save_eval(std::ostream& stream) {
 
-    if (fileName.empty())
+    if (bigNet.fileName.empty())
       return false;
 
-    return write_parameters(stream);
+    return bigNet.write_parameters(stream);
   }
 
   /// Save eval, to a file given by its name
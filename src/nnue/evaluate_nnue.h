@@ -27,9 +27,14 @@
 
 namespace Stockfish::Eval::NNUE {
 
+  // Input feature converter of a network architecture
+  template <typename Arch>
+  using Transformer = FeatureTransformer<Arch::TransformedFeatureDimensions>;
+
   // Hash value of evaluation function structure
+  template <typename Arch>
   constexpr std::uint32_t HashValue =
-      FeatureTransformer::get_hash_value() ^ Network::get_hash_value();
+      Transformer<Arch>::get_hash_value() ^ Arch::get_hash_value();
 
   // Deleter for automating release of memory area
   template <typename T>
@@ -23,13 +23,15 @@
 
 #include <iostream>
 #include <algorithm>
+#include <array>
 #include <type_traits>
 #include "../nnue_common.h"
 #include "../../simd.h"
 
 /*
   This file contains the definition for a fully connected layer (aka affine transform).
-  Two approaches are employed, depending on the sizes of the transform.
+  Two approaches are employed, depending on the sizes of the transform,
+  and a third one for the sparse output of the feature transformer.
 
   Approach 1:
     - used when the PaddedInputDimensions >= 128
@@ -51,6 +53,14 @@
       - not optimized as well as the approach 1
     - inputs are processed in chunks of 4, weights are respectively transposed
     - accumulation happens directly to int32s
+
+  Approach 3 (AffineTransformSparseInput):
+    - used for the first layer after the feature transformer when built with
+      USE_SPARSE_INPUT, because most of its clipped inputs are zero
+    - the indices of the non-zero 4-byte input blocks are gathered first,
+      using a SIMD comparison mask and a lookup table of bit positions
+    - weights are stored column-wise in blocks of 4 like in approach 2, so
+      only the columns of the non-zero blocks are read
 */
 
 namespace Stockfish::Eval::NNUE::Layers {
@@ -534,6 +544,249 @@ namespace Stockfish::Eval::NNUE::Layers {
     alignas(CacheLineSize) WeightType weights[OutputDimensions * PaddedInputDimensions];
   };
 
+  // Lookup tables for find_nnz(): the positions of the set bits of each byte
+  // value, padded with zeros to 8 entries, and the number of set bits.
+  alignas(CacheLineSize) static inline const std::array<std::array<std::uint16_t, 8>, 256> NnzIndices = [] {
+    std::array<std::array<std::uint16_t, 8>, 256> v{};
+    for (unsigned i = 0; i < 256; ++i)
+      for (unsigned b = 0, k = 0; b < 8; ++b)
+        if (i & (1 << b))
+          v[i][k++] = std::uint16_t(b);
+    return v;
+  }();
+
+  alignas(CacheLineSize) static inline const std::array<std::uint8_t, 256> NnzCount = [] {
+    std::array<std::uint8_t, 256> v{};
+    for (unsigned i = 0; i < 256; ++i)
+      for (unsigned b = 0; b < 8; ++b)
+        v[i] += bool(i & (1 << b));
+    return v;
+  }();
+
+  // find_nnz() writes to out[] the indices of the non-zero values of input[]
+  // in increasing order and returns their number. Up to 7 values past the
+  // returned count may be overwritten, out[] must be able to hold Size entries.
+  template <IndexType Size>
+  IndexType find_nnz(const std::int32_t* input, std::uint16_t* out) {
+
+#if defined (USE_AVX512)
+    using vec_t = __m512i;
+    #define vec_nnz(a) _mm512_cmpgt_epi32_mask(a, _mm512_setzero_si512())
+#elif defined (USE_AVX2)
+    using vec_t = __m256i;
+    #define vec_nnz(a) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, _mm256_setzero_si256())))
+#elif defined (USE_SSSE3)
+    using vec_t = __m128i;
+    #define vec_nnz(a) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(a, _mm_setzero_si128())))
+#elif defined (USE_NEON)
+    using vec_t = uint32x4_t;
+    static const std::uint32_t Mask[4] = { 1, 2, 4, 8 };
+    const auto vec_nnz = [](uint32x4_t a) -> unsigned {
+      const uint32x4_t m = vandq_u32(vtstq_u32(a, a), vld1q_u32(Mask));
+# if USE_NEON >= 8
+      return vaddvq_u32(m);
+# else
+      return m[0] | m[1] | m[2] | m[3];
+# endif
+    };
+#endif
+
+    IndexType count = 0;
+
+#if defined (USE_SSSE3) || defined (USE_NEON)
+    // Inputs are tested InputSimdWidth at a time and the indices are written
+    // 8 at a time, so process them in chunks of the larger of the two.
+    constexpr IndexType InputSimdWidth = sizeof(vec_t) / sizeof(std::int32_t);
+    constexpr IndexType ChunkSize = std::max<IndexType>(InputSimdWidth, 8);
+    constexpr IndexType NumChunks = Size / ChunkSize;
+    constexpr IndexType InputsPerChunk = ChunkSize / InputSimdWidth;
+    constexpr IndexType OutputsPerChunk = ChunkSize / 8;
+
+    static_assert(Size % ChunkSize == 0);
+
+    const auto inputVector = reinterpret_cast<const vec_t*>(input);
+
+    for (IndexType i = 0; i < NumChunks; ++i)
+    {
+      // Bitmask of the non-zero values in this chunk
+      unsigned nnz = 0;
+      for (IndexType j = 0; j < InputsPerChunk; ++j)
+        nnz |= unsigned(vec_nnz(inputVector[i * InputsPerChunk + j])) << (j * InputSimdWidth);
+
+      for (IndexType j = 0; j < OutputsPerChunk; ++j)
+      {
+        const unsigned byte = (nnz >> (j * 8)) & 0xFF;
+        const std::uint16_t base = std::uint16_t(i * ChunkSize + j * 8);
+# if defined (USE_SSSE3)
+        const __m128i offsets = _mm_load_si128(reinterpret_cast<const __m128i*>(&NnzIndices[byte]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + count), _mm_add_epi16(offsets, _mm_set1_epi16(base)));
+# else
+        vst1q_u16(out + count, vaddq_u16(vld1q_u16(NnzIndices[byte].data()), vdupq_n_u16(base)));
+# endif
+        count += NnzCount[byte];
+      }
+    }
+
+# undef vec_nnz
+#else
+    for (IndexType i = 0; i < Size; ++i)
+      if (input[i])
+        out[count++] = std::uint16_t(i);
+#endif
+
+    return count;
+  }
+
+  // A variant of the large input specialization for sparse inputs, see approach 3
+  template <IndexType InDims, IndexType OutDims>
+  class AffineTransformSparseInput {
+   public:
+    // Input/output type
+    using InputType = std::uint8_t;
+    using OutputType = std::int32_t;
+
+    // Number of input/output dimensions
+    static constexpr IndexType InputDimensions = InDims;
+    static constexpr IndexType OutputDimensions = OutDims;
+
+    static constexpr IndexType PaddedInputDimensions =
+      ceil_to_multiple<IndexType>(InputDimensions, MaxSimdWidth);
+    static constexpr IndexType PaddedOutputDimensions =
+      ceil_to_multiple<IndexType>(OutputDimensions, MaxSimdWidth);
+
+    using OutputBuffer = OutputType[PaddedOutputDimensions];
+
+    // Inputs are processed in blocks of 4 bytes, i.e. one int32
+    static constexpr IndexType ChunkSize = 4;
+    static constexpr IndexType NumChunks = PaddedInputDimensions / ChunkSize;
+
+#if defined (USE_AVX512)
+    static constexpr const IndexType OutputSimdWidth = 16;
+#elif defined (USE_AVX2)
+    static constexpr const IndexType OutputSimdWidth = 8;
+#elif defined (USE_SSSE3) || defined (USE_NEON)
+    static constexpr const IndexType OutputSimdWidth = 4;
+#else
+    static constexpr const IndexType OutputSimdWidth = 1;
+#endif
+
+    static_assert(OutputDimensions % OutputSimdWidth == 0);
+
+    // Hash value embedded in the evaluation file
+    static constexpr std::uint32_t get_hash_value(std::uint32_t prevHash) {
+      std::uint32_t hashValue = 0xCC03DAE4u;
+      hashValue += OutputDimensions;
+      hashValue ^= prevHash >> 1;
+      hashValue ^= prevHash << 31;
+      return hashValue;
+    }
+
+    // All the weights of a 4-byte input block are stored contiguously
+    static IndexType get_weight_index(IndexType i)
+    {
+      return
+        (i / ChunkSize) % NumChunks * OutputDimensions * ChunkSize +
+        i / PaddedInputDimensions * ChunkSize +
+        i % ChunkSize;
+    }
+
+    // Read network parameters
+    bool read_parameters(std::istream& stream) {
+      for (IndexType i = 0; i < OutputDimensions; ++i)
+        biases[i] = read_little_endian<BiasType>(stream);
+
+      for (IndexType i = 0; i < OutputDimensions * PaddedInputDimensions; ++i)
+        weights[get_weight_index(i)] = read_little_endian<WeightType>(stream);
+
+      return !stream.fail();
+    }
+
+    // Write network parameters
+    bool write_parameters(std::ostream& stream) const {
+      for (IndexType i = 0; i < OutputDimensions; ++i)
+        write_little_endian<BiasType>(stream, biases[i]);
+
+      for (IndexType i = 0; i < OutputDimensions * PaddedInputDimensions; ++i)
+        write_little_endian<WeightType>(stream, weights[get_weight_index(i)]);
+
+      return !stream.fail();
+    }
+
+    // Forward propagation
+    const OutputType* propagate(
+        const InputType* input, OutputType* output) const {
+
+#if defined (USE_AVX512)
+      using vec_t = __m512i;
+      #define vec_set_32 _mm512_set1_epi32
+      #define vec_add_dpbusd_32 Simd::m512_add_dpbusd_epi32
+#elif defined (USE_AVX2)
+      using vec_t = __m256i;
+      #define vec_set_32 _mm256_set1_epi32
+      #define vec_add_dpbusd_32 Simd::m256_add_dpbusd_epi32
+#elif defined (USE_SSSE3)
+      using vec_t = __m128i;
+      #define vec_set_32 _mm_set1_epi32
+      #define vec_add_dpbusd_32 Simd::m128_add_dpbusd_epi32
+#elif defined (USE_NEON)
+      using vec_t = int32x4_t;
+      #define vec_set_32 vdupq_n_s32
+      #define vec_add_dpbusd_32(acc, a, b) Simd::neon_m128_add_dpbusd_epi32(acc, \
+              vreinterpretq_s8_s32(a), vreinterpretq_s8_s32(b))
+#endif
+
+      const auto input32 = reinterpret_cast<const std::int32_t*>(input);
+
+      std::uint16_t nnz[NumChunks];
+      const IndexType count = find_nnz<NumChunks>(input32, nnz);
+
+#if defined (USE_SSSE3) || defined (USE_NEON)
+      constexpr IndexType NumRegs = OutputDimensions / OutputSimdWidth;
+
+      const vec_t* biasvec = reinterpret_cast<const vec_t*>(biases);
+      vec_t acc[NumRegs];
+      for (IndexType k = 0; k < NumRegs; ++k)
+        acc[k] = biasvec[k];
+
+      for (IndexType j = 0; j < count; ++j)
+      {
+        const IndexType i = nnz[j];
+        const vec_t in = vec_set_32(input32[i]);
+        const auto col = reinterpret_cast<const vec_t*>(&weights[i * OutputDimensions * ChunkSize]);
+        for (IndexType k = 0; k < NumRegs; ++k)
+          vec_add_dpbusd_32(acc[k], in, col[k]);
+      }
+
+      vec_t* outptr = reinterpret_cast<vec_t*>(output);
+      for (IndexType k = 0; k < NumRegs; ++k)
+        outptr[k] = acc[k];
+
+# undef vec_set_32
+# undef vec_add_dpbusd_32
+#else
+      std::copy(biases, biases + OutputDimensions, output);
+
+      for (IndexType j = 0; j < count; ++j)
+      {
+        const IndexType i = nnz[j];
+        const WeightType* col = &weights[i * OutputDimensions * ChunkSize];
+        for (IndexType k = 0; k < OutputDimensions; ++k)
+          for (IndexType l = 0; l < ChunkSize; ++l)
+            output[k] += col[k * ChunkSize + l] * input[i * ChunkSize + l];
+      }
+#endif
+
+      return output;
+    }
+
+   private:
+    using BiasType = OutputType;
+    using WeightType = std::int8_t;
+
+    alignas(CacheLineSize) BiasType biases[OutputDimensions];
+    alignas(CacheLineSize) WeightType weights[OutputDimensions * PaddedInputDimensions];
+  };
+
 }  // namespace Stockfish::Eval::NNUE::Layers
 
 #endif // #ifndef NNUE_LAYERS_AFFINE_TRANSFORM_H_INCLUDED
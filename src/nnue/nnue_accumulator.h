@@ -21,17 +21,159 @@
 #ifndef NNUE_ACCUMULATOR_H_INCLUDED
 #define NNUE_ACCUMULATOR_H_INCLUDED
 
+#include <algorithm>
+#include <vector>
+
 #include "nnue_architecture.h"
+#include "../position.h"
 
 namespace Stockfish::Eval::NNUE {
 
   // Class that holds the result of affine transformation of input features
+  template<IndexType Size>
   struct alignas(CacheLineSize) Accumulator {
-    std::int16_t accumulation[2][TransformedFeatureDimensions];
+    std::int16_t accumulation[2][Size];
     std::int32_t psqtAccumulation[2][PSQTBuckets];
     bool computed[2];
+
+    // The position this accumulator currently belongs to. Not initialized
+    // here, so that the stack is first touched by AccumulatorStack::clear(),
+    // run by the thread owning it.
+    const StateInfo* state;
+    Key key;
+  };
+
+  // Per-thread stack of accumulators, indexed by the ply of the StateInfo they
+  // belong to, so that StateInfo stays small and making a move never touches
+  // the accumulators. An entry only holds the accumulator of a state if it was
+  // claimed for the same StateInfo and the same position key: states that are
+  // reused for another position or that are outside of the search, like the
+  // setup moves, are simply seen as not computed.
+  template<IndexType Dimensions>
+  struct AccumulatorStack {
+
+    static constexpr int Size = 256;
+    static_assert(Size > MAX_PLY && (Size & (Size - 1)) == 0);
+
+    // The accumulator of st, or nullptr if st has no entry in the stack
+    Accumulator<Dimensions>* find(const StateInfo* st) {
+      Accumulator<Dimensions>& acc = entry[st->accumulatorIdx & (Size - 1)];
+      return acc.state == st && acc.key == st->key ? &acc : nullptr;
+    }
+
+    // The accumulator of st, claiming and invalidating the entry if needed
+    Accumulator<Dimensions>& get(const StateInfo* st) {
+      Accumulator<Dimensions>& acc = entry[st->accumulatorIdx & (Size - 1)];
+      if (acc.state != st || acc.key != st->key)
+      {
+          acc.state = st;
+          acc.key = st->key;
+          acc.computed[WHITE] = acc.computed[BLACK] = false;
+      }
+      return acc;
+    }
+
+    // Drop all the entries, e.g. after loading a new net
+    void clear() {
+      for (Accumulator<Dimensions>& acc : entry)
+          acc.state = nullptr;
+    }
+
+    Accumulator<Dimensions> entry[Size];
+  };
+
+  // Per-thread cache of accumulators, the so-called Finny tables. For each king
+  // square and perspective it keeps the last refreshed accumulator together with
+  // the pieces it was computed from, so that a refresh only needs to apply the
+  // difference between those pieces and the current ones.
+  template<IndexType Size>
+  struct AccumulatorCache {
+
+    struct alignas(CacheLineSize) Entry {
+      std::int16_t accumulation[Size];
+      std::int32_t psqtAccumulation[PSQTBuckets];
+      Bitboard byColorBB[COLOR_NB];
+      Bitboard byTypeBB[PIECE_TYPE_NB];
+    };
+
+    // Reset all the entries to an empty board, whose accumulator is just the biases
+    void clear(const std::int16_t* biases) {
+
+      for (auto& entries : entry)
+          for (Entry& e : entries)
+          {
+              std::memcpy(e.accumulation, biases, sizeof(e.accumulation));
+              std::memset(e.psqtAccumulation, 0, sizeof(e.psqtAccumulation));
+              std::memset(e.byColorBB, 0, sizeof(e.byColorBB));
+              std::memset(e.byTypeBB, 0, sizeof(e.byTypeBB));
+          }
+    }
+
+    Entry entry[SQUARE_NB][COLOR_NB];
   };
 
+  // Accumulators of the optional small net. A thread only allocates them,
+  // from Thread::clear(), while a small net is loaded.
+  struct SmallNetAccumulators {
+    AccumulatorStack<SmallNetworkArchitecture::TransformedFeatureDimensions> stack;
+    AccumulatorCache<SmallNetworkArchitecture::TransformedFeatureDimensions> cache;
+  };
+
+#if defined(USE_NNUE_CACHE)
+
+  // Per-thread direct mapped cache of the network outputs, indexed by the low
+  // bits of the position key. A position evaluated again by the same thread,
+  // for instance after its TT entry has been overwritten, then skips both the
+  // accumulator update and the forward pass. The probes and hits are only
+  // counted with USE_TT_STATS.
+  struct EvalCache {
+
+    struct Entry {
+      Key key;
+      std::int32_t psqt;
+      std::int32_t positional;
+    };
+
+    // Use the largest power of two number of entries fitting in mbSize MB,
+    // a size of 0 disables the cache. Entries and counters are reset.
+    void resize(std::size_t mbSize) {
+
+      std::size_t count = mbSize ? std::size_t(1) << msb(mbSize * 1024 * 1024 / sizeof(Entry)) : 0;
+      if (count != table.size())
+          std::vector<Entry>(count).swap(table);
+      clear();
+#if defined(USE_TT_STATS)
+      probes = hits = 0;
+#endif
+    }
+
+    // Drop all the entries, e.g. after loading a new net
+    void clear() {
+      std::fill(table.begin(), table.end(), Entry());
+    }
+
+    // The entry of the given key, or nullptr if the cache is disabled
+    Entry* probe(Key key) {
+
+      if (table.empty())
+          return nullptr;
+
+      Entry* e = &table[key & (table.size() - 1)];
+#if defined(USE_TT_STATS)
+      probes++;
+      hits += e->key == key;
+#endif
+      return e;
+    }
+
+    std::vector<Entry> table;
+#if defined(USE_TT_STATS)
+    std::uint64_t probes = 0, hits = 0;
+#endif
+  };
+
+#endif
+
 }  // namespace Stockfish::Eval::NNUE
 
 #endif // NNUE_ACCUMULATOR_H_INCLUDED
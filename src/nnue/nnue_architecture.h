@@ -37,17 +37,34 @@ namespace Stockfish::Eval::NNUE {
 // Input features used in evaluation function
 using FeatureSet = Features::HalfKAv2_hm;
 
-// Number of input feature dimensions after conversion
-constexpr IndexType TransformedFeatureDimensions = 1024;
+// Number of input feature dimensions after conversion, and sizes of the
+// hidden layers, of the architectures we know about
+constexpr IndexType TransformedFeatureDimensionsBig = 1024;
+constexpr int L2Big = 15;
+constexpr int L3Big = 32;
+
+// The small architecture keeps 15 outputs in the first layer, the fewest that
+// fit the 16 wide AVX-512 outputs of the sparse fc_0 once the extra forward
+// output is added, and halves the second hidden layer.
+constexpr IndexType TransformedFeatureDimensionsSmall = 256;
+constexpr int L2Small = 15;
+constexpr int L3Small = 16;
+
 constexpr IndexType PSQTBuckets = 8;
 constexpr IndexType LayerStacks = 8;
 
-struct Network
+template<IndexType L1, int L2, int L3>
+struct NetworkArchitecture
 {
-  static constexpr int FC_0_OUTPUTS = 15;
-  static constexpr int FC_1_OUTPUTS = 32;
+  static constexpr IndexType TransformedFeatureDimensions = L1;
+  static constexpr int FC_0_OUTPUTS = L2;
+  static constexpr int FC_1_OUTPUTS = L3;
 
+#if defined(USE_SPARSE_INPUT)
+  Layers::AffineTransformSparseInput<TransformedFeatureDimensions, FC_0_OUTPUTS + 1> fc_0;
+#else
   Layers::AffineTransform<TransformedFeatureDimensions, FC_0_OUTPUTS + 1> fc_0;
+#endif
   Layers::ClippedReLU<FC_0_OUTPUTS + 1> ac_0;
   Layers::AffineTransform<FC_0_OUTPUTS, FC_1_OUTPUTS> fc_1;
   Layers::ClippedReLU<FC_1_OUTPUTS> ac_1;
@@ -92,11 +109,11 @@ struct Network
   {
     struct alignas(CacheLineSize) Buffer
     {
-      alignas(CacheLineSize) decltype(fc_0)::OutputBuffer fc_0_out;
-      alignas(CacheLineSize) decltype(ac_0)::OutputBuffer ac_0_out;
-      alignas(CacheLineSize) decltype(fc_1)::OutputBuffer fc_1_out;
-      alignas(CacheLineSize) decltype(ac_1)::OutputBuffer ac_1_out;
-      alignas(CacheLineSize) decltype(fc_2)::OutputBuffer fc_2_out;
+      alignas(CacheLineSize) typename decltype(fc_0)::OutputBuffer fc_0_out;
+      alignas(CacheLineSize) typename decltype(ac_0)::OutputBuffer ac_0_out;
+      alignas(CacheLineSize) typename decltype(fc_1)::OutputBuffer fc_1_out;
+      alignas(CacheLineSize) typename decltype(ac_1)::OutputBuffer ac_1_out;
+      alignas(CacheLineSize) typename decltype(fc_2)::OutputBuffer fc_2_out;
 
       Buffer()
       {
@@ -128,6 +145,19 @@ struct Network
   }
 };
 
+using BigNetworkArchitecture   = NetworkArchitecture<TransformedFeatureDimensionsBig, L2Big, L3Big>;
+using SmallNetworkArchitecture = NetworkArchitecture<TransformedFeatureDimensionsSmall, L2Small, L3Small>;
+
+// Architecture of the net used by the engine, selected at build time with
+// the nnue= option of the Makefile.
+#if defined(NNUE_SMALL)
+using Network = SmallNetworkArchitecture;
+#else
+using Network = BigNetworkArchitecture;
+#endif
+
+constexpr IndexType TransformedFeatureDimensions = Network::TransformedFeatureDimensions;
+
 }  // namespace Stockfish::Eval::NNUE
 
 #endif // #ifndef NNUE_ARCHITECTURE_H_INCLUDED
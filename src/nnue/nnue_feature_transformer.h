@@ -23,6 +23,7 @@
 
 #include "nnue_common.h"
 #include "nnue_architecture.h"
+#include "nnue_accumulator.h"
 
 #include <cstring> // std::memset()
 
@@ -52,10 +53,7 @@ namespace Stockfish::Eval::NNUE {
   #define vec_set_16(a) _mm512_set1_epi16(a)
   #define vec_max_16(a,b) _mm512_max_epi16(a,b)
   #define vec_min_16(a,b) _mm512_min_epi16(a,b)
-  inline vec_t vec_msb_pack_16(vec_t a, vec_t b){
-    vec_t compacted = _mm512_packs_epi16(_mm512_srli_epi16(a,7),_mm512_srli_epi16(b,7));
-    return _mm512_permutexvar_epi64(_mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7), compacted);
-  }
+  #define vec_msb_pack_16(a,b) _mm512_packs_epi16(_mm512_srli_epi16(a,7),_mm512_srli_epi16(b,7))
   #define vec_load_psqt(a) _mm256_load_si256(a)
   #define vec_store_psqt(a,b) _mm256_store_si256(a,b)
   #define vec_add_psqt_32(a,b) _mm256_add_epi32(a,b)
@@ -76,10 +74,7 @@ namespace Stockfish::Eval::NNUE {
   #define vec_set_16(a) _mm256_set1_epi16(a)
   #define vec_max_16(a,b) _mm256_max_epi16(a,b)
   #define vec_min_16(a,b) _mm256_min_epi16(a,b)
-  inline vec_t vec_msb_pack_16(vec_t a, vec_t b){
-    vec_t compacted = _mm256_packs_epi16(_mm256_srli_epi16(a,7), _mm256_srli_epi16(b,7));
-    return _mm256_permute4x64_epi64(compacted, 0b11011000);
-  }
+  #define vec_msb_pack_16(a,b) _mm256_packs_epi16(_mm256_srli_epi16(a,7),_mm256_srli_epi16(b,7))
   #define vec_load_psqt(a) _mm256_load_si256(a)
   #define vec_store_psqt(a,b) _mm256_store_si256(a,b)
   #define vec_add_psqt_32(a,b) _mm256_add_epi32(a,b)
@@ -209,8 +204,6 @@ namespace Stockfish::Eval::NNUE {
           return 1;
       }
 
-      static constexpr int NumRegs     = BestRegisterCount<vec_t, WeightType, TransformedFeatureDimensions, NumRegistersSIMD>();
-      static constexpr int NumPsqtRegs = BestRegisterCount<psqt_vec_t, PSQTWeightType, PSQTBuckets, NumRegistersSIMD>();
       #if defined(__GNUC__)
       #pragma GCC diagnostic pop
       #endif
@@ -218,20 +211,55 @@ namespace Stockfish::Eval::NNUE {
 
 
 
+  // The packs instructions interleave their two inputs 128 bits at a time, so
+  // vec_msb_pack_16() outputs the 64-bit chunks of each pair of vectors in this
+  // order. The weights and the biases are permuted at load time so that the
+  // output of the feature transformer still comes in the order of the net.
+  #if defined(USE_AVX512)
+  constexpr IndexType PackusEpi16Order[] = {0, 2, 4, 6, 1, 3, 5, 7};
+  #elif defined(USE_AVX2)
+  constexpr IndexType PackusEpi16Order[] = {0, 2, 1, 3};
+  #else
+  constexpr IndexType PackusEpi16Order[] = {0};
+  #endif
+
   // Input feature converter
+  template<IndexType TransformedFeatureDimensions>
   class FeatureTransformer {
 
    private:
     // Number of output dimensions for one side
     static constexpr IndexType HalfDimensions = TransformedFeatureDimensions;
 
+    using Accumulator      = NNUE::Accumulator<HalfDimensions>;
+    using AccumulatorStack = NNUE::AccumulatorStack<HalfDimensions>;
+    using AccumulatorCache = NNUE::AccumulatorCache<HalfDimensions>;
+
     #ifdef VECTOR
+    #if defined(__GNUC__)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wignored-attributes"
+    #endif
+    static constexpr int NumRegs     = BestRegisterCount<vec_t, WeightType, HalfDimensions, NumRegistersSIMD>();
+    static constexpr int NumPsqtRegs = BestRegisterCount<psqt_vec_t, PSQTWeightType, PSQTBuckets, NumRegistersSIMD>();
+    // The fused updates keep half of the registers free for the weight columns,
+    // with AVX-512 a tile of all the registers makes gcc spill the accumulator
+    static constexpr int FusedRegs   = BestRegisterCount<vec_t, WeightType, HalfDimensions, NumRegistersSIMD / 2>();
+    #if defined(__GNUC__)
+    #pragma GCC diagnostic pop
+    #endif
+
     static constexpr IndexType TileHeight = NumRegs * sizeof(vec_t) / 2;
+    static constexpr IndexType FusedTileHeight = FusedRegs * sizeof(vec_t) / 2;
     static constexpr IndexType PsqtTileHeight = NumPsqtRegs * sizeof(psqt_vec_t) / 4;
     static_assert(HalfDimensions % TileHeight == 0, "TileHeight must divide HalfDimensions");
     static_assert(PSQTBuckets % PsqtTileHeight == 0, "PsqtTileHeight must divide PSQTBuckets");
     #endif
 
+    // Longest chain of incremental updates, bounded by the refresh cost of at
+    // most 32 pieces since each update costs at least one feature
+    static constexpr int MaxChainLength = 32;
+
    public:
     // Output type
     using OutputType = TransformedFeatureType;
@@ -256,27 +284,55 @@ namespace Stockfish::Eval::NNUE {
       read_little_endian<WeightType    >(stream, weights    , HalfDimensions * InputDimensions);
       read_little_endian<PSQTWeightType>(stream, psqtWeights, PSQTBuckets    * InputDimensions);
 
+      permute(biases, true);
+      for (IndexType i = 0; i < InputDimensions; ++i)
+          permute(&weights[i * HalfDimensions], true);
+
       return !stream.fail();
     }
 
-    // Write network parameters
+    // Write network parameters, in the order of the net. The parameters are
+    // left untouched since they may be read-only, e.g. for a mapped net.
     bool write_parameters(std::ostream& stream) const {
 
-      write_little_endian<BiasType      >(stream, biases     , HalfDimensions                  );
-      write_little_endian<WeightType    >(stream, weights    , HalfDimensions * InputDimensions);
-      write_little_endian<PSQTWeightType>(stream, psqtWeights, PSQTBuckets    * InputDimensions);
+      std::int16_t row[HalfDimensions];
+
+      std::memcpy(row, biases, sizeof(row));
+      permute(row, false);
+      write_little_endian<BiasType>(stream, row, HalfDimensions);
+
+      for (IndexType i = 0; i < InputDimensions; ++i)
+      {
+          std::memcpy(row, &weights[i * HalfDimensions], sizeof(row));
+          permute(row, false);
+          write_little_endian<WeightType>(stream, row, HalfDimensions);
+      }
+
+      write_little_endian<PSQTWeightType>(stream, psqtWeights, PSQTBuckets * InputDimensions);
 
       return !stream.fail();
     }
 
+    // Reset an accumulator cache to the empty board state of this net
+    void clear_cache(AccumulatorCache& cache) const {
+      cache.clear(biases);
+    }
+
+    // Bring the accumulators of the position up to date, for both perspectives
+    void update_accumulators(const Position& pos, AccumulatorStack& stack, AccumulatorCache& cache) const {
+      update_accumulator(pos, WHITE, stack, cache);
+      update_accumulator(pos, BLACK, stack, cache);
+    }
+
     // Convert input features
-    std::int32_t transform(const Position& pos, OutputType* output, int bucket) const {
-      update_accumulator(pos, WHITE);
-      update_accumulator(pos, BLACK);
+    std::int32_t transform(const Position& pos, AccumulatorStack& stack, AccumulatorCache& cache,
+                           OutputType* output, int bucket) const {
+      update_accumulators(pos, stack, cache);
 
       const Color perspectives[2] = {pos.side_to_move(), ~pos.side_to_move()};
-      const auto& accumulation = pos.state()->accumulator.accumulation;
-      const auto& psqtAccumulation = pos.state()->accumulator.psqtAccumulation;
+      const Accumulator& accumulator = stack.get(pos.state());
+      const auto& accumulation = accumulator.accumulation;
+      const auto& psqtAccumulation = accumulator.psqtAccumulation;
 
       const auto psqt = (
             psqtAccumulation[perspectives[0]][bucket]
@@ -338,7 +394,138 @@ namespace Stockfish::Eval::NNUE {
 
 
    private:
-    void update_accumulator(const Position& pos, const Color perspective) const {
+    // Permute a row of HalfDimensions values, from the order of the net to the
+    // one expected by vec_msb_pack_16() if toSimd is set, or back otherwise.
+    static void permute(std::int16_t* row, bool toSimd) {
+
+      constexpr IndexType ChunkSize = 8;
+      constexpr IndexType NumChunks = sizeof(PackusEpi16Order) / sizeof(PackusEpi16Order[0]);
+      constexpr IndexType BlockSize = ChunkSize * NumChunks;
+      static_assert(HalfDimensions % BlockSize == 0);
+
+      if constexpr (NumChunks == 1)
+          return;
+
+      std::int16_t block[BlockSize];
+
+      for (IndexType i = 0; i < HalfDimensions; i += BlockSize)
+      {
+          for (IndexType j = 0; j < NumChunks; ++j)
+              if (toSimd)
+                  std::memcpy(&block[j * ChunkSize], &row[i + PackusEpi16Order[j] * ChunkSize], ChunkSize * 2);
+              else
+                  std::memcpy(&block[PackusEpi16Order[j] * ChunkSize], &row[i + j * ChunkSize], ChunkSize * 2);
+
+          std::memcpy(&row[i], block, sizeof(block));
+      }
+    }
+
+    using FusedKernel = void (FeatureTransformer::*)(const Accumulator&, Accumulator&, Color,
+        const FeatureSet::IndexList&, const FeatureSet::IndexList&) const;
+
+    // Apply the feature changes of one move to an accumulator in a single pass,
+    // adding and subtracting all the weight columns in registers. The number of
+    // added and removed features is known at compile time, so that the loops
+    // over the features are fully unrolled.
+    template<int NumAdded, int NumRemoved>
+    void update_fused(const Accumulator& from, Accumulator& to, const Color perspective,
+                      const FeatureSet::IndexList& added, const FeatureSet::IndexList& removed) const {
+
+      const WeightType* addedColumns[std::max(NumAdded, 1)];
+      const WeightType* removedColumns[std::max(NumRemoved, 1)];
+      const PSQTWeightType* addedPsqt[std::max(NumAdded, 1)];
+      const PSQTWeightType* removedPsqt[std::max(NumRemoved, 1)];
+
+      for (int i = 0; i < NumAdded; ++i)
+      {
+        addedColumns[i] = &weights[HalfDimensions * added[i]];
+        addedPsqt[i] = &psqtWeights[PSQTBuckets * added[i]];
+      }
+
+      for (int i = 0; i < NumRemoved; ++i)
+      {
+        removedColumns[i] = &weights[HalfDimensions * removed[i]];
+        removedPsqt[i] = &psqtWeights[PSQTBuckets * removed[i]];
+      }
+
+  #ifdef VECTOR
+      vec_t acc[FusedRegs];
+
+      for (IndexType j = 0; j < HalfDimensions / FusedTileHeight; ++j)
+      {
+        auto in  = reinterpret_cast<const vec_t*>(&from.accumulation[perspective][j * FusedTileHeight]);
+        auto out = reinterpret_cast<      vec_t*>(&to.accumulation[perspective][j * FusedTileHeight]);
+
+        for (IndexType k = 0; k < FusedRegs; ++k)
+          acc[k] = vec_load(&in[k]);
+
+        for (int i = 0; i < NumAdded; ++i)
+        {
+          auto column = reinterpret_cast<const vec_t*>(&addedColumns[i][j * FusedTileHeight]);
+          for (IndexType k = 0; k < FusedRegs; ++k)
+            acc[k] = vec_add_16(acc[k], column[k]);
+        }
+
+        for (int i = 0; i < NumRemoved; ++i)
+        {
+          auto column = reinterpret_cast<const vec_t*>(&removedColumns[i][j * FusedTileHeight]);
+          for (IndexType k = 0; k < FusedRegs; ++k)
+            acc[k] = vec_sub_16(acc[k], column[k]);
+        }
+
+        for (IndexType k = 0; k < FusedRegs; ++k)
+          vec_store(&out[k], acc[k]);
+      }
+
+      auto inPsqt  = reinterpret_cast<const psqt_vec_t*>(from.psqtAccumulation[perspective]);
+      auto outPsqt = reinterpret_cast<      psqt_vec_t*>(to.psqtAccumulation[perspective]);
+
+      for (IndexType k = 0; k < PSQTBuckets * sizeof(PSQTWeightType) / sizeof(psqt_vec_t); ++k)
+      {
+        psqt_vec_t v = vec_load_psqt(&inPsqt[k]);
+        for (int i = 0; i < NumAdded; ++i)
+          v = vec_add_psqt_32(v, reinterpret_cast<const psqt_vec_t*>(addedPsqt[i])[k]);
+        for (int i = 0; i < NumRemoved; ++i)
+          v = vec_sub_psqt_32(v, reinterpret_cast<const psqt_vec_t*>(removedPsqt[i])[k]);
+        vec_store_psqt(&outPsqt[k], v);
+      }
+  #else
+      for (IndexType j = 0; j < HalfDimensions; ++j)
+      {
+        BiasType v = from.accumulation[perspective][j];
+        for (int i = 0; i < NumAdded; ++i)
+          v += addedColumns[i][j];
+        for (int i = 0; i < NumRemoved; ++i)
+          v -= removedColumns[i][j];
+        to.accumulation[perspective][j] = v;
+      }
+
+      for (std::size_t k = 0; k < PSQTBuckets; ++k)
+      {
+        PSQTWeightType v = from.psqtAccumulation[perspective][k];
+        for (int i = 0; i < NumAdded; ++i)
+          v += addedPsqt[i][k];
+        for (int i = 0; i < NumRemoved; ++i)
+          v -= removedPsqt[i][k];
+        to.psqtAccumulation[perspective][k] = v;
+      }
+  #endif
+    }
+
+    // The fused kernel for the given numbers of added and removed features, or
+    // nullptr if there is none. They cover the null moves, the quiet moves and
+    // the promotions, the captures and en passant, and castling.
+    static FusedKernel fused_kernel(std::size_t numAdded, std::size_t numRemoved) {
+
+      return numAdded == 0 && numRemoved == 0 ? &FeatureTransformer::update_fused<0, 0>
+           : numAdded == 1 && numRemoved == 1 ? &FeatureTransformer::update_fused<1, 1>
+           : numAdded == 1 && numRemoved == 2 ? &FeatureTransformer::update_fused<1, 2>
+           : numAdded == 2 && numRemoved == 2 ? &FeatureTransformer::update_fused<2, 2>
+                                              : nullptr;
+    }
+
+    void update_accumulator(const Position& pos, const Color perspective,
+                            AccumulatorStack& stack, AccumulatorCache& cache) const {
 
       // The size must be enough to contain the largest possible update.
       // That might depend on the feature set and generally relies on the
@@ -354,171 +541,229 @@ namespace Stockfish::Eval::NNUE {
 
       // Look for a usable accumulator of an earlier position. We keep track
       // of the estimated gain in terms of features to be added/subtracted.
-      StateInfo *st = pos.state(), *next = nullptr;
+      // A state without an entry in the stack can not be used as a starting
+      // point, but the walk may go past it using its dirty pieces.
+      StateInfo *st = pos.state();
+      StateInfo* chain[MaxChainLength];
+      int length = 0;
+      Accumulator* source = stack.find(st);
       int gain = FeatureSet::refresh_cost(pos);
-      while (st->previous && !st->accumulator.computed[perspective])
+      while (st->previous && !(source && source->computed[perspective]))
       {
         // This governs when a full feature refresh is needed and how many
         // updates are better than just one full refresh.
         if (   FeatureSet::requires_refresh(st, perspective)
-            || (gain -= FeatureSet::update_cost(st) + 1) < 0)
+            || (gain -= FeatureSet::update_cost(st) + 1) < 0
+            || length == MaxChainLength)
           break;
-        next = st;
+        chain[length++] = st;
         st = st->previous;
+        source = stack.find(st);
       }
 
-      if (st->accumulator.computed[perspective])
+      if (source && source->computed[perspective])
       {
-        if (next == nullptr)
+        if (length == 0)
           return;
 
-        // Update incrementally in two steps. First, we update the "next"
-        // accumulator. Then, we update the current accumulator (pos.state()).
+        // Update incrementally, one state after the other from the oldest one
+        // of the chain up to the current position. The accumulator of every
+        // state along the way is stored, so that the siblings and the other
+        // descendants of these states, searched next, start from them instead
+        // of walking the same chain of updates again.
 
-        // Gather all features to be updated.
+        // Gather the features to be updated, and the accumulators, oldest first
         const Square ksq = pos.square<KING>(perspective);
-        FeatureSet::IndexList removed[2], added[2];
-        FeatureSet::append_changed_indices(
-          ksq, next->dirtyPiece, perspective, removed[0], added[0]);
-        for (StateInfo *st2 = pos.state(); st2 != next; st2 = st2->previous)
+        FeatureSet::IndexList removed[MaxChainLength], added[MaxChainLength];
+        Accumulator* accumulators[MaxChainLength];
+        for (int i = 0; i < length; ++i)
+        {
+          const StateInfo* state = chain[length - 1 - i];
           FeatureSet::append_changed_indices(
-            ksq, st2->dirtyPiece, perspective, removed[1], added[1]);
+            ksq, state->dirtyPiece, perspective, removed[i], added[i]);
+          accumulators[i] = &stack.get(state);
+          accumulators[i]->computed[perspective] = true;
+        }
 
-        // Mark the accumulators as computed.
-        next->accumulator.computed[perspective] = true;
-        pos.state()->accumulator.computed[perspective] = true;
+        // The usual moves are applied with fused kernels, see update_fused()
+        bool fused = true;
+        for (int i = 0; i < length; ++i)
+          fused &= fused_kernel(added[i].size(), removed[i].size()) != nullptr;
 
-        // Now update the accumulators listed in states_to_update[], where the last element is a sentinel.
-        StateInfo *states_to_update[3] =
-          { next, next == pos.state() ? nullptr : pos.state(), nullptr };
-  #ifdef VECTOR
-        for (IndexType j = 0; j < HalfDimensions / TileHeight; ++j)
+        if (fused)
         {
-          // Load accumulator
-          auto accTile = reinterpret_cast<vec_t*>(
-            &st->accumulator.accumulation[perspective][j * TileHeight]);
-          for (IndexType k = 0; k < NumRegs; ++k)
-            acc[k] = vec_load(&accTile[k]);
-
-          for (IndexType i = 0; states_to_update[i]; ++i)
+          const Accumulator* from = source;
+          for (int i = 0; i < length; ++i)
           {
-            // Difference calculation for the deactivated features
-            for (const auto index : removed[i])
-            {
-              const IndexType offset = HalfDimensions * index + j * TileHeight;
-              auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
-              for (IndexType k = 0; k < NumRegs; ++k)
-                acc[k] = vec_sub_16(acc[k], column[k]);
-            }
+            (this->*fused_kernel(added[i].size(), removed[i].size()))(
+              *from, *accumulators[i], perspective, added[i], removed[i]);
+            from = accumulators[i];
+          }
+        }
+        else
+        {
+  #ifdef VECTOR
+          for (IndexType j = 0; j < HalfDimensions / TileHeight; ++j)
+          {
+            // Load accumulator
+            auto accTile = reinterpret_cast<vec_t*>(
+              &source->accumulation[perspective][j * TileHeight]);
+            for (IndexType k = 0; k < NumRegs; ++k)
+              acc[k] = vec_load(&accTile[k]);
 
-            // Difference calculation for the activated features
-            for (const auto index : added[i])
+            for (int i = 0; i < length; ++i)
             {
-              const IndexType offset = HalfDimensions * index + j * TileHeight;
-              auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
+              // Difference calculation for the deactivated features
+              for (const auto index : removed[i])
+              {
+                const IndexType offset = HalfDimensions * index + j * TileHeight;
+                auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
+                for (IndexType k = 0; k < NumRegs; ++k)
+                  acc[k] = vec_sub_16(acc[k], column[k]);
+              }
+
+              // Difference calculation for the activated features
+              for (const auto index : added[i])
+              {
+                const IndexType offset = HalfDimensions * index + j * TileHeight;
+                auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
+                for (IndexType k = 0; k < NumRegs; ++k)
+                  acc[k] = vec_add_16(acc[k], column[k]);
+              }
+
+              // Store accumulator
+              accTile = reinterpret_cast<vec_t*>(
+                &accumulators[i]->accumulation[perspective][j * TileHeight]);
               for (IndexType k = 0; k < NumRegs; ++k)
-                acc[k] = vec_add_16(acc[k], column[k]);
+                vec_store(&accTile[k], acc[k]);
             }
-
-            // Store accumulator
-            accTile = reinterpret_cast<vec_t*>(
-              &states_to_update[i]->accumulator.accumulation[perspective][j * TileHeight]);
-            for (IndexType k = 0; k < NumRegs; ++k)
-              vec_store(&accTile[k], acc[k]);
           }
-        }
 
-        for (IndexType j = 0; j < PSQTBuckets / PsqtTileHeight; ++j)
-        {
-          // Load accumulator
-          auto accTilePsqt = reinterpret_cast<psqt_vec_t*>(
-            &st->accumulator.psqtAccumulation[perspective][j * PsqtTileHeight]);
-          for (std::size_t k = 0; k < NumPsqtRegs; ++k)
-            psqt[k] = vec_load_psqt(&accTilePsqt[k]);
-
-          for (IndexType i = 0; states_to_update[i]; ++i)
+          for (IndexType j = 0; j < PSQTBuckets / PsqtTileHeight; ++j)
           {
-            // Difference calculation for the deactivated features
-            for (const auto index : removed[i])
-            {
-              const IndexType offset = PSQTBuckets * index + j * PsqtTileHeight;
-              auto columnPsqt = reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
-              for (std::size_t k = 0; k < NumPsqtRegs; ++k)
-                psqt[k] = vec_sub_psqt_32(psqt[k], columnPsqt[k]);
-            }
+            // Load accumulator
+            auto accTilePsqt = reinterpret_cast<psqt_vec_t*>(
+              &source->psqtAccumulation[perspective][j * PsqtTileHeight]);
+            for (std::size_t k = 0; k < NumPsqtRegs; ++k)
+              psqt[k] = vec_load_psqt(&accTilePsqt[k]);
 
-            // Difference calculation for the activated features
-            for (const auto index : added[i])
+            for (int i = 0; i < length; ++i)
             {
-              const IndexType offset = PSQTBuckets * index + j * PsqtTileHeight;
-              auto columnPsqt = reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
+              // Difference calculation for the deactivated features
+              for (const auto index : removed[i])
+              {
+                const IndexType offset = PSQTBuckets * index + j * PsqtTileHeight;
+                auto columnPsqt = reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
+                for (std::size_t k = 0; k < NumPsqtRegs; ++k)
+                  psqt[k] = vec_sub_psqt_32(psqt[k], columnPsqt[k]);
+              }
+
+              // Difference calculation for the activated features
+              for (const auto index : added[i])
+              {
+                const IndexType offset = PSQTBuckets * index + j * PsqtTileHeight;
+                auto columnPsqt = reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
+                for (std::size_t k = 0; k < NumPsqtRegs; ++k)
+                  psqt[k] = vec_add_psqt_32(psqt[k], columnPsqt[k]);
+              }
+
+              // Store accumulator
+              accTilePsqt = reinterpret_cast<psqt_vec_t*>(
+                &accumulators[i]->psqtAccumulation[perspective][j * PsqtTileHeight]);
               for (std::size_t k = 0; k < NumPsqtRegs; ++k)
-                psqt[k] = vec_add_psqt_32(psqt[k], columnPsqt[k]);
+                vec_store_psqt(&accTilePsqt[k], psqt[k]);
             }
-
-            // Store accumulator
-            accTilePsqt = reinterpret_cast<psqt_vec_t*>(
-              &states_to_update[i]->accumulator.psqtAccumulation[perspective][j * PsqtTileHeight]);
-            for (std::size_t k = 0; k < NumPsqtRegs; ++k)
-              vec_store_psqt(&accTilePsqt[k], psqt[k]);
           }
-        }
 
   #else
-        for (IndexType i = 0; states_to_update[i]; ++i)
-        {
-          std::memcpy(states_to_update[i]->accumulator.accumulation[perspective],
-              st->accumulator.accumulation[perspective],
-              HalfDimensions * sizeof(BiasType));
+          for (int i = 0; i < length; ++i)
+          {
+            std::memcpy(accumulators[i]->accumulation[perspective],
+                source->accumulation[perspective],
+                HalfDimensions * sizeof(BiasType));
 
-          for (std::size_t k = 0; k < PSQTBuckets; ++k)
-            states_to_update[i]->accumulator.psqtAccumulation[perspective][k] = st->accumulator.psqtAccumulation[perspective][k];
+            for (std::size_t k = 0; k < PSQTBuckets; ++k)
+              accumulators[i]->psqtAccumulation[perspective][k] = source->psqtAccumulation[perspective][k];
 
-          st = states_to_update[i];
+            source = accumulators[i];
 
-          // Difference calculation for the deactivated features
-          for (const auto index : removed[i])
-          {
-            const IndexType offset = HalfDimensions * index;
+            // Difference calculation for the deactivated features
+            for (const auto index : removed[i])
+            {
+              const IndexType offset = HalfDimensions * index;
 
-            for (IndexType j = 0; j < HalfDimensions; ++j)
-              st->accumulator.accumulation[perspective][j] -= weights[offset + j];
+              for (IndexType j = 0; j < HalfDimensions; ++j)
+                source->accumulation[perspective][j] -= weights[offset + j];
 
-            for (std::size_t k = 0; k < PSQTBuckets; ++k)
-              st->accumulator.psqtAccumulation[perspective][k] -= psqtWeights[index * PSQTBuckets + k];
-          }
+              for (std::size_t k = 0; k < PSQTBuckets; ++k)
+                source->psqtAccumulation[perspective][k] -= psqtWeights[index * PSQTBuckets + k];
+            }
 
-          // Difference calculation for the activated features
-          for (const auto index : added[i])
-          {
-            const IndexType offset = HalfDimensions * index;
+            // Difference calculation for the activated features
+            for (const auto index : added[i])
+            {
+              const IndexType offset = HalfDimensions * index;
 
-            for (IndexType j = 0; j < HalfDimensions; ++j)
-              st->accumulator.accumulation[perspective][j] += weights[offset + j];
+              for (IndexType j = 0; j < HalfDimensions; ++j)
+                source->accumulation[perspective][j] += weights[offset + j];
 
-            for (std::size_t k = 0; k < PSQTBuckets; ++k)
-              st->accumulator.psqtAccumulation[perspective][k] += psqtWeights[index * PSQTBuckets + k];
+              for (std::size_t k = 0; k < PSQTBuckets; ++k)
+                source->psqtAccumulation[perspective][k] += psqtWeights[index * PSQTBuckets + k];
+            }
           }
-        }
   #endif
+        }
       }
       else
       {
-        // Refresh the accumulator
-        auto& accumulator = pos.state()->accumulator;
+        // Refresh the accumulator, starting from the cached accumulator for the
+        // same king square and applying only the pieces that have changed since.
+        auto& accumulator = stack.get(pos.state());
         accumulator.computed[perspective] = true;
-        FeatureSet::IndexList active;
-        FeatureSet::append_active_indices(pos, perspective, active);
+
+        const Square ksq = pos.square<KING>(perspective);
+        auto& entry = cache.entry[ksq][perspective];
+        FeatureSet::IndexList removed, added;
+
+        for (Color c : { WHITE, BLACK })
+            for (PieceType pt = PAWN; pt <= KING; ++pt)
+            {
+                const Piece pc = make_piece(c, pt);
+                const Bitboard oldBB = entry.byColorBB[c] & entry.byTypeBB[pt];
+                const Bitboard newBB = pos.pieces(c, pt);
+                Bitboard toRemove = oldBB & ~newBB;
+                Bitboard toAdd    = newBB & ~oldBB;
+
+                while (toRemove)
+                    removed.push_back(FeatureSet::make_index(perspective, pop_lsb(toRemove), pc, ksq));
+                while (toAdd)
+                    added.push_back(FeatureSet::make_index(perspective, pop_lsb(toAdd), pc, ksq));
+            }
+
+        for (Color c : { WHITE, BLACK })
+            entry.byColorBB[c] = pos.pieces(c);
+
+        for (PieceType pt = PAWN; pt <= KING; ++pt)
+            entry.byTypeBB[pt] = pos.pieces(pt);
 
   #ifdef VECTOR
         for (IndexType j = 0; j < HalfDimensions / TileHeight; ++j)
         {
-          auto biasesTile = reinterpret_cast<const vec_t*>(
-              &biases[j * TileHeight]);
+          auto entryTile = reinterpret_cast<vec_t*>(
+              &entry.accumulation[j * TileHeight]);
           for (IndexType k = 0; k < NumRegs; ++k)
-            acc[k] = biasesTile[k];
+            acc[k] = vec_load(&entryTile[k]);
+
+          for (const auto index : removed)
+          {
+            const IndexType offset = HalfDimensions * index + j * TileHeight;
+            auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
 
-          for (const auto index : active)
+            for (unsigned k = 0; k < NumRegs; ++k)
+              acc[k] = vec_sub_16(acc[k], column[k]);
+          }
+
+          for (const auto index : added)
           {
             const IndexType offset = HalfDimensions * index + j * TileHeight;
             auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
@@ -530,15 +775,29 @@ namespace Stockfish::Eval::NNUE {
           auto accTile = reinterpret_cast<vec_t*>(
               &accumulator.accumulation[perspective][j * TileHeight]);
           for (unsigned k = 0; k < NumRegs; k++)
+          {
+            vec_store(&entryTile[k], acc[k]);
             vec_store(&accTile[k], acc[k]);
+          }
         }
 
         for (IndexType j = 0; j < PSQTBuckets / PsqtTileHeight; ++j)
         {
+          auto entryTilePsqt = reinterpret_cast<psqt_vec_t*>(
+              &entry.psqtAccumulation[j * PsqtTileHeight]);
           for (std::size_t k = 0; k < NumPsqtRegs; ++k)
-            psqt[k] = vec_zero_psqt();
+            psqt[k] = vec_load_psqt(&entryTilePsqt[k]);
+
+          for (const auto index : removed)
+          {
+            const IndexType offset = PSQTBuckets * index + j * PsqtTileHeight;
+            auto columnPsqt = reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
 
-          for (const auto index : active)
+            for (std::size_t k = 0; k < NumPsqtRegs; ++k)
+              psqt[k] = vec_sub_psqt_32(psqt[k], columnPsqt[k]);
+          }
+
+          for (const auto index : added)
           {
             const IndexType offset = PSQTBuckets * index + j * PsqtTileHeight;
             auto columnPsqt = reinterpret_cast<const psqt_vec_t*>(&psqtWeights[offset]);
@@ -548,28 +807,42 @@ namespace Stockfish::Eval::NNUE {
           }
 
           auto accTilePsqt = reinterpret_cast<psqt_vec_t*>(
-            &accumulator.psqtAccumulation[perspective][j * PsqtTileHeight]);
+              &accumulator.psqtAccumulation[perspective][j * PsqtTileHeight]);
           for (std::size_t k = 0; k < NumPsqtRegs; ++k)
+          {
+            vec_store_psqt(&entryTilePsqt[k], psqt[k]);
             vec_store_psqt(&accTilePsqt[k], psqt[k]);
+          }
         }
 
   #else
-        std::memcpy(accumulator.accumulation[perspective], biases,
-            HalfDimensions * sizeof(BiasType));
+        for (const auto index : removed)
+        {
+          const IndexType offset = HalfDimensions * index;
+
+          for (IndexType j = 0; j < HalfDimensions; ++j)
+            entry.accumulation[j] -= weights[offset + j];
 
-        for (std::size_t k = 0; k < PSQTBuckets; ++k)
-          accumulator.psqtAccumulation[perspective][k] = 0;
+          for (std::size_t k = 0; k < PSQTBuckets; ++k)
+            entry.psqtAccumulation[k] -= psqtWeights[index * PSQTBuckets + k];
+        }
 
-        for (const auto index : active)
+        for (const auto index : added)
         {
           const IndexType offset = HalfDimensions * index;
 
           for (IndexType j = 0; j < HalfDimensions; ++j)
-            accumulator.accumulation[perspective][j] += weights[offset + j];
+            entry.accumulation[j] += weights[offset + j];
 
           for (std::size_t k = 0; k < PSQTBuckets; ++k)
-            accumulator.psqtAccumulation[perspective][k] += psqtWeights[index * PSQTBuckets + k];
+            entry.psqtAccumulation[k] += psqtWeights[index * PSQTBuckets + k];
         }
+
+        std::memcpy(accumulator.accumulation[perspective], entry.accumulation,
+            HalfDimensions * sizeof(BiasType));
+
+        std::memcpy(accumulator.psqtAccumulation[perspective], entry.psqtAccumulation,
+            PSQTBuckets * sizeof(PSQTWeightType));
   #endif
       }
 
@@ -18,6 +18,8 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <iostream>
 
 #include "bitboard.h"
 #include "pawns.h"
@@ -202,24 +204,149 @@ namespace {
 namespace Pawns {
 
 
+SharedTable Shared; // Global object
+
+
+/// Table::resize() sets the size of the table to the largest power of two
+/// number of entries fitting in mbSize MB. Entries are kept if the size does
+/// not change, the counters of a ttstats build are reset.
+
+void Table::resize(size_t mbSize) {
+
+  size_t count = size_t(1) << msb(mbSize * 1024 * 1024 / sizeof(Entry));
+  if (count != table.size())
+      std::vector<Entry>(count).swap(table);
+
+#if defined(USE_TT_STATS)
+  probes = hits = sharedProbes = sharedHits = 0;
+#endif
+}
+
+
+/// SharedTable::resize() sets the size of the shared table in MB, a size of 0
+/// disables it. It must be called only while no search is running.
+
+void SharedTable::resize(size_t mbSize) {
+
+  aligned_large_pages_free(table);
+  table = nullptr;
+  entryCount = mbSize * 1024 * 1024 / sizeof(SharedEntry);
+
+  if (!entryCount)
+      return;
+
+  table = static_cast<SharedEntry*>(aligned_large_pages_alloc(entryCount * sizeof(SharedEntry)));
+  if (!table)
+  {
+      std::cerr << "Failed to allocate " << mbSize
+                << "MB for shared pawn hash." << std::endl;
+      exit(EXIT_FAILURE);
+  }
+
+  std::memset(table, 0, entryCount * sizeof(SharedEntry));
+}
+
+
+/// SharedTable::probe() copies the pawn structure data of the given key into
+/// the entry, if found. The slot is read once into a local copy that is then
+/// verified, so a concurrent save() can't change it between check and use.
+/// The pawn attacks, cheap to compute, are not stored and left to the caller.
+
+bool SharedTable::probe(Key key, Entry* e) const {
+
+  const SharedEntry se = *slot(key);
+
+  Key k = se.keyXor;
+  for (uint64_t d : se.data)
+      k ^= d;
+
+  if (k != key)
+      return false;
+
+  e->scores[WHITE]          = Score(int32_t(se.data[0]));
+  e->scores[BLACK]          = Score(int32_t(se.data[0] >> 32));
+  e->passedPawns[WHITE]     = se.data[1];
+  e->passedPawns[BLACK]     = se.data[2];
+  e->pawnAttacksSpan[WHITE] = se.data[3];
+  e->pawnAttacksSpan[BLACK] = se.data[4];
+  e->blockedCount           = int(se.data[5]);
+  return true;
+}
+
+
+/// SharedTable::save() stores the pawn structure data of an entry, always
+/// replacing the previous content of the slot.
+
+void SharedTable::save(Key key, const Entry* e) {
+
+  SharedEntry se;
+  se.data[0] = uint32_t(e->scores[WHITE]) | uint64_t(uint32_t(e->scores[BLACK])) << 32;
+  se.data[1] = e->passedPawns[WHITE];
+  se.data[2] = e->passedPawns[BLACK];
+  se.data[3] = e->pawnAttacksSpan[WHITE];
+  se.data[4] = e->pawnAttacksSpan[BLACK];
+  se.data[5] = uint64_t(e->blockedCount);
+  se.padding = 0;
+
+  se.keyXor = key;
+  for (uint64_t d : se.data)
+      se.keyXor ^= d;
+
+  *slot(key) = se;
+}
+
+
 /// Pawns::probe() looks up the current position's pawns configuration in
-/// the pawns hash table. It returns a pointer to the Entry if the position
-/// is found. Otherwise a new Entry is computed and stored there, so we don't
-/// have to recompute all when the same pawns configuration occurs again.
+/// the pawns hash table of the thread, then in the shared table if enabled.
+/// It returns a pointer to the Entry if the position is found. Otherwise a
+/// new Entry is computed and stored there, so we don't have to recompute all
+/// when the same pawns configuration occurs again.
 
 Entry* probe(const Position& pos) {
 
   Key key = pos.pawn_key();
-  Entry* e = pos.this_thread()->pawnsTable[key];
+  Table& table = pos.this_thread()->pawnsTable;
+  Entry* e = table[key];
+
+#if defined(USE_TT_STATS)
+  table.probes++;
+#endif
 
   if (e->key == key)
+  {
+#if defined(USE_TT_STATS)
+      table.hits++;
+#endif
       return e;
+  }
 
   e->key = key;
+
+  if (Shared.enabled())
+  {
+#if defined(USE_TT_STATS)
+      table.sharedProbes++;
+#endif
+
+      if (Shared.probe(key, e))
+      {
+#if defined(USE_TT_STATS)
+          table.sharedHits++;
+#endif
+          e->kingSquares[WHITE] = e->kingSquares[BLACK] = SQ_NONE;
+          e->pawnAttacks[WHITE] = pawn_attacks_bb<WHITE>(pos.pieces(WHITE, PAWN));
+          e->pawnAttacks[BLACK] = pawn_attacks_bb<BLACK>(pos.pieces(BLACK, PAWN));
+          return e;
+      }
+  }
+
   e->blockedCount = 0;
   e->scores[WHITE] = evaluate<WHITE>(pos, e);
   e->scores[BLACK] = evaluate<BLACK>(pos, e);
 
+  if (Shared.enabled())
+      Shared.save(key, e);
+
   return e;
 }
 
@@ -19,6 +19,8 @@
 #ifndef PAWNS_H_INCLUDED
 #define PAWNS_H_INCLUDED
 
+#include <vector>
+
 #include "misc.h"
 #include "position.h"
 #include "types.h"
@@ -61,7 +63,57 @@ struct Entry {
   int blockedCount;
 };
 
-typedef HashTable<Entry, 131072> Table;
+/// Pawns::Table is the pawn hash table of a thread, sized with the "Pawn Hash"
+/// UCI option. Its entries also cache the king safety of the thread's last
+/// lookups, so they are never shared with other threads.
+
+class Table {
+
+public:
+  void resize(size_t mbSize);
+  Entry* operator[](Key key) { return &table[(uint32_t)key & (table.size() - 1)]; }
+
+#if defined(USE_TT_STATS)
+  uint64_t probes = 0, hits = 0, sharedProbes = 0, sharedHits = 0;
+#endif
+
+private:
+  std::vector<Entry> table;
+};
+
+
+/// Pawns::SharedTable is an optional second level pawn hash table, sized with
+/// the "Shared Pawn Hash" UCI option and probed by all the threads when their
+/// own table misses, so that a pawn structure is evaluated only once by a
+/// search with many threads. Entries are written without locks: the pawn key
+/// is stored xored with all the data words, so an entry torn by concurrent
+/// writes never matches the probed key and is treated as a miss.
+
+class SharedTable {
+
+  struct SharedEntry {
+    Key keyXor;
+    uint64_t data[6];
+    uint64_t padding;
+  };
+
+  static_assert(sizeof(SharedEntry) == 64, "Unexpected SharedEntry size");
+
+public:
+ ~SharedTable() { aligned_large_pages_free(table); }
+  void resize(size_t mbSize);
+  bool enabled() const { return entryCount; }
+  bool probe(Key key, Entry* e) const;
+  void save(Key key, const Entry* e);
+
+private:
+  SharedEntry* slot(Key key) const { return &table[mul_hi64(key, entryCount)]; }
+
+  size_t entryCount = 0;
+  SharedEntry* table = nullptr;
+};
+
+extern SharedTable Shared;
 
 Entry* probe(const Position& pos);
 
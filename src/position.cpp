@@ -79,7 +79,6 @@ std::ostream& operator<<(std::ostream& os, const Position& pos) {
       && !pos.can_castle(ANY_CASTLING))
   {
       StateInfo st;
-      ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
       Position p;
       p.set(pos.fen(), pos.is_chess960(), &st, pos.this_thread());
@@ -363,9 +362,23 @@ void Position::set_state(StateInfo* si) const {
 
   si->key ^= Zobrist::castling[si->castlingRights];
 
+  si->materialKey = material_key(pieceCount);
+}
+
+
+/// Position::material_key() computes the material key of a material configuration,
+/// given by the number of pieces of each kind, like the one of a position with
+/// the same material. It is used to precompute the material table.
+
+Key Position::material_key(const int pieceCount[PIECE_NB]) {
+
+  Key key = 0;
+
   for (Piece pc : Pieces)
       for (int cnt = 0; cnt < pieceCount[pc]; ++cnt)
-          si->materialKey ^= Zobrist::psq[pc][cnt];
+          key ^= Zobrist::psq[pc][cnt];
+
+  return key;
 }
 
 
@@ -702,8 +715,7 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   ++st->pliesFromNull;
 
   // Used by NNUE
-  st->accumulator.computed[WHITE] = false;
-  st->accumulator.computed[BLACK] = false;
+  st->accumulatorIdx = st->previous->accumulatorIdx + 1;
   auto& dp = st->dirtyPiece;
   dp.dirty_num = 1;
 
@@ -768,10 +780,9 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
       if (type_of(m) == EN_PASSANT)
           board[capsq] = NO_PIECE;
 
-      // Update material hash key and prefetch access to materialTable
+      // Update material hash key
       k ^= Zobrist::psq[captured][capsq];
       st->materialKey ^= Zobrist::psq[captured][pieceCount[captured]];
-      prefetch(thisThread->materialTable[st->materialKey]);
 
       // Reset rule 50 counter
       st->rule50 = 0;
@@ -996,15 +1007,14 @@ void Position::do_null_move(StateInfo& newSt) {
   assert(!checkers());
   assert(&newSt != st);
 
-  std::memcpy(&newSt, st, offsetof(StateInfo, accumulator));
+  std::memcpy(&newSt, st, offsetof(StateInfo, dirtyPiece));
 
   newSt.previous = st;
   st = &newSt;
 
   st->dirtyPiece.dirty_num = 0;
   st->dirtyPiece.piece[0] = NO_PIECE; // Avoid checks in UpdateAccumulator()
-  st->accumulator.computed[WHITE] = false;
-  st->accumulator.computed[BLACK] = false;
+  st->accumulatorIdx = st->previous->accumulatorIdx + 1;
 
   if (st->epSquare != SQ_NONE)
   {
@@ -1319,7 +1329,6 @@ bool Position::pos_is_ok() const {
               assert(0 && "pos_is_ok: Bitboards");
 
   StateInfo si = *st;
-  ASSERT_ALIGNED(&si, Eval::NNUE::CacheLineSize);
 
   set_state(&si);
   if (std::memcmp(&si, st, sizeof(StateInfo)))
@@ -29,8 +29,6 @@
 #include "psqt.h"
 #include "types.h"
 
-#include "nnue/nnue_accumulator.h"
-
 namespace Stockfish {
 
 /// StateInfo struct stores information needed to restore a Position object to
@@ -59,8 +57,8 @@ struct StateInfo {
   int        repetition;
 
   // Used by NNUE
-  Eval::NNUE::Accumulator accumulator;
   DirtyPiece dirtyPiece;
+  int        accumulatorIdx;
 };
 
 
@@ -80,6 +78,7 @@ class Thread;
 class Position {
 public:
   static void init();
+  static Key material_key(const int pieceCount[PIECE_NB]);
 
   Position() = default;
   Position(const Position&) = delete;
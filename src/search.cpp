@@ -17,10 +17,14 @@
 */
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstring>   // For std::memset
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 
 #include "evaluate.h"
@@ -121,32 +125,245 @@ namespace {
   void update_all_stats(const Position& pos, Stack* ss, Move bestMove, Value bestValue, Value beta, Square prevSq,
                         Move* quietsSearched, int quietCount, Move* capturesSearched, int captureCount, Depth depth);
 
+  // PerftTable is an optional hash table for perft() keyed on perft_key() of
+  // the position and the remaining depth. Each bucket has a depth-preferred and an always
+  // replace slot, and entries are validated by xor-ing the key with the data
+  // so that the table can be shared by all the threads without locking. It is
+  // allocated at the start of each perft and freed when the perft returns.
+  class PerftTable {
+
+    struct Entry {
+      Key keyXor;
+      uint64_t data; // Node count in the upper 56 bits, depth in the lower 8
+    };
+
+    struct Bucket {
+      Entry entry[2];
+    };
+
+  public:
+    void resize(size_t mbSize) {
+
+      size_t count = mbSize * 1024 * 1024 / sizeof(Bucket);
+      if (count != table.size())
+          std::vector<Bucket>(count).swap(table);
+    }
+
+    void free() { std::vector<Bucket>().swap(table); }
+
+    bool probe(Key key, Depth depth, uint64_t& nodes) {
+
+      if (table.empty())
+          return false;
+
+      for (const Entry& e : bucket(key).entry)
+      {
+          uint64_t data = e.data;
+          if ((e.keyXor ^ data) == key && Depth(data & 0xFF) == depth)
+          {
+              nodes = data >> 8;
+              return true;
+          }
+      }
+      return false;
+    }
+
+    void store(Key key, Depth depth, uint64_t nodes) {
+
+      if (table.empty())
+          return;
+
+      Entry* e = bucket(key).entry;
+      uint64_t data = nodes << 8 | uint64_t(depth);
+
+      if (depth < Depth(e[0].data & 0xFF))
+          e++;
+
+      e->data = data;
+      e->keyXor = key ^ data;
+    }
+
+  private:
+    Bucket& bucket(Key key) { return table[mul_hi64(key, table.size())]; }
+
+    std::vector<Bucket> table;
+  };
+
+  PerftTable PerftTT;
+
+  // The key of a position for PerftTT. In Chess960 the castling rights of the
+  // position key do not tell which rook each right is for, so the squares of
+  // the castling rooks are mixed in.
+  Key perft_key(const Position& pos) {
+
+    uint64_t rooks = 0;
+
+    if (pos.is_chess960())
+        for (CastlingRights cr : { WHITE_OO, WHITE_OOO, BLACK_OO, BLACK_OOO })
+            rooks = rooks << 8 | (pos.can_castle(cr) ? pos.castling_rook_square(cr) + 1 : 0);
+
+    return rooks ? pos.key() ^ make_key(rooks) : pos.key();
+  }
+
+  // Root moves of the current perft, their node counts, and the index of the
+  // next root move to be picked up by a thread.
+  std::vector<Move> PerftMoves;
+  std::vector<uint64_t> PerftCounts;
+  std::atomic<size_t> PerftNext;
+
   // perft() is our utility to verify move generation. All the leaf nodes up
   // to the given depth are generated and counted, and the sum is returned.
-  template<bool Root>
   uint64_t perft(Position& pos, Depth depth) {
 
-    StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
+    if (depth == 1)
+        return MoveList<LEGAL>(pos).size();
 
-    uint64_t cnt, nodes = 0;
-    const bool leaf = (depth == 2);
+    uint64_t nodes = 0;
+    if (depth >= 3 && PerftTT.probe(perft_key(pos), depth, nodes))
+        return nodes;
+
+    StateInfo st;
 
     for (const auto& m : MoveList<LEGAL>(pos))
     {
-        if (Root && depth <= 1)
-            cnt = 1, nodes++;
+        pos.do_move(m, st);
+        nodes += perft(pos, depth - 1);
+        pos.undo_move(m);
+    }
+
+    if (depth >= 3)
+        PerftTT.store(perft_key(pos), depth, nodes);
+
+    return nodes;
+  }
+
+  // perft_worker() is run by every thread during a perft: root moves are
+  // picked up one at a time until all of them have been counted.
+  void perft_worker(Thread& th, Depth depth) {
+
+    StateInfo st;
+    size_t i;
+
+    while ((i = PerftNext++) < PerftMoves.size())
+    {
+        uint64_t cnt = 1;
+
+        if (depth > 1)
+        {
+            th.rootPos.do_move(PerftMoves[i], st);
+            cnt = perft(th.rootPos, depth - 1);
+            th.rootPos.undo_move(PerftMoves[i]);
+        }
+
+        PerftCounts[i] = cnt;
+    }
+  }
+
+  // BatchState is shared by all the threads during a batch analysis. Results
+  // are kept in 'pending' until all the earlier positions have been written,
+  // so that the output file follows the order of the input file.
+  struct BatchState {
+    std::mutex mutex;
+    std::ifstream in;
+    std::ofstream out;
+    size_t nextIn, nextOut;
+    uint64_t nodes;
+    std::map<size_t, std::string> pending;
+  };
+
+  BatchState Batch;
+
+  // batch_next() reads the next position of the batch, keeping only the FEN
+  // fields of an EPD record. Returns false when the input file is exhausted.
+  bool batch_next(std::string& fen, size_t& idx) {
+
+    std::lock_guard<std::mutex> lk(Batch.mutex);
+    std::string line;
+
+    while (std::getline(Batch.in, line))
+    {
+        fen = UCI::epd_to_fen(line);
+
+        if (fen.empty())
+            continue;
+
+        idx = Batch.nextIn++;
+        return true;
+    }
+    return false;
+  }
+
+  // batch_write() queues the result of a position and writes all the results
+  // that are now in input order.
+  void batch_write(size_t idx, const std::string& result, uint64_t nodes) {
+
+    std::lock_guard<std::mutex> lk(Batch.mutex);
+
+    Batch.pending[idx] = result;
+    Batch.nodes += nodes;
+
+    while (!Batch.pending.empty() && Batch.pending.begin()->first == Batch.nextOut)
+    {
+        Batch.out << Batch.pending.begin()->second << "\n";
+        Batch.pending.erase(Batch.pending.begin());
+        Batch.nextOut++;
+    }
+    Batch.out.flush();
+  }
+
+  // batch_worker() is run by every thread during a batch analysis: positions
+  // are read one at a time and each one is searched by this thread alone, up
+  // to the given depth, until the input file is exhausted or "stop" is received.
+  void batch_worker(Thread& th) {
+
+    std::string fen;
+    size_t idx = 0;
+
+    while (!Threads.stop && batch_next(fen, idx))
+    {
+        if (!UCI::valid_fen(fen))
+        {
+            batch_write(idx, fen + "; invalid FEN", 0);
+            continue;
+        }
+
+        Position& pos = th.rootPos;
+
+        pos.set(fen, Options["UCI_Chess960"], &th.rootState, &th);
+        th.rootMoves.clear();
+        for (const auto& m : MoveList<LEGAL>(pos))
+            th.rootMoves.emplace_back(m);
+
+        th.nodes = th.tbHits = th.nmpMinPly = th.bestMoveChanges = 0;
+        th.rootDepth = th.completedDepth = 0;
+
+        std::stringstream ss;
+        ss << pos.fen() << "; bestmove ";
+
+        if (th.rootMoves.empty())
+            ss << "(none) score " << UCI::value(pos.checkers() ? -VALUE_MATE : VALUE_DRAW)
+               << " depth 0 nodes 0";
         else
         {
-            pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - 1);
-            nodes += cnt;
-            pos.undo_move(m);
+            th.Thread::search();
+
+            if (Threads.stop)
+                break;
+
+            const RootMove& rm = th.rootMoves[0];
+
+            ss << UCI::move(rm.pv[0], pos.is_chess960())
+               << " score " << UCI::value(rm.score)
+               << " depth " << th.completedDepth
+               << " nodes " << th.nodes
+               << " pv";
+
+            for (Move m : rm.pv)
+                ss << " " << UCI::move(m, pos.is_chess960());
         }
-        if (Root)
-            sync_cout << UCI::move(m, pos.is_chess960()) << ": " << cnt << sync_endl;
+
+        batch_write(idx, ss.str(), th.nodes);
     }
-    return nodes;
   }
 
 } // namespace
@@ -181,8 +398,77 @@ void MainThread::search() {
 
   if (Limits.perft)
   {
-      nodes = perft<true>(rootPos, Limits.perft);
-      sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+      PerftTT.resize(size_t(Options["Perft Hash"]));
+      PerftMoves.clear();
+      for (const auto& m : MoveList<LEGAL>(rootPos))
+          PerftMoves.push_back(m);
+      PerftCounts.assign(PerftMoves.size(), 0);
+      PerftNext = 0;
+
+      Threads.start_searching(); // start non-main threads
+      perft_worker(*this, Limits.perft);
+      Threads.wait_for_search_finished();
+      PerftTT.free();
+
+      uint64_t total = 0;
+      for (size_t i = 0; i < PerftMoves.size(); ++i)
+      {
+          total += PerftCounts[i];
+          sync_cout << UCI::move(PerftMoves[i], rootPos.is_chess960()) << ": " << PerftCounts[i] << sync_endl;
+      }
+
+      TimePoint elapsed = now() - Limits.startTime + 1;
+
+      sync_cout << "\nNodes searched: " << total
+                << "\nNodes/second: "  << total * 1000 / elapsed << "\n" << sync_endl;
+
+      // do_move() has counted the interior nodes, report the leaf count instead
+      for (Thread* th : Threads)
+          th->nodes = 0;
+      nodes = total;
+      return;
+  }
+
+  if (Limits.batch())
+  {
+      Batch.in.open(Limits.epdFile);
+      Batch.out.open(Limits.outFile);
+
+      if (!Batch.in.is_open() || !Batch.out.is_open())
+      {
+          sync_cout << "info string Unable to open " << (Batch.in.is_open() ? Limits.outFile : Limits.epdFile) << sync_endl;
+          Batch.in.close();
+          Batch.out.close();
+          return;
+      }
+
+      Eval::NNUE::verify();
+
+      // The TT is aged once for the whole batch, before the workers share it.
+      // The tablebase globals are shared as well, so the root moves of the
+      // positions are not ranked, the tables are only probed in the tree.
+      TT.new_search();
+      Tablebases::rank_root_moves(rootPos, rootMoves, false);
+
+      Batch.nextIn = Batch.nextOut = 0;
+      Batch.nodes = 0;
+      Batch.pending.clear();
+
+      for (Thread* th : Threads)
+          if (th != this)
+              th->run_custom_job([th]{ batch_worker(*th); });
+
+      batch_worker(*this);
+      Threads.wait_for_search_finished();
+
+      Batch.in.close();
+      Batch.out.close();
+
+      TimePoint elapsed = now() - Limits.startTime + 1;
+
+      sync_cout << "\nPositions analysed: " << Batch.nextOut
+                << "\nNodes searched: "     << Batch.nodes
+                << "\nNodes/second: "       << Batch.nodes * 1000 / elapsed << "\n" << sync_endl;
       return;
   }
 
@@ -257,6 +543,12 @@ void MainThread::search() {
 
 void Thread::search() {
 
+  if (Limits.perft)
+  {
+      perft_worker(*this, Limits.perft);
+      return;
+  }
+
   // To allow access to (ss-7) up to (ss+2), the stack must be oversized.
   // The former is needed to allow update_continuation_histories(ss-1, ...),
   // which accesses its argument at ss-6, also near the root.
@@ -266,7 +558,8 @@ void Thread::search() {
   Value alpha, beta, delta;
   Move  lastBestMove = MOVE_NONE;
   Depth lastBestMoveDepth = 0;
-  MainThread* mainThread = (this == Threads.main() ? Threads.main() : nullptr);
+  // During a batch analysis every thread searches its own position
+  MainThread* mainThread = (this == Threads.main() && !Limits.batch() ? Threads.main() : nullptr);
   double timeReduction = 1, totBestMoveChanges = 0;
   Color us = rootPos.side_to_move();
   int iterIdx = 0;
@@ -314,7 +607,7 @@ void Thread::search() {
   // Iterative deepening loop until requested to stop or the target depth is reached
   while (   ++rootDepth < MAX_PLY
          && !Threads.stop
-         && !(Limits.depth && mainThread && rootDepth > Limits.depth))
+         && !(Limits.depth && (mainThread || Limits.batch()) && rootDepth > Limits.depth))
   {
       // Age out PV variability metric
       if (mainThread)
@@ -546,9 +839,10 @@ namespace {
 
     Move pv[MAX_PLY+1], capturesSearched[32], quietsSearched[64];
     StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
-    TTEntry* tte;
+    const TTEntry* tte; // Entry to read, see TranspositionTable::probe()
+    TTEntry* ttSlot;    // Entry to save to
+    TTEntry ttCopy;
     Key posKey;
     Move ttMove, move, excludedMove, bestMove;
     Depth extension, newDepth;
@@ -621,7 +915,7 @@ namespace {
     // position key in case of an excluded move.
     excludedMove = ss->excludedMove;
     posKey = excludedMove == MOVE_NONE ? pos.key() : pos.key() ^ make_key(excludedMove);
-    tte = TT.probe(posKey, ss->ttHit);
+    tte = TT.probe(posKey, ss->ttHit, ttSlot, ttCopy);
     ttValue = ss->ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove =  rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0]
             : ss->ttHit    ? tte->move() : MOVE_NONE;
@@ -699,9 +993,9 @@ namespace {
                 if (    b == BOUND_EXACT
                     || (b == BOUND_LOWER ? value >= beta : value <= alpha))
                 {
-                    tte->save(posKey, value_to_tt(value, ss->ply), ss->ttPv, b,
-                              std::min(MAX_PLY - 1, depth + 6),
-                              MOVE_NONE, VALUE_NONE);
+                    ttSlot->save(posKey, value_to_tt(value, ss->ply), ss->ttPv, b,
+                                 std::min(MAX_PLY - 1, depth + 6),
+                                 MOVE_NONE, VALUE_NONE);
 
                     return value;
                 }
@@ -751,7 +1045,7 @@ namespace {
 
         // Save static evaluation into transposition table
         if (!excludedMove)
-            tte->save(posKey, VALUE_NONE, ss->ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval);
+            ttSlot->save(posKey, VALUE_NONE, ss->ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval);
     }
 
     // Use static evaluation difference to improve quiet move ordering (~3 Elo)
@@ -870,7 +1164,7 @@ namespace {
         ss->ttPv = false;
 
         while ((move = mp.next_move()) != MOVE_NONE)
-            if (move != excludedMove && pos.legal(move))
+            if (move != excludedMove && (LegalMoveGen || pos.legal(move)))
             {
                 assert(pos.capture(move) || promotion_type(move) == QUEEN);
 
@@ -899,7 +1193,7 @@ namespace {
                     if ( !(ss->ttHit
                        && tte->depth() >= depth - 3
                        && ttValue != VALUE_NONE))
-                        tte->save(posKey, value_to_tt(value, ss->ply), ttPv,
+                        ttSlot->save(posKey, value_to_tt(value, ss->ply), ttPv,
                             BOUND_LOWER,
                             depth - 3, move, ss->staticEval);
                     return value;
@@ -976,12 +1270,14 @@ moves_loop: // When in check, search starts here
           continue;
 
       // Check for legality
-      if (!rootNode && !pos.legal(move))
+      if (!LegalMoveGen && !rootNode && !pos.legal(move))
           continue;
 
+      assert(pos.legal(move));
+
       ss->moveCount = ++moveCount;
 
-      if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000)
+      if (rootNode && thisThread == Threads.main() && !Limits.batch() && Time.elapsed() > 3000)
           sync_cout << "info depth " << depth
                     << " currmove " << UCI::move(move, pos.is_chess960())
                     << " currmovenumber " << moveCount + thisThread->pvIdx << sync_endl;
@@ -1368,10 +1664,10 @@ moves_loop: // When in check, search starts here
 
     // Write gathered information in transposition table
     if (!excludedMove && !(rootNode && thisThread->pvIdx))
-        tte->save(posKey, value_to_tt(bestValue, ss->ply), ss->ttPv,
-                  bestValue >= beta ? BOUND_LOWER :
-                  PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
-                  depth, bestMove, ss->staticEval);
+        ttSlot->save(posKey, value_to_tt(bestValue, ss->ply), ss->ttPv,
+                     bestValue >= beta ? BOUND_LOWER :
+                     PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
+                     depth, bestMove, ss->staticEval);
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1393,9 +1689,10 @@ moves_loop: // When in check, search starts here
 
     Move pv[MAX_PLY+1];
     StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
-    TTEntry* tte;
+    const TTEntry* tte; // Entry to read, see TranspositionTable::probe()
+    TTEntry* ttSlot;    // Entry to save to
+    TTEntry ttCopy;
     Key posKey;
     Move ttMove, move, bestMove;
     Depth ttDepth;
@@ -1428,7 +1725,7 @@ moves_loop: // When in check, search starts here
                                                   : DEPTH_QS_NO_CHECKS;
     // Transposition table lookup
     posKey = pos.key();
-    tte = TT.probe(posKey, ss->ttHit);
+    tte = TT.probe(posKey, ss->ttHit, ttSlot, ttCopy);
     ttValue = ss->ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove = ss->ttHit ? tte->move() : MOVE_NONE;
     pvHit = ss->ttHit && tte->is_pv();
@@ -1471,8 +1768,8 @@ moves_loop: // When in check, search starts here
         {
             // Save gathered info in transposition table
             if (!ss->ttHit)
-                tte->save(posKey, value_to_tt(bestValue, ss->ply), false, BOUND_LOWER,
-                          DEPTH_NONE, MOVE_NONE, ss->staticEval);
+                ttSlot->save(posKey, value_to_tt(bestValue, ss->ply), false, BOUND_LOWER,
+                             DEPTH_NONE, MOVE_NONE, ss->staticEval);
 
             return bestValue;
         }
@@ -1505,9 +1802,11 @@ moves_loop: // When in check, search starts here
       assert(is_ok(move));
 
       // Check for legality
-      if (!pos.legal(move))
+      if (!LegalMoveGen && !pos.legal(move))
           continue;
 
+      assert(pos.legal(move));
+
       givesCheck = pos.gives_check(move);
       capture = pos.capture(move);
 
@@ -1606,9 +1905,9 @@ moves_loop: // When in check, search starts here
     }
 
     // Save gathered info in transposition table
-    tte->save(posKey, value_to_tt(bestValue, ss->ply), pvHit,
-              bestValue >= beta ? BOUND_LOWER : BOUND_UPPER,
-              ttDepth, bestMove, ss->staticEval);
+    ttSlot->save(posKey, value_to_tt(bestValue, ss->ply), pvHit,
+                 bestValue >= beta ? BOUND_LOWER : BOUND_UPPER,
+                 ttDepth, bestMove, ss->staticEval);
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1897,7 +2196,6 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
 bool RootMove::extract_ponder_from_tt(Position& pos) {
 
     StateInfo st;
-    ASSERT_ALIGNED(&st, Eval::NNUE::CacheLineSize);
 
     bool ttHit;
 
@@ -1907,7 +2205,9 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
         return false;
 
     pos.do_move(pv[0], st);
-    TTEntry* tte = TT.probe(pos.key(), ttHit);
+    TTEntry* ttSlot;
+    TTEntry ttCopy;
+    const TTEntry* tte = TT.probe(pos.key(), ttHit, ttSlot, ttCopy);
 
     if (ttHit)
     {
@@ -1920,7 +2220,10 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
     return pv.size() > 1;
 }
 
-void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
+/// Tablebases::rank_root_moves() sets up the tablebase probes of the search and,
+/// unless probeRoot is false, ranks the root moves when the root is in the tables.
+
+void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves, bool probeRoot) {
 
     RootInTB = false;
     UseRule50 = bool(Options["Syzygy50MoveRule"]);
@@ -1936,7 +2239,9 @@ void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
         ProbeDepth = 0;
     }
 
-    if (Cardinality >= popcount(pos.pieces()) && !pos.can_castle(ANY_CASTLING))
+    if (   probeRoot
+        && Cardinality >= popcount(pos.pieces())
+        && !pos.can_castle(ANY_CASTLING))
     {
         // Rank moves using DTZ tables
         RootInTB = root_probe(pos, rootMoves);
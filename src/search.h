@@ -19,6 +19,7 @@
 #ifndef SEARCH_H_INCLUDED
 #define SEARCH_H_INCLUDED
 
+#include <string>
 #include <vector>
 
 #include "misc.h"
@@ -98,7 +99,12 @@ struct LimitsType {
     return time[WHITE] || time[BLACK];
   }
 
+  bool batch() const {
+    return !epdFile.empty();
+  }
+
   std::vector<Move> searchmoves;
+  std::string epdFile, outFile;
   TimePoint time[COLOR_NB], inc[COLOR_NB], npmsec, movetime, startTime;
   int movestogo, depth, mate, perft, infinite;
   int64_t nodes;
@@ -380,6 +380,19 @@ namespace Stockfish::Simd {
       acc = vpadalq_s16(acc, product);
     }
 
+    // Adds to each 32 bit lane of acc the dot product of the corresponding
+    // 4 bytes of a and b, like the x86 dpbusd instruction.
+    [[maybe_unused]] static void neon_m128_add_dpbusd_epi32(
+        int32x4_t& acc,
+        int8x16_t a, int8x16_t b) {
+
+      int32x4_t lo = vpaddlq_s16(vmull_s8(vget_low_s8(a), vget_low_s8(b)));
+      int32x4_t hi = vpaddlq_s16(vmull_s8(vget_high_s8(a), vget_high_s8(b)));
+      int32x4_t sum = vcombine_s32(vpadd_s32(vget_low_s32(lo), vget_high_s32(lo)),
+                                   vpadd_s32(vget_low_s32(hi), vget_high_s32(hi)));
+      acc = vaddq_s32(acc, sum);
+    }
+
 #endif
 
 }
@@ -57,6 +57,16 @@ Thread::~Thread() {
 
 void Thread::clear() {
 
+#if defined(USE_NNUE_CACHE)
+  evalCache.resize(size_t(Options["NNUE Cache"]));
+#endif
+  pawnsTable.resize(size_t(Options["Pawn Hash"]));
+  Eval::NNUE::clear_thread(*this);
+
+#if defined(USE_TT_STATS)
+  ttStats = TTStats();
+#endif
+
   counterMoves.fill(MOVE_NONE);
   mainHistory.fill(0);
   captureHistory.fill(0);
@@ -82,6 +92,20 @@ void Thread::start_searching() {
 }
 
 
+/// Thread::run_custom_job() wakes up the thread to execute the given function
+/// instead of a search, for instance to touch its memory from the thread itself.
+
+void Thread::run_custom_job(std::function<void()> f) {
+
+  wait_for_search_finished();
+
+  std::lock_guard<std::mutex> lk(mutex);
+  jobFunc = std::move(f);
+  searching = true;
+  cv.notify_one(); // Wake up the thread in idle_loop()
+}
+
+
 /// Thread::wait_for_search_finished() blocks on the condition variable
 /// until the thread has finished searching.
 
@@ -105,6 +129,20 @@ void Thread::idle_loop() {
   if (Options["Threads"] > 8)
       WinProcGroup::bindThisThread(idx);
 
+  // Under Linux bind the threads to single cpus, or else to the NUMA nodes,
+  // only when explicitly requested. This is done before the thread touches
+  // its history tables, so that on a first-touch system they are allocated
+  // on the local node.
+  if (!Threads.cpuOrder.empty())
+      Affinity::bind_to_cpu(Threads.cpuOrder[idx % Threads.cpuOrder.size()]);
+
+  else if (!(Options["NUMA Policy"] == "None"))
+      Numa::bindThisThread(idx);
+
+#if defined(USE_TT_STATS)
+  TranspositionTable::threadStats = &ttStats;
+#endif
+
   while (true)
   {
       std::unique_lock<std::mutex> lk(mutex);
@@ -117,7 +155,14 @@ void Thread::idle_loop() {
 
       lk.unlock();
 
-      search();
+      if (jobFunc)
+      {
+          std::function<void()> job = std::move(jobFunc);
+          jobFunc = nullptr;
+          job();
+      }
+      else
+          search();
   }
 }
 
@@ -137,6 +182,12 @@ void ThreadPool::set(size_t requested) {
 
   if (requested > 0)   // create new thread(s)
   {
+      Affinity::Mode mode = Options["Thread Affinity"] == "Cores"  ? Affinity::CORES
+                          : Options["Thread Affinity"] == "Socket" ? Affinity::SOCKET
+                          : Options["Thread Affinity"] == "List"   ? Affinity::LIST
+                                                                   : Affinity::NONE;
+      cpuOrder = Affinity::cpu_order(mode, Options["CPU List"]);
+
       push_back(new MainThread(0));
 
       while (size() < requested)
@@ -152,12 +203,12 @@ void ThreadPool::set(size_t requested) {
 }
 
 
-/// ThreadPool::clear() sets threadPool data to initial values
+/// ThreadPool::clear() sets threadPool data to initial values. Each thread
+/// clears its own data, so that memory is first touched by the thread using it.
 
 void ThreadPool::clear() {
 
-  for (Thread* th : *this)
-      th->clear();
+  run_on_all([](Thread& th) { th.clear(); });
 
   main()->callsCnt = 0;
   main()->bestPreviousScore = VALUE_INFINITE;
@@ -166,12 +217,27 @@ void ThreadPool::clear() {
 }
 
 
+/// ThreadPool::run_on_all() runs the given function on every thread, from the
+/// thread itself, and waits until all of them are done.
+
+void ThreadPool::run_on_all(std::function<void(Thread&)> f) {
+
+  for (Thread* th : *this)
+      th->run_custom_job([th, f]() { f(*th); });
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
+}
+
+
 /// ThreadPool::start_thinking() wakes up main thread waiting in idle_loop() and
 /// returns immediately. Main thread will wake up other threads and start the search.
 
 void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
                                 const Search::LimitsType& limits, bool ponderMode) {
 
+  assert(Startup::finished()); // The UCI command must have called ready()
+
   main()->wait_for_search_finished();
 
   main()->stopOnPonderhit = stop = false;
@@ -21,6 +21,8 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -31,6 +33,8 @@
 #include "position.h"
 #include "search.h"
 #include "thread_win32_osx.h"
+#include "tt.h"
+#include "nnue/nnue_accumulator.h"
 
 namespace Stockfish {
 
@@ -45,6 +49,7 @@ class Thread {
   std::condition_variable cv;
   size_t idx;
   bool exit = false, searching = true; // Set before starting std::thread
+  std::function<void()> jobFunc;
   NativeThread stdThread;
 
 public:
@@ -54,11 +59,21 @@ public:
   void clear();
   void idle_loop();
   void start_searching();
+  void run_custom_job(std::function<void()> f);
   void wait_for_search_finished();
   size_t id() const { return idx; }
 
   Pawns::Table pawnsTable;
   Material::Table materialTable;
+  Eval::NNUE::AccumulatorStack<Eval::NNUE::TransformedFeatureDimensions> accumulatorStack;
+  Eval::NNUE::AccumulatorCache<Eval::NNUE::TransformedFeatureDimensions> accumulatorCache;
+  std::unique_ptr<Eval::NNUE::SmallNetAccumulators> smallNetAccumulators;
+#if defined(USE_NNUE_CACHE)
+  Eval::NNUE::EvalCache evalCache;
+#endif
+#if defined(USE_TT_STATS)
+  TTStats ttStats;
+#endif
   size_t pvIdx, pvLast;
   RunningAverage complexityAverage;
   std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
@@ -107,6 +122,7 @@ struct ThreadPool : public std::vector<Thread*> {
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
   void clear();
   void set(size_t);
+  void run_on_all(std::function<void(Thread&)> f);
 
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
@@ -116,6 +132,7 @@ struct ThreadPool : public std::vector<Thread*> {
   void wait_for_search_finished() const;
 
   std::atomic_bool stop, increaseDepth;
+  std::vector<int> cpuOrder; // Cpus the threads are bound to, empty if unbound
 
 private:
   StateListPtr setupStates;
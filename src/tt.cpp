@@ -16,10 +16,22 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm> // For std::max
+#include <cstdio>    // For std::remove and std::rename
 #include <cstring>   // For std::memset
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <thread>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "bitboard.h"
 #include "misc.h"
 #include "thread.h"
@@ -30,6 +42,78 @@ namespace Stockfish {
 
 TranspositionTable TT; // Our global transposition table
 
+#if defined(USE_TT_STATS)
+thread_local TTStats* TranspositionTable::threadStats = nullptr;
+#endif
+
+namespace {
+
+  // Header of a hash file, padded to a page so that when the file is mapped
+  // the cluster array that follows it is page aligned.
+  struct HashFileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t clusterSize;
+    uint64_t clusterCount;
+    uint8_t  generation8;
+  };
+
+  constexpr char     HashFileMagic[8]  = "SFHASH";
+  constexpr uint32_t HashFileVersion   = 2;
+  constexpr size_t   HashFileHeaderSize = 4096;
+
+  static_assert(sizeof(HashFileHeader) <= HashFileHeaderSize, "Hash file header too big");
+
+  // Placement of the table across the NUMA nodes, as set by the "NUMA Policy" option
+  Numa::Policy numa_policy() {
+
+    return Options["NUMA Policy"] == "Interleave" ? Numa::INTERLEAVE
+         : Options["NUMA Policy"] == "Partition"  ? Numa::PARTITION
+                                                  : Numa::NONE;
+  }
+
+} // namespace
+
+#if defined(USE_TT_XOR)
+
+/// TTEntry::save() populates the TTEntry with a new node's data, possibly
+/// overwriting an old position. Update is not atomic, but a racing write can
+/// only make the entry fail the key check of probe().
+
+void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
+
+  uint64_t old = data();
+  const bool samePosition = matches(k, old);
+
+  // Preserve any existing move for the same position
+  if (m || !samePosition)
+      old = (old & ~uint64_t(0xFFFF)) | uint16_t(m);
+
+  // Overwrite less valuable entries (cheapest checks first)
+  if (   b == BOUND_EXACT
+      || !samePosition
+      || d - DEPTH_OFFSET + 2 * pv > uint8_t(old >> 48) - 4)
+  {
+      assert(d > DEPTH_OFFSET);
+      assert(d < 256 + DEPTH_OFFSET);
+
+#if defined(USE_TT_STATS)
+      if (!samePosition)
+          TT.count_write(uint8_t(old >> 48), uint8_t(old >> 56));
+#endif
+
+      write(k,   uint64_t(uint16_t(old))
+               | uint64_t(uint16_t(v)) << 16
+               | uint64_t(uint16_t(ev)) << 32
+               | uint64_t(uint8_t(d - DEPTH_OFFSET)) << 48
+               | uint64_t(uint8_t(TT.generation8 | uint8_t(pv) << 2 | b)) << 56);
+  }
+  else
+      write(k, old);
+}
+
+#else
+
 /// TTEntry::save() populates the TTEntry with a new node's data, possibly
 /// overwriting an old position. Update is not atomic and can be racy.
 
@@ -47,6 +131,11 @@ void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev)
       assert(d > DEPTH_OFFSET);
       assert(d < 256 + DEPTH_OFFSET);
 
+#if defined(USE_TT_STATS)
+      if ((uint16_t)k != key16)
+          TT.count_write(depth8, genBound8);
+#endif
+
       key16     = (uint16_t)k;
       depth8    = (uint8_t)(d - DEPTH_OFFSET);
       genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
@@ -55,16 +144,72 @@ void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev)
   }
 }
 
+#endif
+
 
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
 /// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// With USE_LAZY_INIT the table is allocated and zeroed by a background thread,
+/// see wait_for_allocation(). The options it needs are read here, on the UCI
+/// thread, which may change them meanwhile. A table loaded from a hash file is
+/// kept if it has already the requested size, so that changing Threads or NUMA
+/// Policy after load_hash does not discard it.
 
 void TranspositionTable::resize(size_t mbSize) {
 
   Threads.main()->wait_for_search_finished();
 
-  aligned_large_pages_free(table);
+  wait_for_allocation();
+
+  if (loaded)
+  {
+      if (clusterCount * sizeof(Cluster) == mbSize * 1024 * 1024)
+          return;
+
+      sync_cout << "info string Discarding the hash loaded from file" << sync_endl;
+  }
+
+  const size_t threadCount = size_t(Options["Threads"]);
+  const Numa::Policy policy = numa_policy();
+
+  if (!Startup::Lazy)
+  {
+      allocate(mbSize, threadCount, policy);
+      return;
+  }
+
+  // Only the allocations started before Startup::finish() are part of the startup
+  const bool startup = !Startup::finished();
+
+  allocator = std::thread([this, mbSize, threadCount, policy, startup]() {
+
+      int64_t begin = Startup::elapsed();
+      allocate(mbSize, threadCount, policy);
+
+      if (startup)
+          Startup::record("Hash " + std::to_string(mbSize) + " MB", begin, Startup::elapsed(), true);
+  });
+}
+
+
+/// TranspositionTable::wait_for_allocation() waits for the background thread
+/// started by resize(), if any. The table must not be used before.
+
+void TranspositionTable::wait_for_allocation() {
+
+  if (allocator.joinable())
+      allocator.join();
+}
+
+
+/// TranspositionTable::allocate() replaces the table with a zeroed one of the
+/// given size, placed and zeroed as set by the given Threads and NUMA Policy
+
+void TranspositionTable::allocate(size_t mbSize, size_t threadCount, Numa::Policy policy) {
+
+  free();
+  loaded = false;
 
   clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
 
@@ -76,29 +221,199 @@ void TranspositionTable::resize(size_t mbSize) {
       exit(EXIT_FAILURE);
   }
 
-  clear();
+  // Spread the pages across the NUMA nodes before they are touched by zero()
+  if (policy == Numa::INTERLEAVE)
+      Numa::interleave(table, clusterCount * sizeof(Cluster));
+
+  zero(threadCount, policy);
+}
+
+
+/// TranspositionTable::free() releases the table, either allocated by resize()
+/// or mapped from a hash file by load().
+
+void TranspositionTable::free() {
+
+#ifndef _WIN32
+  if (mappedMem)
+  {
+      munmap(mappedMem, mappedSize);
+      mappedMem = nullptr;
+      table = nullptr;
+      return;
+  }
+#endif
+
+  aligned_large_pages_free(table);
+  table = nullptr;
+}
+
+
+/// TranspositionTable::save() writes the table, together with the current
+/// generation, to a hash file that can later be reloaded with load(). An
+/// existing file is only replaced once the new one is completely written.
+
+bool TranspositionTable::save(const std::string& fname) const {
+
+  Threads.main()->wait_for_search_finished();
+
+  HashFileHeader header{};
+  std::memcpy(header.magic, HashFileMagic, sizeof(header.magic));
+  header.version      = HashFileVersion;
+  header.clusterSize  = sizeof(Cluster);
+  header.clusterCount = clusterCount;
+  header.generation8  = generation8;
+
+  char page[HashFileHeaderSize] = {};
+  std::memcpy(page, &header, sizeof(header));
+
+  // The table may be mapped from the file being replaced, so it is written to
+  // a temporary file renamed over the old one at the end. The mapping keeps
+  // the old file alive until it is released.
+  const std::string tmpName = fname + ".tmp";
+  std::ofstream file(tmpName, std::ios::binary);
+  file.write(page, HashFileHeaderSize);
+  file.write(reinterpret_cast<const char*>(table), clusterCount * sizeof(Cluster));
+  file.close();
+
+  if (!file)
+  {
+      std::remove(tmpName.c_str());
+      return false;
+  }
+
+#ifdef _WIN32
+  std::remove(fname.c_str()); // rename() does not replace an existing file
+#endif
+
+  return std::rename(tmpName.c_str(), fname.c_str()) == 0;
+}
+
+
+/// TranspositionTable::load() replaces the table with the content of a hash
+/// file written by save(). The table takes the size stored in the file. Where
+/// available the file is mapped copy-on-write and used directly as the table,
+/// so that loading is near-instant and pages are read from disk on demand.
+
+bool TranspositionTable::load(const std::string& fname) {
+
+  Threads.main()->wait_for_search_finished();
+
+  HashFileHeader header;
+  std::ifstream file(fname, std::ios::binary | std::ios::ate);
+  const std::streamoff fileSize = file.tellg();
+
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+  if (   !file
+      || std::memcmp(header.magic, HashFileMagic, sizeof(header.magic))
+      || header.version != HashFileVersion
+      || header.clusterSize != sizeof(Cluster)
+      || header.clusterCount < 1000
+      || header.clusterCount > uint64_t(MaxHashMB) * 1024 * 1024 / sizeof(Cluster) // No overflow below
+      || fileSize != std::streamoff(HashFileHeaderSize + header.clusterCount * sizeof(Cluster)))
+      return false;
+
+  // The Hash option is set to the size of the loaded table, so that resize()
+  // keeps it. Refuse a size the option can not hold.
+  const uint64_t tableSize = header.clusterCount * sizeof(Cluster);
+
+  if (   tableSize % (1024 * 1024)
+      || tableSize / (1024 * 1024) > uint64_t(MaxHashMB))
+  {
+      sync_cout << "info string The hash in " << fname << " is not a whole number of MB"
+                << " between 1 and " << MaxHashMB << sync_endl;
+      return false;
+  }
+
+#ifndef _WIN32
+  file.close();
+
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd == -1)
+      return false;
+
+  void* mem = mmap(nullptr, size_t(fileSize), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (mem == MAP_FAILED)
+      return false;
+
+  free();
+
+  mappedMem    = mem;
+  mappedSize   = size_t(fileSize);
+  clusterCount = size_t(header.clusterCount);
+  table        = reinterpret_cast<Cluster*>(static_cast<char*>(mem) + HashFileHeaderSize);
+#else
+  free();
+
+  clusterCount = size_t(header.clusterCount);
+  table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
+  if (!table)
+  {
+      std::cerr << "Failed to allocate " << clusterCount * sizeof(Cluster) / (1024 * 1024)
+                << "MB for transposition table." << std::endl;
+      exit(EXIT_FAILURE);
+  }
+
+  file.seekg(HashFileHeaderSize);
+  file.read(reinterpret_cast<char*>(table), clusterCount * sizeof(Cluster));
+#endif
+
+  generation8 = header.generation8;
+  loaded = true;
+
+  // Make the Hash option match the loaded table, resize() then keeps the table
+  Options["Hash"] = std::to_string(clusterCount * sizeof(Cluster) / (1024 * 1024));
+
+  return true;
 }
 
 
-/// TranspositionTable::clear() initializes the entire transposition table to zero,
-//  in a multi-threaded way.
+/// TranspositionTable::clear() initializes the entire transposition table to zero
 
 void TranspositionTable::clear() {
 
+  wait_for_allocation();
+
+  if (loaded)
+  {
+      sync_cout << "info string Clearing the hash loaded from file" << sync_endl;
+      loaded = false;
+  }
+
+  zero(size_t(Options["Threads"]), numa_policy());
+}
+
+
+/// TranspositionTable::zero() clears the table in a multi-threaded way, using
+/// as many threads as the search. With the "Partition" NUMA policy each node
+/// zeroes, and so owns on a first-touch system, a contiguous slice of the table.
+
+void TranspositionTable::zero(size_t threadCount, Numa::Policy policy) {
+
   std::vector<std::thread> threads;
 
-  for (size_t idx = 0; idx < Options["Threads"]; ++idx)
+  const bool partition = policy == Numa::PARTITION;
+  const size_t zeroCount = partition ? std::max(threadCount, Numa::nodes()) : threadCount;
+
+  for (size_t idx = 0; idx < zeroCount; ++idx)
   {
-      threads.emplace_back([this, idx]() {
+      threads.emplace_back([this, idx, threadCount, zeroCount, partition]() {
 
           // Thread binding gives faster search on systems with a first-touch policy
-          if (Options["Threads"] > 8)
+          if (threadCount > 8)
               WinProcGroup::bindThisThread(idx);
 
+          if (partition)
+              Numa::bind_to_node(idx * Numa::nodes() / zeroCount);
+
           // Each thread will zero its part of the hash table
-          const size_t stride = size_t(clusterCount / Options["Threads"]),
+          const size_t stride = size_t(clusterCount / zeroCount),
                        start  = size_t(stride * idx),
-                       len    = idx != Options["Threads"] - 1 ?
+                       len    = idx != zeroCount - 1 ?
                                 stride : clusterCount - start;
 
           std::memset(&table[start], 0, len * sizeof(Cluster));
@@ -115,9 +430,83 @@ void TranspositionTable::clear() {
 /// Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
 /// to be replaced later. The replace value of an entry is calculated as its depth
 /// minus 8 times its relative age. TTEntry t1 is considered more valuable than
-/// TTEntry t2 if its replace value is greater than that of t2.
+/// TTEntry t2 if its replace value is greater than that of t2. With
+/// USE_TT_STATS the probe is also counted for the calling thread.
+///
+/// The entry in the table, to call save() on, is returned in 'slot'. The entry
+/// to read from is the same one, or with USE_TT_XOR 'copy', which holds the data
+/// word read and validated once by the probe.
+
+const TTEntry* TranspositionTable::probe(const Key key, bool& found, TTEntry*& slot, TTEntry& copy) const {
+
+#if defined(USE_TT_XOR)
+  slot = lookup(key, found, copy);
+  const TTEntry* const tte = &copy;
+#else
+  (void)copy;
+  const TTEntry* const tte = slot = lookup(key, found);
+#endif
+
+#if defined(USE_TT_STATS)
+  if (threadStats)
+  {
+      ++threadStats->probes;
+      if (found)
+      {
+          ++threadStats->hits;
+          ++threadStats->hitsByBound[tte->bound()];
+      }
+  }
+#endif
 
-TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
+  return tte;
+}
+
+
+/// TranspositionTable::lookup() implements probe() for the entry layout
+/// selected at compile time.
+
+#if defined(USE_TT_XOR)
+
+TTEntry* TranspositionTable::lookup(const Key key, bool& found, TTEntry& copy) const {
+
+  TTEntry* const tte = first_entry(key);
+
+  for (int i = 0; i < ClusterSize; ++i)
+  {
+      // Read the data word once, the key check validates it
+      uint64_t data = tte[i].data();
+
+      if (tte[i].matches(key, data) || !uint8_t(data >> 48))
+      {
+          // Refresh only a stale generation, as rewriting both words of the
+          // entry may undo a newer write of another thread.
+          const uint8_t genBound8 = uint8_t(generation8 | (uint8_t(data >> 56) & (GENERATION_DELTA - 1)));
+          if (genBound8 != uint8_t(data >> 56))
+          {
+              data = (data & ~(uint64_t(0xFF) << 56)) | uint64_t(genBound8) << 56;
+              tte[i].write(key, data);
+          }
+
+          copy.write(key, data);
+          return found = (bool)uint8_t(data >> 48), &tte[i];
+      }
+  }
+
+  // Find an entry to be replaced according to the replacement strategy
+  TTEntry* replace = tte;
+  for (int i = 1; i < ClusterSize; ++i)
+      if (  replace->depth8() - ((GENERATION_CYCLE + generation8 - replace->genBound8()) & GENERATION_MASK)
+          >   tte[i].depth8() - ((GENERATION_CYCLE + generation8 -   tte[i].genBound8()) & GENERATION_MASK))
+          replace = &tte[i];
+
+  copy.write(key, 0);
+  return found = false, replace;
+}
+
+#else
+
+TTEntry* TranspositionTable::lookup(const Key key, bool& found) const {
 
   TTEntry* const tte = first_entry(key);
   const uint16_t key16 = (uint16_t)key;  // Use the low 16 bits as key inside the cluster
@@ -145,18 +534,104 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
   return found = false, replace;
 }
 
+#endif
+
 
 /// TranspositionTable::hashfull() returns an approximation of the hashtable
 /// occupation during a search. The hash is x permill full, as per UCI protocol.
 
 int TranspositionTable::hashfull() const {
 
-  int cnt = 0;
-  for (int i = 0; i < 1000; ++i)
+  return int(occupied(1000, true) / ClusterSize);
+}
+
+
+/// TranspositionTable::occupied() counts the non-empty entries of the first
+/// 'clusters' clusters, or only those written during the current search.
+
+size_t TranspositionTable::occupied(size_t clusters, bool currentOnly) const {
+
+  size_t cnt = 0;
+  for (size_t i = 0; i < clusters; ++i)
       for (int j = 0; j < ClusterSize; ++j)
-          cnt += table[i].entry[j].depth8 && (table[i].entry[j].genBound8 & GENERATION_MASK) == generation8;
+      {
+#if defined(USE_TT_XOR)
+          const uint8_t depth8 = table[i].entry[j].depth8(), genBound8 = table[i].entry[j].genBound8();
+#else
+          const uint8_t depth8 = table[i].entry[j].depth8, genBound8 = table[i].entry[j].genBound8;
+#endif
+          cnt += depth8 && (!currentOnly || (genBound8 & GENERATION_MASK) == generation8);
+      }
 
-  return cnt / ClusterSize;
+  return cnt;
 }
 
+
+#if defined(USE_TT_STATS)
+
+/// TranspositionTable::count_write() counts, for the calling thread, a write
+/// of a new position into an entry with the given depth and generation.
+
+void TranspositionTable::count_write(uint8_t depth8, uint8_t genBound8) const {
+
+  if (threadStats)
+      ++(  !depth8                                         ? threadStats->emptyFills
+         : (genBound8 & GENERATION_MASK) == generation8 ? threadStats->sameGenReplaced
+                                                         : threadStats->staleReplaced);
+}
+
+#endif
+
+
+#if defined(USE_TT_STATS)
+
+/// TranspositionTable::stats() returns a report of the usage of the whole
+/// table and of the counters of all the search threads since they were last
+/// cleared. It scans the whole table, so it is only built with USE_TT_STATS.
+
+std::string TranspositionTable::stats() const {
+
+  std::stringstream ss;
+  const size_t entries = clusterCount * ClusterSize;
+
+  auto percent = [](uint64_t n, uint64_t total) {
+      std::stringstream p;
+      p << std::fixed << std::setprecision(1) << (total ? 100.0 * n / total : 0.0) << "%";
+      return p.str();
+  };
+
+  ss << "Entries             : " << entries
+     << "\nUsed                : " << percent(occupied(clusterCount, false), entries)
+     << "\nUsed this search    : " << percent(occupied(clusterCount, true), entries);
+
+  TTStats sum{};
+  for (Thread* th : Threads)
+  {
+      sum.probes          += th->ttStats.probes;
+      sum.hits            += th->ttStats.hits;
+      sum.emptyFills      += th->ttStats.emptyFills;
+      sum.sameGenReplaced += th->ttStats.sameGenReplaced;
+      sum.staleReplaced   += th->ttStats.staleReplaced;
+      for (int b = 0; b < 4; ++b)
+          sum.hitsByBound[b] += th->ttStats.hitsByBound[b];
+  }
+
+  const uint64_t writes = sum.emptyFills + sum.sameGenReplaced + sum.staleReplaced;
+
+  ss << "\nProbes              : " << sum.probes
+     << "\nHits                : " << sum.hits << " (" << percent(sum.hits, sum.probes) << ")"
+     << "\n  exact             : " << sum.hitsByBound[BOUND_EXACT]
+     << "\n  lower bound       : " << sum.hitsByBound[BOUND_LOWER]
+     << "\n  upper bound       : " << sum.hitsByBound[BOUND_UPPER]
+     << "\n  eval only         : " << sum.hitsByBound[BOUND_NONE]
+     << "\nNew positions       : " << writes
+     << "\n  empty slot        : " << sum.emptyFills << " (" << percent(sum.emptyFills, writes) << ")"
+     << "\n  replaced current  : " << sum.sameGenReplaced << " (" << percent(sum.sameGenReplaced, writes) << ")"
+     << "\n  replaced older    : " << sum.staleReplaced << " (" << percent(sum.staleReplaced, writes) << ")";
+
+  return ss.str();
+}
+
+#endif
+
 } // namespace Stockfish
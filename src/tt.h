@@ -19,11 +19,70 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <cstring>
+#include <string>
+#include <thread>
+
 #include "misc.h"
 #include "types.h"
 
 namespace Stockfish {
 
+#if defined(USE_TT_XOR)
+
+/// With USE_TT_XOR the TTEntry struct is 12 bytes: a 64 bit data word, defined
+/// as below, and a 32 bit check, the low 32 bits of the position key xored with
+/// both halves of the data word. An entry is only used if the check matches the
+/// probed key and the data word read, so that writes of other threads running
+/// concurrently, which may leave the check of one write with the data of another,
+/// can only produce a usable corrupted entry with a 2^-32 chance. For the same
+/// reason probe() hands out a copy of the validated data word to read from,
+/// the table entry itself being only written to.
+///
+/// move       16 bit
+/// value      16 bit
+/// eval value 16 bit
+/// depth       8 bit
+/// generation  5 bit
+/// pv node     1 bit
+/// bound type  2 bit
+
+struct TTEntry {
+
+  Move  move()  const { return (Move )uint16_t(data() >> 0); }
+  Value value() const { return (Value)int16_t(data() >> 16); }
+  Value eval()  const { return (Value)int16_t(data() >> 32); }
+  Depth depth() const { return (Depth)depth8() + DEPTH_OFFSET; }
+  bool is_pv()  const { return (bool)(genBound8() & 0x4); }
+  Bound bound() const { return (Bound)(genBound8() & 0x3); }
+  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev);
+
+private:
+  friend class TranspositionTable;
+
+  uint8_t depth8()    const { return uint8_t(data() >> 48); }
+  uint8_t genBound8() const { return uint8_t(data() >> 56); }
+
+  static uint32_t check(Key k, uint64_t d) { return uint32_t(k ^ d ^ (d >> 32)); }
+  bool matches(Key k, uint64_t d) const { return keyCheck == check(k, d); }
+
+  // The data word is only 4 byte aligned, so that 5 entries fit in a cache
+  // line: it starts at byte 4, 16, 28, 40 or 52 of the cluster, never crossing
+  // the line, and memcpy keeps the misaligned access well defined. On 64 bit
+  // targets it compiles to a single load or store, but nothing guarantees that
+  // one is atomic, nor that the check and the data word are written together.
+  // A read torn between two writes pairs the check or one half of the data word
+  // with another write, and since check() mixes in both halves of the data word
+  // the result then passes matches() only with a 2^-32 chance.
+  uint64_t data() const { uint64_t d; std::memcpy(&d, dataWords, sizeof(d)); return d; }
+  void write(Key k, uint64_t d) { std::memcpy(dataWords, &d, sizeof(d)); keyCheck = check(k, d); }
+
+  uint32_t keyCheck;
+  uint32_t dataWords[2];
+};
+
+#else
+
 /// TTEntry struct is the 10 bytes transposition table entry, defined as below:
 ///
 /// key        16 bit
@@ -56,6 +115,24 @@ private:
   int16_t  eval16;
 };
 
+#endif
+
+
+#if defined(USE_TT_STATS)
+
+/// TTStats holds the transposition table counters of one search thread. They
+/// are only compiled in with USE_TT_STATS and are reset by Thread::clear().
+
+struct TTStats {
+  uint64_t probes;
+  uint64_t hits;
+  uint64_t hitsByBound[4]; // Indexed by Bound
+  uint64_t emptyFills;     // Writes to an empty slot
+  uint64_t sameGenReplaced, staleReplaced; // Other position overwritten
+};
+
+#endif
+
 
 /// A TranspositionTable is an array of Cluster, of size clusterCount. Each
 /// cluster consists of ClusterSize number of TTEntry. Each non-empty TTEntry
@@ -65,6 +142,16 @@ private:
 
 class TranspositionTable {
 
+#if defined(USE_TT_XOR)
+  static constexpr int ClusterSize = 5;
+
+  struct Cluster {
+    TTEntry entry[ClusterSize];
+    char padding[4]; // Pad to 64 bytes
+  };
+
+  static_assert(sizeof(Cluster) == 64, "Unexpected Cluster size");
+#else
   static constexpr int ClusterSize = 3;
 
   struct Cluster {
@@ -73,6 +160,7 @@ class TranspositionTable {
   };
 
   static_assert(sizeof(Cluster) == 32, "Unexpected Cluster size");
+#endif
 
   // Constants used to refresh the hash table periodically
   static constexpr unsigned GENERATION_BITS  = 3;                                // nb of bits reserved for other things
@@ -81,23 +169,53 @@ class TranspositionTable {
   static constexpr int      GENERATION_MASK  = (0xFF << GENERATION_BITS) & 0xFF; // mask to pull out generation number
 
 public:
- ~TranspositionTable() { aligned_large_pages_free(table); }
+  static constexpr int MaxHashMB = Is64Bit ? 33554432 : 2048; // Maximum of the Hash option
+
+ ~TranspositionTable() { wait_for_allocation(); free(); }
   void new_search() { generation8 += GENERATION_DELTA; } // Lower bits are used for other things
-  TTEntry* probe(const Key key, bool& found) const;
+  const TTEntry* probe(const Key key, bool& found, TTEntry*& slot, TTEntry& copy) const;
   int hashfull() const;
   void resize(size_t mbSize);
   void clear();
+  void wait_for_allocation();
+  bool save(const std::string& fname) const;
+  bool load(const std::string& fname);
+#if defined(USE_TT_STATS)
+  std::string stats() const;
+#endif
 
   TTEntry* first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
   }
 
+#if defined(USE_TT_STATS)
+  // Counters of the calling thread, set by each search thread to its own
+  static thread_local TTStats* threadStats;
+#endif
+
 private:
   friend struct TTEntry;
 
+  void allocate(size_t mbSize, size_t threadCount, Numa::Policy policy);
+  void zero(size_t threadCount, Numa::Policy policy);
+#if defined(USE_TT_XOR)
+  TTEntry* lookup(const Key key, bool& found, TTEntry& copy) const;
+#else
+  TTEntry* lookup(const Key key, bool& found) const;
+#endif
+  size_t occupied(size_t clusters, bool currentOnly) const;
+  void free();
+#if defined(USE_TT_STATS)
+  void count_write(uint8_t depth8, uint8_t genBound8) const;
+#endif
+
   size_t clusterCount;
   Cluster* table;
+  void* mappedMem = nullptr; // Start of the hash file mapping, if any
+  size_t mappedSize;
+  bool loaded = false; // Table holds the content of a hash file
   uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+  std::thread allocator; // Allocates and zeroes the table with USE_LAZY_INIT
 };
 
 extern TranspositionTable TT;
@@ -16,8 +16,11 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -44,6 +47,17 @@ namespace {
   const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
 
+  // ready() finishes the initialization deferred with USE_LAZY_INIT and waits
+  // for the hash. Every command that may search, evaluate or use the hash must
+  // call it first, Search and NNUE assert that it has been called.
+
+  void ready() {
+
+    Startup::finish();
+    TT.wait_for_allocation();
+  }
+
+
   // position() is called when engine receives the "position" UCI command.
   // The function sets up the position described in the given FEN string ("fen")
   // or the starting position ("startpos") and then makes the moves given in the
@@ -83,6 +97,8 @@ namespace {
 
   void trace_eval(Position& pos) {
 
+    ready();
+
     StateListPtr states(new std::deque<StateInfo>(1));
     Position p;
     p.set(pos.fen(), Options["UCI_Chess960"], &states->back(), Threads.main());
@@ -110,6 +126,9 @@ namespace {
     while (is >> token)
         value += (value.empty() ? "" : " ") + token;
 
+    // Let the background allocation of the hash finish before any option changes
+    TT.wait_for_allocation();
+
     if (Options.count(name))
         Options[name] = value;
     else
@@ -123,6 +142,8 @@ namespace {
 
   void go(Position& pos, istringstream& is, StateListPtr& states) {
 
+    ready();
+
     Search::LimitsType limits;
     string token;
     bool ponderMode = false;
@@ -151,12 +172,179 @@ namespace {
   }
 
 
+  // analyse() is called when engine receives the "analyse" command. All the
+  // positions of an EPD/FEN file are searched to the given depth, each one by
+  // a single thread with all the threads running concurrently, and the results
+  // are written to the output file. As with "go", the batch runs in the
+  // background and "stop" ends it.
+
+  void analyse(Position& pos, istringstream& is, StateListPtr& states) {
+
+    ready();
+
+    Search::LimitsType limits;
+    string token;
+
+    limits.startTime = now();
+    limits.depth = 13;
+
+    is >> limits.epdFile >> limits.outFile;
+
+    while (is >> token)
+        if (token == "depth")
+            is >> limits.depth;
+
+    if (limits.outFile.empty())
+    {
+        sync_cout << "An input and an output filename are required" << sync_endl;
+        return;
+    }
+
+    Threads.start_thinking(pos, states, limits);
+  }
+
+
+  // evalbatch() is called when engine receives the "evalbatch" command. All the
+  // positions of an EPD/FEN file are statically evaluated by the NNUE, a batch
+  // at a time, and the results are printed once each batch is done.
+
+  void evalbatch(istringstream& is) {
+
+    ready();
+
+    constexpr size_t BatchSize = 1024;
+
+    string filename, line;
+    is >> filename;
+
+    ifstream file(filename);
+    if (!file)
+    {
+        sync_cout << "Unable to open " << filename << sync_endl;
+        return;
+    }
+
+    if (!Eval::useNNUE)
+    {
+        sync_cout << "The NNUE evaluation is required" << sync_endl;
+        return;
+    }
+
+    Eval::NNUE::verify();
+    Threads.main()->wait_for_search_finished();
+
+    vector<Position> positions(BatchSize);
+    vector<StateInfo> states(BatchSize);
+    vector<const Position*> batch(BatchSize);
+    vector<Value> values(BatchSize);
+
+    for (size_t i = 0; i < BatchSize; ++i)
+        batch[i] = &positions[i];
+
+    while (file)
+    {
+        size_t count = 0;
+        string invalid;
+
+        // A bad record ends the batch early, to be reported in input order
+        while (count < BatchSize && getline(file, line))
+        {
+            string fen = UCI::epd_to_fen(line);
+
+            if (fen.empty())
+                continue;
+
+            if (!UCI::valid_fen(fen))
+            {
+                invalid = fen;
+                break;
+            }
+
+            positions[count].set(fen, Options["UCI_Chess960"], &states[count], Threads.main());
+            count++;
+        }
+
+        if (!count && invalid.empty())
+            break;
+
+        if (count)
+            Eval::NNUE::evaluate(batch.data(), count, values.data(), *Threads.main());
+
+        stringstream ss;
+        for (size_t i = 0; i < count; ++i)
+            ss << (i ? "\n" : "") << positions[i].fen() << "; eval " << UCI::value(values[i]);
+
+        if (!invalid.empty())
+            ss << (count ? "\n" : "") << invalid << "; invalid FEN";
+
+        sync_cout << ss.str() << sync_endl;
+    }
+  }
+
+
+  // nnuebench() is called when engine receives the "nnuebench" command. The
+  // parts of the NNUE evaluation are timed separately, on the bench positions
+  // or on the positions of a FEN file, and a report is printed.
+
+  void nnuebench(Position& pos, istringstream& is) {
+
+    ready();
+
+    string token;
+    int n, iterations = (is >> token) && (istringstream(token) >> n) ? n : 1000;
+    string fenFile = (is >> token) ? token : "default";
+
+    if (!Eval::useNNUE)
+    {
+        sync_cout << "The NNUE evaluation is required" << sync_endl;
+        return;
+    }
+
+    Eval::NNUE::verify();
+    Threads.main()->wait_for_search_finished();
+
+    istringstream args("16 1 1 " + fenFile);
+    deque<Position> positions;
+    vector<StateListPtr> states;
+    vector<Position*> list;
+
+    // Bad records of a FEN file are skipped, as by the batch commands
+    for (const auto& cmd : setup_bench(pos, args))
+        if (cmd.find("position fen ") == 0 && UCI::valid_fen(cmd.substr(13)))
+        {
+            istringstream ss(cmd);
+            ss >> token;
+            positions.emplace_back();
+            states.emplace_back();
+            position(positions.back(), ss, states.back());
+            list.push_back(&positions.back());
+        }
+
+    sync_cout << Eval::NNUE::benchmark(list.data(), list.size(), *Threads.main(), max(iterations, 1))
+              << sync_endl;
+  }
+
+
+  // attackbench() is called when engine receives the "attackbench" command.
+  // The sliding attacks backend is verified and timed, see Bitboards::benchmark().
+
+  void attackbench(istringstream& is) {
+
+    string token;
+    int n, iterations = (is >> token) && (istringstream(token) >> n) ? n : 2000;
+
+    sync_cout << Bitboards::benchmark(max(iterations, 1)) << sync_endl;
+  }
+
+
   // bench() is called when engine receives the "bench" command. Firstly
   // a list of UCI commands is setup according to bench parameters, then
   // it is run one by one printing a summary at the end.
 
   void bench(Position& pos, istream& args, StateListPtr& states) {
 
+    ready();
+
     string token;
     uint64_t num, nodes = 0, cnt = 1;
 
@@ -195,6 +383,35 @@ namespace {
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+#if defined(USE_TT_STATS)
+#if defined(USE_NNUE_CACHE)
+    uint64_t probes = 0, hits = 0;
+    for (Thread* th : Threads)
+        probes += th->evalCache.probes, hits += th->evalCache.hits;
+
+    if (probes)
+        cerr << "NNUE cache hits : " << std::fixed << std::setprecision(1)
+             << 100.0 * hits / probes << "% of " << probes << " probes" << endl;
+#endif
+
+    uint64_t pawnProbes = 0, pawnHits = 0, sharedProbes = 0, sharedHits = 0;
+    for (Thread* th : Threads)
+    {
+        pawnProbes   += th->pawnsTable.probes,       pawnHits   += th->pawnsTable.hits;
+        sharedProbes += th->pawnsTable.sharedProbes, sharedHits += th->pawnsTable.sharedHits;
+    }
+
+    if (pawnProbes)
+        cerr << "Pawn hash hits  : " << std::fixed << std::setprecision(1)
+             << 100.0 * pawnHits / pawnProbes << "% of " << pawnProbes << " probes" << endl;
+
+    if (sharedProbes)
+        cerr << "Shared pawn hits: " << std::fixed << std::setprecision(1)
+             << 100.0 * sharedHits / sharedProbes << "% of " << sharedProbes << " probes" << endl;
+
+    cerr << "\n" << TT.stats() << endl;
+#endif
   }
 
   // The win rate model returns the probability (per mille) of winning given an eval
@@ -267,24 +484,63 @@ void UCI::loop(int argc, char* argv[]) {
       else if (token == "setoption")  setoption(is);
       else if (token == "go")         go(pos, is, states);
       else if (token == "position")   position(pos, is, states);
-      else if (token == "ucinewgame") Search::clear();
-      else if (token == "isready")    sync_cout << "readyok" << sync_endl;
+      else if (token == "ucinewgame") { ready(); Search::clear(); }
+      else if (token == "isready")    { ready(); sync_cout << "readyok" << sync_endl; }
 
       // Additional custom non-UCI commands, mainly for debugging.
       // Do not use these commands during a search!
       else if (token == "flip")     pos.flip();
       else if (token == "bench")    bench(pos, is, states);
+      else if (token == "analyse")  analyse(pos, is, states);
+      else if (token == "evalbatch") evalbatch(is);
+      else if (token == "nnuebench") nnuebench(pos, is);
+      else if (token == "attackbench") attackbench(is);
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     trace_eval(pos);
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
+      else if (token == "startup")  sync_cout << Startup::report() << sync_endl;
+#if defined(USE_TT_STATS)
+      else if (token == "ttstats")  { ready(); sync_cout << TT.stats() << sync_endl; }
+#endif
       else if (token == "export_net")
       {
+          ready();
           std::optional<std::string> filename;
           std::string f;
           if (is >> skipws >> f)
               filename = f;
           Eval::NNUE::save_eval(filename);
       }
+      else if (token == "export_mapped_net")
+      {
+          ready();
+          std::string f;
+          if (!(is >> skipws >> f))
+              sync_cout << "A filename is required" << sync_endl;
+          else
+              Eval::NNUE::save_mapped_eval(f);
+      }
+      else if (token == "save_hash" || token == "load_hash")
+      {
+          ready();
+          std::string f;
+          if (!(is >> skipws >> f))
+              sync_cout << "A filename is required" << sync_endl;
+          else if (token == "save_hash")
+          {
+              // Called outside sync_cout, the search being waited for may print
+              bool saved = TT.save(f);
+              sync_cout << (saved ? "Hash saved successfully to " + f
+                                  : "Failed to save the hash to " + f) << sync_endl;
+          }
+          else
+          {
+              // Called outside sync_cout, load() may print an info string itself
+              bool loaded = TT.load(f);
+              sync_cout << (loaded ? "Hash loaded successfully from " + f
+                                   : "Failed to load the hash from " + f) << sync_endl;
+          }
+      }
       else if (!token.empty() && token[0] != '#')
           sync_cout << "Unknown command: " << cmd << sync_endl;
 
@@ -380,4 +636,120 @@ Move UCI::to_move(const Position& pos, string& str) {
   return MOVE_NONE;
 }
 
+
+/// UCI::epd_to_fen() returns the FEN fields of an EPD record, as used by the
+/// batch commands. EPD records have operations in place of the move counters,
+/// so only numeric fields are kept after the first four.
+
+string UCI::epd_to_fen(const string& record) {
+
+  istringstream ss(record);
+  string fen, token;
+
+  for (int i = 0; i < 6 && ss >> token; ++i)
+  {
+      if (i >= 4 && token.find_first_not_of("0123456789") != string::npos)
+          break;
+
+      fen += (i ? " " : "") + token;
+  }
+
+  return fen;
+}
+
+
+/// UCI::valid_fen() checks the fields of a FEN that Position::set() trusts,
+/// so that the batch commands can skip bad records: 8 ranks of 8 squares, one
+/// king per side and no pawn on the first or last rank, the side to move, castling
+/// rights with their king and rook on the first rank and the en passant square.
+/// Each side has at most 8 pawns, counting the pieces beyond the initial ones as
+/// promoted pawns, and so at most 16 pieces, the most that NNUE can evaluate.
+/// The side to move must not be able to capture the other king.
+
+bool UCI::valid_fen(const string& fen) {
+
+  istringstream ss(fen);
+  string board, side, castling = "-", ep = "-";
+  char grid[RANK_NB][FILE_NB];
+  int rank = RANK_8, file = FILE_A, kings[COLOR_NB] = {};
+  int pieceCount[COLOR_NB][PIECE_TYPE_NB] = {};
+
+  if (!(ss >> board >> side))
+      return false;
+
+  ss >> castling >> ep;
+
+  for (char c : board)
+  {
+      if (c == '/')
+      {
+          if (file != FILE_NB || rank == RANK_1)
+              return false;
+
+          --rank, file = FILE_A;
+      }
+      else if (c >= '1' && c <= '8')
+      {
+          if (file + (c - '0') > FILE_NB)
+              return false;
+
+          for (int n = c - '0'; n > 0; --n)
+              grid[rank][file++] = ' ';
+      }
+      else if (string("PNBRQKpnbrqk").find(c) != string::npos && file < FILE_NB)
+      {
+          if ((c == 'P' || c == 'p') && (rank == RANK_1 || rank == RANK_8))
+              return false;
+
+          kings[WHITE] += c == 'K', kings[BLACK] += c == 'k';
+          pieceCount[islower(c) ? BLACK : WHITE][string(" PNBRQK").find(char(toupper(c)))]++;
+          grid[rank][file++] = c;
+      }
+      else
+          return false;
+  }
+
+  if (rank != RANK_1 || file != FILE_NB || kings[WHITE] != 1 || kings[BLACK] != 1)
+      return false;
+
+  if (side != "w" && side != "b")
+      return false;
+
+  for (Color c : { WHITE, BLACK })
+  {
+      const int* pc = pieceCount[c];
+      int promoted =  std::max(pc[KNIGHT] - 2, 0) + std::max(pc[BISHOP] - 2, 0)
+                    + std::max(pc[ROOK] - 2, 0)   + std::max(pc[QUEEN] - 1, 0);
+
+      if (pc[PAWN] + promoted > 8)
+          return false;
+  }
+
+  if (castling != "-")
+      for (char c : castling)
+      {
+          Color us = islower(c) ? BLACK : WHITE;
+          const char* backRank = grid[relative_rank(us, RANK_1)];
+          const char king = us == WHITE ? 'K' : 'k', rook = us == WHITE ? 'R' : 'r';
+          const char* k = std::find(backRank, backRank + FILE_NB, king);
+          const char C = char(toupper(c));
+
+          if (   k == backRank + FILE_NB
+              || (C == 'K' && std::find(k, backRank + FILE_NB, rook) == backRank + FILE_NB)
+              || (C == 'Q' && std::find(backRank, k, rook) == k)
+              || (C >= 'A' && C <= 'H' && backRank[C - 'A'] != rook)
+              || (C != 'K' && C != 'Q' && (C < 'A' || C > 'H')))
+              return false;
+      }
+
+  if (ep != "-" && (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' || (ep[1] != '3' && ep[1] != '6')))
+      return false;
+
+  StateInfo st;
+  Position pos;
+  pos.set(fen, false, &st, Threads.main());
+
+  return !(pos.attackers_to(pos.square<KING>(~pos.side_to_move())) & pos.pieces(pos.side_to_move()));
+}
+
 } // namespace Stockfish
@@ -75,6 +75,8 @@ std::string move(Move m, bool chess960);
 std::string pv(const Position& pos, Depth depth, Value alpha, Value beta);
 std::string wdl(Value v, int ply);
 Move to_move(const Position& pos, std::string& str);
+std::string epd_to_fen(const std::string& record);
+bool valid_fen(const std::string& fen);
 
 } // namespace UCI
 
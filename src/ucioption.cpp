@@ -23,6 +23,7 @@
 
 #include "evaluate.h"
 #include "misc.h"
+#include "pawns.h"
 #include "search.h"
 #include "thread.h"
 #include "tt.h"
@@ -42,9 +43,16 @@ void on_clear_hash(const Option&) { Search::clear(); }
 void on_hash_size(const Option& o) { TT.resize(size_t(o)); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(size_t(o)); }
-void on_tb_path(const Option& o) { Tablebases::init(o); }
-void on_use_NNUE(const Option& ) { Eval::NNUE::init(); }
-void on_eval_file(const Option& ) { Eval::NNUE::init(); }
+void on_numa_policy(const Option&) { Threads.set(size_t(Options["Threads"])); }
+void on_thread_affinity(const Option&) { Threads.set(size_t(Options["Threads"])); }
+void on_tb_path(const Option& o) { if (Startup::finished()) Tablebases::init(o); }
+void on_use_NNUE(const Option& ) { if (Startup::finished()) Eval::NNUE::init(); }
+void on_eval_file(const Option& ) { if (Startup::finished()) Eval::NNUE::init(); }
+#if defined(USE_NNUE_CACHE)
+void on_nnue_cache(const Option& o) { Threads.run_on_all([&o](Thread& th) { th.evalCache.resize(size_t(o)); }); }
+#endif
+void on_pawn_hash(const Option& o) { Threads.run_on_all([&o](Thread& th) { th.pawnsTable.resize(size_t(o)); }); }
+void on_shared_pawn_hash(const Option& o) { Threads.main()->wait_for_search_finished(); Pawns::Shared.resize(size_t(o)); }
 
 /// Our case insensitive less() function as required by UCI protocol
 bool CaseInsensitiveLess::operator() (const string& s1, const string& s2) const {
@@ -58,12 +66,16 @@ bool CaseInsensitiveLess::operator() (const string& s1, const string& s2) const
 
 void init(OptionsMap& o) {
 
-  constexpr int MaxHashMB = Is64Bit ? 33554432 : 2048;
+  constexpr int MaxHashMB = TranspositionTable::MaxHashMB;
 
   o["Debug Log File"]        << Option("", on_logger);
   o["Threads"]               << Option(1, 1, 512, on_threads);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
+  o["NUMA Policy"]           << Option("None var None var Interleave var Partition", "None", on_numa_policy);
+  o["Thread Affinity"]       << Option("None var None var Cores var Socket var List", "None", on_thread_affinity);
+  o["CPU List"]              << Option("", on_thread_affinity);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Perft Hash"]            << Option(0, 0, MaxHashMB);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -81,6 +93,12 @@ void init(OptionsMap& o) {
   o["SyzygyProbeLimit"]      << Option(7, 0, 7);
   o["Use NNUE"]              << Option(true, on_use_NNUE);
   o["EvalFile"]              << Option(EvalFileDefaultName, on_eval_file);
+  o["EvalFileSmall"]         << Option("<empty>", on_eval_file);
+#if defined(USE_NNUE_CACHE)
+  o["NNUE Cache"]            << Option(0, 0, 1024, on_nnue_cache);
+#endif
+  o["Pawn Hash"]             << Option(12, 1, 1024, on_pawn_hash);
+  o["Shared Pawn Hash"]      << Option(0, 0, 4096, on_shared_pawn_hash);
 }
 
 
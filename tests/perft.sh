@@ -10,23 +10,34 @@ trap 'error ${LINENO}' ERR
 
 echo "perft testing started"
 
-cat << EOF > perft.exp
-   set timeout 10
-   lassign \$argv pos depth result
-   spawn ./stockfish
-   send "position \$pos\\ngo perft \$depth\\n"
-   expect "Nodes searched? \$result" {} timeout {exit 1}
-   send "quit\\n"
-   expect eof
-EOF
+# perft pos depth result [threads] [hash] [chess960]
+# go perft runs to the end before the following quit is read, so the
+# commands can be piped in without waiting for the output.
+perft()
+{
+  printf "setoption name Threads value %s\nsetoption name Perft Hash value %s\nsetoption name UCI_Chess960 value %s\nposition %s\ngo perft %s\nquit\n" \
+         "${4:-1}" "${5:-0}" "${6:-false}" "$1" "$2" \
+  | ./stockfish 2>&1 | grep -q "^Nodes searched: $3$"
+}
+
+perft startpos 5 4865609
+perft "fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -" 4 4085603
+perft "fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -" 5 193690690
+perft "fen 8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -" 5 674624
+perft "fen 8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -" 6 11030083
+perft "fen r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1" 5 15833292
+perft "fen rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8" 5 89941194
+perft "fen r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10" 5 164075551
 
-expect perft.exp startpos 5 4865609 > /dev/null
-expect perft.exp "fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -" 5 193690690 > /dev/null
-expect perft.exp "fen 8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -" 6 11030083 > /dev/null
-expect perft.exp "fen r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1" 5 15833292 > /dev/null
-expect perft.exp "fen rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8" 5 89941194 > /dev/null
-expect perft.exp "fen r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10" 5 164075551 > /dev/null
+# en passant capture giving a discovered check, and Chess960 castling
+perft "fen 8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1" 6 1440467
+perft "fen bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9" 5 8146062 1 0 true
+perft "fen 2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9" 5 16253601 1 0 true
 
-rm perft.exp
+# threaded split and the perft hash table
+perft "fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -" 5 193690690 4 0
+perft "fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -" 5 193690690 1 16
+perft "fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -" 5 193690690 4 16
+perft "fen 2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9" 5 16253601 1 16 true
 
 echo "perft testing OK"